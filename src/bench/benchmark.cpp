@@ -0,0 +1,750 @@
+/**
+ * @file benchmark.cpp
+ * @brief Benchmark suite for the codec, the threading models and the server
+ *
+ * Three suites, each reported as JSON records on stdout so runs can be
+ * compared and gated on regressions:
+ * - codec: encode and decode throughput by alphabet and message size
+ * - threads: thread-per-line against a shared-queue pool and the
+ *   work-stealing ThreadPool, at every thread count up to the CPUs
+ * - network: requests per second and latency percentiles of a running
+ *   server under a closed-loop load of pipelined NetworkClient connections
+ *
+ * Progress goes to stderr, so stdout holds only the report.
+ */
+
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../codec/shannon.h"
+#include "../codec/fixedAlphabet.h"
+#include "../codec/kernels.h"
+#include "../threading/threadPool.h"
+#include "../network/networkClient.h"
+#include "../network/protocol.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Configuration constants
+namespace BenchConfig {
+    constexpr double MIN_SECONDS = 0.2;             // Each measurement repeats for at least this long
+    constexpr size_t CODEC_SIZES[] = {64, 1024, 16 * 1024, 256 * 1024, 4 << 20};
+    constexpr size_t LINES = 2048;                  // Lines per threads-suite run
+    constexpr size_t LINE_SIZE = 2048;
+    constexpr size_t SKEW_PERIOD = 64;              // Every this many lines, one is SKEW_FACTOR times longer
+    constexpr size_t SKEW_FACTOR = 64;
+    constexpr unsigned CONNECTIONS = 4;             // Per load generator thread
+    constexpr unsigned DEPTH = 16;                  // Requests in flight per connection
+    constexpr size_t REQUESTS = 20000;
+    constexpr size_t MESSAGE_SIZE = 256;
+    constexpr size_t CORPUS_SIZE = 1 << 20;         // Network messages are windows of this
+    constexpr int MAX_EVENTS = 64;
+    constexpr uint64_t SEED = 42;
+}
+
+/**
+ * @class JsonRecord
+ * @brief One flat JSON object, fields kept in insertion order
+ */
+class JsonRecord {
+private:
+    std::vector<std::pair<std::string, std::string>> fields;    ///< Key and serialized value
+
+    static std::string quote(std::string_view text) {
+        std::string quoted = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') quoted += '\\';
+            quoted += c;
+        }
+        return quoted + '"';
+    }
+
+public:
+    JsonRecord& add(const std::string& key, std::string_view value) {
+        fields.emplace_back(key, quote(value));
+        return *this;
+    }
+
+    JsonRecord& add(const std::string& key, const char* value) {
+        return add(key, std::string_view(value));
+    }
+
+    JsonRecord& add(const std::string& key, double value) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.6g", value);
+        fields.emplace_back(key, text);
+        return *this;
+    }
+
+    JsonRecord& add(const std::string& key, uint64_t value) {
+        fields.emplace_back(key, std::to_string(value));
+        return *this;
+    }
+
+    std::string str() const {
+        std::string out = "{";
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (i > 0) out += ", ";
+            out += quote(fields[i].first) + ": " + fields[i].second;
+        }
+        return out + "}";
+    }
+};
+
+/**
+ * @struct Report
+ * @brief Every record of a run, printed as one JSON document
+ */
+struct Report {
+    std::vector<JsonRecord> results;
+
+    void print(std::ostream& out, unsigned cpus) const {
+        out << "{\n  \"kernel\": \"" << Shannon::encodeKernelName() << "\",\n"
+            << "  \"cpus\": " << cpus << ",\n  \"results\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            out << (i > 0 ? ",\n    " : "\n    ") << results[i].str();
+        }
+        out << "\n  ]\n}\n";
+    }
+};
+
+/**
+ * @struct Corpus
+ * @brief A kind of input and how to generate it
+ */
+struct Corpus {
+    const char* name;
+    Shannon::Alphabet alphabet;     ///< Hint for the fixed-alphabet encoders
+    std::string symbols;
+    bool zipf;                      ///< Symbol i has weight 1 / (i + 1); otherwise uniform
+};
+
+std::vector<Corpus> corpora() {
+    std::string bytes(256, '\0');
+    for (int i = 0; i < 256; ++i) bytes[i] = static_cast<char>(i);
+    return {
+        {"text", Shannon::Alphabet::ANY, " etaoinsrhldcumfpgwybvkxjqz", true},
+        {"dna", Shannon::Alphabet::DNA, "ACGT", true},
+        {"hex", Shannon::Alphabet::HEX, "0123456789abcdef", false},
+        {"base64", Shannon::Alphabet::BASE64,
+         "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/", false},
+        {"bytes", Shannon::Alphabet::ANY, bytes, true},
+    };
+}
+
+/**
+ * @brief length symbols drawn from corpus, the same for every run
+ */
+std::string generate(const Corpus& corpus, size_t length) {
+    std::vector<double> weights(corpus.symbols.size());
+    for (size_t i = 0; i < weights.size(); ++i) {
+        weights[i] = corpus.zipf ? 1.0 / (i + 1) : 1.0;
+    }
+    std::mt19937_64 random(BenchConfig::SEED);
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+
+    std::string data(length, '\0');
+    for (char& c : data) c = corpus.symbols[pick(random)];
+    return data;
+}
+
+const Corpus& findCorpus(const std::vector<Corpus>& all, const std::string& name) {
+    for (const auto& corpus : all) {
+        if (name == corpus.name) return corpus;
+    }
+    throw std::runtime_error("Unknown alphabet: " + name);
+}
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * @struct Timing
+ * @brief Runs of a measured body and the time they took together
+ */
+struct Timing {
+    uint64_t iterations = 0;
+    double seconds = 0;
+};
+
+/**
+ * @brief Runs body once to warm up, then repeatedly for at least minSeconds
+ */
+Timing measure(double minSeconds, const std::function<void()>& body) {
+    body();
+    Timing timing;
+    const Clock::time_point start = Clock::now();
+    do {
+        body();
+        ++timing.iterations;
+        timing.seconds = secondsSince(start);
+    } while (timing.seconds < minSeconds);
+    return timing;
+}
+
+double mibPerSecond(size_t bytes, const Timing& timing) {
+    return bytes * static_cast<double>(timing.iterations) / timing.seconds / (1 << 20);
+}
+
+// ---------------------------------------------------------------------------
+// Codec suite
+// ---------------------------------------------------------------------------
+
+void recordCodec(Report& report, const char* operation, const Corpus& corpus, size_t size, const Timing& timing) {
+    report.results.push_back(JsonRecord()
+        .add("suite", "codec").add("name", operation).add("alphabet", corpus.name)
+        .add("size", static_cast<uint64_t>(size)).add("iterations", timing.iterations)
+        .add("mib_per_s", mibPerSecond(size, timing))
+        .add("ns_per_byte", timing.seconds * 1e9 / (static_cast<double>(size) * timing.iterations)));
+}
+
+/**
+ * @brief Encode with a fresh table, encode with a ready one (generic and fixed-alphabet) and decode
+ * @throws std::runtime_error if a message does not decode to itself
+ */
+void benchCodec(Report& report, double minSeconds) {
+    const size_t largest = *std::max_element(std::begin(BenchConfig::CODEC_SIZES),
+                                             std::end(BenchConfig::CODEC_SIZES));
+    for (const Corpus& corpus : corpora()) {
+        const std::string data = generate(corpus, largest);
+        for (size_t size : BenchConfig::CODEC_SIZES) {
+            std::cerr << "[codec] " << corpus.name << " " << size << " bytes" << std::endl;
+            const std::string_view line(data.data(), size);
+
+            // Counting, table construction and encoding, as the server does per message
+            Shannon::EncodedMsg msg;
+            recordCodec(report, "encode", corpus, size, measure(minSeconds, [&] {
+                Shannon::shannonCode(line, msg);
+            }));
+
+            Shannon::Histogram hist{};
+            Shannon::countFrequencies(line.data(), line.size(), hist);
+            Shannon::CodeTable codes;
+            const std::vector<Shannon::CharCode> table = Shannon::buildCodeTable(hist, codes);
+
+            Shannon::BitStream encoded;
+            recordCodec(report, "encode_table", corpus, size, measure(minSeconds, [&] {
+                encoded = Shannon::encode(Shannon::Alphabet::ANY, line, hist, codes);
+            }));
+            if (corpus.alphabet != Shannon::Alphabet::ANY) {
+                recordCodec(report, "encode_fixed", corpus, size, measure(minSeconds, [&] {
+                    encoded = Shannon::encode(corpus.alphabet, line, hist, codes);
+                }));
+            }
+
+            const Shannon::Decoder decoder(table);
+            std::string decoded(size, '\0');
+            recordCodec(report, "decode", corpus, size, measure(minSeconds, [&] {
+                decoder.decode(encoded.bytes.data(), 0, encoded.bitCount, size, &decoded[0]);
+            }));
+            if (decoded != line) {
+                throw std::runtime_error(std::string("Decoding ") + corpus.name + " did not round-trip");
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Threads suite
+// ---------------------------------------------------------------------------
+
+/**
+ * @class SharedQueuePool
+ * @brief Baseline pool: every worker takes tasks from one queue behind one mutex
+ */
+class SharedQueuePool {
+private:
+    std::vector<pthread_t> workers;
+    std::deque<std::function<void()>> tasks;
+    size_t outstanding = 0;
+    bool stopping = false;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t taskReady = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t allDone = PTHREAD_COND_INITIALIZER;
+
+    static void* workerMain(void* void_ptr) {
+        SharedQueuePool* pool = static_cast<SharedQueuePool*>(void_ptr);
+        pthread_mutex_lock(&pool->mutex);
+        while (true) {
+            while (pool->tasks.empty() && !pool->stopping) {
+                pthread_cond_wait(&pool->taskReady, &pool->mutex);
+            }
+            if (pool->tasks.empty()) break;
+            std::function<void()> task = std::move(pool->tasks.front());
+            pool->tasks.pop_front();
+            pthread_mutex_unlock(&pool->mutex);
+            task();
+            pthread_mutex_lock(&pool->mutex);
+            if (--pool->outstanding == 0) pthread_cond_broadcast(&pool->allDone);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+        return nullptr;
+    }
+
+    void stop() {
+        pthread_mutex_lock(&mutex);
+        stopping = true;
+        pthread_cond_broadcast(&taskReady);
+        pthread_mutex_unlock(&mutex);
+        for (pthread_t tid : workers) pthread_join(tid, nullptr);
+        workers.clear();
+    }
+
+public:
+    /**
+     * @throws std::runtime_error if a worker cannot be created
+     */
+    explicit SharedQueuePool(unsigned threads) {
+        for (unsigned i = 0; i < threads; ++i) {
+            pthread_t tid;
+            if (pthread_create(&tid, nullptr, workerMain, this)) {
+                stop();
+                throw std::runtime_error("Error creating pool thread");
+            }
+            workers.push_back(tid);
+        }
+    }
+
+    ~SharedQueuePool() {
+        stop();
+    }
+
+    SharedQueuePool(const SharedQueuePool&) = delete;
+    SharedQueuePool& operator=(const SharedQueuePool&) = delete;
+
+    void submit(std::function<void()> task) {
+        pthread_mutex_lock(&mutex);
+        tasks.push_back(std::move(task));
+        ++outstanding;
+        pthread_cond_signal(&taskReady);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    void wait() {
+        pthread_mutex_lock(&mutex);
+        while (outstanding > 0) pthread_cond_wait(&allDone, &mutex);
+        pthread_mutex_unlock(&mutex);
+    }
+};
+
+/**
+ * @struct LineJob
+ * @brief One line of a threads-suite run and the message it is encoded into
+ */
+struct LineJob {
+    std::string_view line;
+    Shannon::EncodedMsg msg;
+};
+
+void* encodeLine(void* void_ptr) {
+    LineJob* job = static_cast<LineJob*>(void_ptr);
+    Shannon::shannonCode(job->line, job->msg);
+    return nullptr;
+}
+
+/**
+ * @brief The original model: one pthread per line, all joined at the end
+ * @throws std::runtime_error if a thread cannot be created
+ */
+void threadPerLine(std::vector<LineJob>& jobs) {
+    std::vector<pthread_t> threads;
+    threads.reserve(jobs.size());
+    for (auto& job : jobs) {
+        pthread_t tid;
+        if (pthread_create(&tid, nullptr, encodeLine, &job)) {
+            for (pthread_t started : threads) pthread_join(started, nullptr);
+            throw std::runtime_error("Error creating thread");
+        }
+        threads.push_back(tid);
+    }
+    for (pthread_t tid : threads) pthread_join(tid, nullptr);
+}
+
+void recordThreads(Report& report, const char* model, const char* workload, unsigned threads,
+                   size_t lines, size_t bytes, const Timing& timing, double baseline) {
+    const double seconds = timing.seconds / timing.iterations;
+    report.results.push_back(JsonRecord()
+        .add("suite", "threads").add("name", model).add("workload", workload)
+        .add("threads", static_cast<uint64_t>(threads)).add("lines", static_cast<uint64_t>(lines))
+        .add("iterations", timing.iterations)
+        .add("lines_per_s", lines / seconds).add("mib_per_s", mibPerSecond(bytes, timing))
+        .add("speedup", baseline > 0 ? baseline / seconds : 1.0));
+}
+
+/**
+ * @brief Powers of two below maxThreads, then maxThreads itself
+ */
+std::vector<unsigned> threadCounts(unsigned maxThreads) {
+    std::vector<unsigned> counts;
+    for (unsigned threads = 1; threads < maxThreads; threads *= 2) counts.push_back(threads);
+    counts.push_back(maxThreads);
+    return counts;
+}
+
+/**
+ * @brief Encodes a batch of lines under every threading model and thread count
+ *
+ * The skewed workload makes every SKEW_PERIOD-th line SKEW_FACTOR times
+ * longer, which strands the lines queued behind it unless idle workers steal.
+ */
+void benchThreads(Report& report, double minSeconds, size_t lineCount, unsigned maxThreads) {
+    const Corpus text = corpora()[0];
+    const std::string data = generate(text, BenchConfig::LINE_SIZE * BenchConfig::SKEW_FACTOR);
+
+    for (const bool skewed : {false, true}) {
+        const char* workload = skewed ? "skewed" : "uniform";
+        std::vector<LineJob> jobs(lineCount);
+        size_t bytes = 0;
+        for (size_t i = 0; i < lineCount; ++i) {
+            const bool longLine = skewed && i % BenchConfig::SKEW_PERIOD == 0;
+            const size_t length = BenchConfig::LINE_SIZE * (longLine ? BenchConfig::SKEW_FACTOR : 1);
+            const size_t offset = (i * 7919) % (data.size() - length + 1);
+            jobs[i].line = std::string_view(data).substr(offset, length);
+            bytes += length;
+        }
+
+        std::cerr << "[threads] " << workload << " thread-per-line" << std::endl;
+        recordThreads(report, "thread-per-line", workload, static_cast<unsigned>(lineCount), lineCount, bytes,
+                      measure(minSeconds, [&] { threadPerLine(jobs); }), 0);
+
+        double sharedBaseline = 0;
+        double stealingBaseline = 0;
+        for (unsigned threads : threadCounts(maxThreads)) {
+            std::cerr << "[threads] " << workload << " " << threads << " threads" << std::endl;
+            {
+                SharedQueuePool pool(threads);
+                const Timing timing = measure(minSeconds, [&] {
+                    for (auto& job : jobs) pool.submit([&job] { encodeLine(&job); });
+                    pool.wait();
+                });
+                if (threads == 1) sharedBaseline = timing.seconds / timing.iterations;
+                recordThreads(report, "shared-queue", workload, threads, lineCount, bytes, timing, sharedBaseline);
+            }
+            {
+                ThreadPool pool(threads);
+                const Timing timing = measure(minSeconds, [&] {
+                    for (auto& job : jobs) pool.submit([&job] { encodeLine(&job); });
+                    pool.wait();
+                });
+                if (threads == 1) stealingBaseline = timing.seconds / timing.iterations;
+                recordThreads(report, "work-stealing", workload, threads, lineCount, bytes, timing,
+                              stealingBaseline);
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Network suite
+// ---------------------------------------------------------------------------
+
+/**
+ * @struct LoadConfig
+ * @brief Shape of the load one generator thread offers
+ */
+struct LoadConfig {
+    sockaddr_in serv_addr;
+    unsigned connections = BenchConfig::CONNECTIONS;
+    unsigned depth = BenchConfig::DEPTH;
+    size_t requests = BenchConfig::REQUESTS;    ///< Answered requests to time, per generator
+    size_t warmup = 0;                          ///< Untimed requests before them
+    size_t messageSize = BenchConfig::MESSAGE_SIZE;
+    size_t batchLines = 1;                      ///< Lines per request; more than one sends BATCH
+    uint32_t staticTable = 0;
+    uint16_t flags = Protocol::FLAG_TABLE_IDS;
+    const std::string* corpus = nullptr;        ///< Messages are windows of it
+};
+
+/**
+ * @class LoadGenerator
+ * @brief Keeps depth requests in flight on each of its connections from one epoll loop
+ *
+ * Closed loop: every answer sends the next request on the same connection,
+ * so the offered load tracks what the server sustains and latencies
+ * include queueing behind the requests ahead.
+ */
+class LoadGenerator {
+private:
+    struct Pending {
+        Clock::time_point sent;
+        Batch batch;
+    };
+
+    const LoadConfig& config;
+    size_t index;                               ///< Spreads generators over the corpus
+    int epollFd = -1;
+    std::vector<std::unique_ptr<NetworkClient>> clients;
+    std::vector<std::unordered_map<uint32_t, Pending>> pending;   ///< Per connection, by request id
+    uint64_t nextSeq = 0;
+    size_t answered = 0;
+
+    Batch makeBatch(uint64_t seq) const {
+        const std::string& corpus = *config.corpus;
+        Batch batch;
+        batch.lines.resize(config.batchLines);
+        for (size_t i = 0; i < config.batchLines; ++i) {
+            const uint64_t message = (seq * config.batchLines + i) * 7919 + index * 104729;
+            const size_t offset = message % (corpus.size() - config.messageSize + 1);
+            batch.lines[i].line = std::string_view(corpus).substr(offset, config.messageSize);
+            batch.bytes += config.messageSize;
+        }
+        return batch;
+    }
+
+    void send(size_t connection) {
+        const uint32_t requestId = static_cast<uint32_t>(nextSeq);
+        Pending request{Clock::now(), makeBatch(nextSeq++)};
+        clients[connection]->queue(requestId, request.batch, config.staticTable, config.flags);
+        pending[connection].emplace(requestId, std::move(request));
+    }
+
+    size_t total() const { return config.warmup + config.requests; }
+
+    void receive(size_t connection) {
+        NetworkClient& client = *clients[connection];
+        bool more = true;
+        while (more) {
+            more = client.receive();
+            const char* frame;
+            uint64_t length;
+            while (client.nextFrame(frame, length)) {
+                const uint32_t requestId = Protocol::responseRequestId(frame, length);
+                auto it = pending[connection].find(requestId);
+                if (it == pending[connection].end()) {
+                    throw std::runtime_error("Response for unknown request " + std::to_string(requestId));
+                }
+                client.parse(frame, length, it->second.batch);
+                if (answered++ >= config.warmup) {
+                    latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - it->second.sent).count());
+                }
+                pending[connection].erase(it);
+                if (nextSeq < total()) send(connection);
+            }
+        }
+        client.flush();
+    }
+
+public:
+    std::vector<uint64_t> latencies;            ///< Nanoseconds per timed request
+    std::exception_ptr error;
+
+    LoadGenerator(const LoadConfig& config, size_t index) : config(config), index(index) {}
+
+    ~LoadGenerator() {
+        clients.clear();
+        if (epollFd >= 0) close(epollFd);
+    }
+
+    LoadGenerator(const LoadGenerator&) = delete;
+    LoadGenerator& operator=(const LoadGenerator&) = delete;
+
+    /**
+     * @throws std::runtime_error on connection failures or malformed responses
+     */
+    void run() {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            throw std::runtime_error("Error creating event loop");
+        }
+        latencies.reserve(config.requests);
+        pending.resize(config.connections);
+        for (unsigned i = 0; i < config.connections; ++i) {
+            clients.push_back(std::make_unique<NetworkClient>(config.serv_addr));
+            epoll_event event;
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.u64 = i;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clients[i]->descriptor(), &event) < 0) {
+                throw std::runtime_error("Error registering connection");
+            }
+        }
+        for (unsigned k = 0; k < config.depth; ++k) {
+            for (unsigned i = 0; i < config.connections && nextSeq < total(); ++i) send(i);
+        }
+        for (auto& client : clients) client->flush();
+
+        epoll_event events[BenchConfig::MAX_EVENTS];
+        while (answered < total()) {
+            const int n = epoll_wait(epollFd, events, BenchConfig::MAX_EVENTS, -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("Error waiting for events");
+            }
+            for (int i = 0; i < n; ++i) {
+                const size_t connection = events[i].data.u64;
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    receive(connection);
+                }
+                if (events[i].events & EPOLLOUT) {
+                    clients[connection]->flush();
+                }
+            }
+        }
+    }
+
+    static void* threadMain(void* void_ptr) {
+        LoadGenerator* generator = static_cast<LoadGenerator*>(void_ptr);
+        try {
+            generator->run();
+        } catch (...) {
+            generator->error = std::current_exception();
+        }
+        return nullptr;
+    }
+};
+
+/**
+ * @brief Drives a server with generators threads and records throughput and latency percentiles
+ * @throws The first generator's failure, or std::runtime_error if a thread cannot be created
+ */
+void benchNetwork(Report& report, const LoadConfig& config, unsigned generators, const char* alphabet) {
+    std::cerr << "[network] " << generators << " x " << config.connections << " connections, depth "
+              << config.depth << ", " << config.messageSize << " byte messages" << std::endl;
+
+    std::vector<std::unique_ptr<LoadGenerator>> load;
+    std::vector<pthread_t> threads;
+    const Clock::time_point start = Clock::now();
+    for (unsigned i = 0; i < generators; ++i) {
+        load.push_back(std::make_unique<LoadGenerator>(config, i));
+        pthread_t tid;
+        if (pthread_create(&tid, nullptr, LoadGenerator::threadMain, load.back().get())) {
+            for (pthread_t started : threads) pthread_join(started, nullptr);
+            throw std::runtime_error("Error creating load generator thread");
+        }
+        threads.push_back(tid);
+    }
+    for (pthread_t tid : threads) pthread_join(tid, nullptr);
+    const double seconds = secondsSince(start);
+
+    std::vector<uint64_t> latencies;
+    for (const auto& generator : load) {
+        if (generator->error) std::rethrow_exception(generator->error);
+        latencies.insert(latencies.end(), generator->latencies.begin(), generator->latencies.end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    const auto percentile = [&latencies](double fraction) {
+        if (latencies.empty()) return 0.0;
+        const size_t rank = static_cast<size_t>(fraction * (latencies.size() - 1) + 0.5);
+        return latencies[rank] / 1e3;
+    };
+    double mean = 0;
+    for (uint64_t latency : latencies) mean += latency / 1e3;
+    if (!latencies.empty()) mean /= latencies.size();
+
+    // Warmup requests count towards the wall time, so the rate is slightly conservative
+    const double requests = static_cast<double>(generators) * (config.warmup + config.requests);
+    report.results.push_back(JsonRecord()
+        .add("suite", "network").add("name", config.batchLines > 1 ? "batch" : "encode")
+        .add("alphabet", alphabet).add("size", static_cast<uint64_t>(config.messageSize))
+        .add("batch_lines", static_cast<uint64_t>(config.batchLines))
+        .add("generators", static_cast<uint64_t>(generators))
+        .add("connections", static_cast<uint64_t>(generators * config.connections))
+        .add("depth", static_cast<uint64_t>(config.depth))
+        .add("static_table", static_cast<uint64_t>(config.staticTable))
+        .add("requests", static_cast<uint64_t>(latencies.size()))
+        .add("seconds", seconds).add("requests_per_s", requests / seconds)
+        .add("mib_per_s", requests * config.batchLines * config.messageSize / seconds / (1 << 20))
+        .add("mean_us", mean).add("p50_us", percentile(0.50)).add("p90_us", percentile(0.90))
+        .add("p99_us", percentile(0.99)).add("p999_us", percentile(0.999)).add("max_us", percentile(1.0)));
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        const std::string usage = "Usage: " + std::string(argv[0]) +
+            " [codec] [threads] [network HOST PORT] [--seconds S] [--lines N] [--max-threads N]"
+            " [--generators N] [--connections N] [--depth N] [--requests N] [--size N] [--batch N]"
+            " [--alphabet text|dna|hex|base64|bytes] [--table ID]";
+
+        bool codec = false;
+        bool threads = false;
+        bool network = false;
+        std::string host;
+        int port = 0;
+        double minSeconds = BenchConfig::MIN_SECONDS;
+        size_t lines = BenchConfig::LINES;
+        unsigned maxThreads = ThreadPool::defaultThreadCount();
+        unsigned generators = 1;
+        std::string alphabet = "text";
+        LoadConfig load;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "codec") {
+                codec = true;
+            } else if (arg == "threads") {
+                threads = true;
+            } else if (arg == "network" && i + 2 < argc) {
+                network = true;
+                host = argv[++i];
+                port = std::stoi(argv[++i]);
+            } else if (arg == "--seconds" && i + 1 < argc) {
+                minSeconds = std::stod(argv[++i]);
+            } else if (arg == "--lines" && i + 1 < argc) {
+                lines = std::stoul(argv[++i]);
+            } else if (arg == "--max-threads" && i + 1 < argc) {
+                maxThreads = std::stoul(argv[++i]);
+            } else if (arg == "--generators" && i + 1 < argc) {
+                generators = std::stoul(argv[++i]);
+            } else if (arg == "--connections" && i + 1 < argc) {
+                load.connections = std::stoul(argv[++i]);
+            } else if (arg == "--depth" && i + 1 < argc) {
+                load.depth = std::stoul(argv[++i]);
+            } else if (arg == "--requests" && i + 1 < argc) {
+                load.requests = std::stoul(argv[++i]);
+            } else if (arg == "--size" && i + 1 < argc) {
+                load.messageSize = std::stoul(argv[++i]);
+            } else if (arg == "--batch" && i + 1 < argc) {
+                load.batchLines = std::stoul(argv[++i]);
+            } else if (arg == "--alphabet" && i + 1 < argc) {
+                alphabet = argv[++i];
+            } else if (arg == "--table" && i + 1 < argc) {
+                load.staticTable = std::stoul(argv[++i]);
+            } else {
+                throw std::runtime_error("Unknown option: " + arg + "\n" + usage);
+            }
+        }
+        if (!codec && !threads && !network) {
+            codec = threads = true;
+        }
+        if (lines == 0 || maxThreads == 0 || generators == 0 || load.connections == 0 || load.depth == 0 ||
+            load.requests == 0 || load.messageSize == 0 || load.batchLines == 0) {
+            throw std::runtime_error("Counts and sizes must be positive\n" + usage);
+        }
+
+        Report report;
+        if (codec) benchCodec(report, minSeconds);
+        if (threads) benchThreads(report, minSeconds, lines, maxThreads);
+        if (network) {
+            const std::vector<Corpus> all = corpora();
+            const Corpus& corpus = findCorpus(all, alphabet);
+            const std::string data = generate(corpus, std::max(BenchConfig::CORPUS_SIZE, load.messageSize));
+            load.serv_addr = resolveServer(host, port);
+            load.corpus = &data;
+            load.flags |= Protocol::alphabetFlags(corpus.alphabet);
+            load.warmup = std::min<size_t>(load.requests / 10, 1000);
+            benchNetwork(report, load, generators, corpus.name);
+        }
+        report.print(std::cout, ThreadPool::defaultThreadCount());
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
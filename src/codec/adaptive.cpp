@@ -0,0 +1,149 @@
+/**
+ * @file adaptive.cpp
+ * @brief One-pass encoding with code tables estimated from a sample
+ */
+
+#include "adaptive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace Shannon {
+
+namespace {
+    constexpr size_t SAMPLE_SLICES = 64;        // Spread of a sample over an input held in memory
+    constexpr size_t CHECK_INTERVAL = 64 * 1024; // Block bytes between drift checks
+
+    /**
+     * @brief counts with every unseen byte given a count of one, so it still has a code
+     */
+    Histogram smoothed(const Histogram& counts) {
+        Histogram hist = counts;
+        for (uint32_t& freq : hist) {
+            if (freq == 0) freq = 1;
+        }
+        return hist;
+    }
+
+    /**
+     * @brief Bits the symbols counted in hist would take with a table rebuilt from them
+     */
+    uint64_t rebuiltBitCount(const Histogram& hist) {
+        CodeTable own;
+        buildCodeTable(smoothed(hist), own);
+        return encodedBitCount(hist, own);
+    }
+}
+
+Histogram sampleHistogram(std::string_view data, size_t sampleSize) {
+    Histogram hist{};
+    if (data.size() <= sampleSize) {
+        countFrequencies(data.data(), data.size(), hist);
+        return hist;
+    }
+
+    const size_t sliceSize = std::max<size_t>(1, sampleSize / SAMPLE_SLICES);
+    const size_t slices = sampleSize / sliceSize;
+    const size_t stride = (data.size() - sliceSize) / std::max<size_t>(1, slices - 1);
+    for (size_t i = 0; i < slices; ++i) {
+        countFrequencies(data.data() + i * stride, sliceSize, hist);
+    }
+    return hist;
+}
+
+AdaptiveEncoder::AdaptiveEncoder(BlockSink sink, size_t blockSize, size_t sampleSize, double driftThreshold)
+    : sink(std::move(sink)), blockSize(blockSize), sampleSize(sampleSize), driftThreshold(driftThreshold) {
+    if (blockSize == 0 || sampleSize == 0) {
+        throw std::invalid_argument("Block and sample sizes must be positive");
+    }
+}
+
+void AdaptiveEncoder::useTable(const Histogram& counts, bool complete) {
+    // Unless counts cover all that is left, a byte they never saw may still turn up
+    buildCodeTable(complete ? counts : smoothed(counts), codes, table);
+    tableChanged = true;
+}
+
+void AdaptiveEncoder::seed(const Histogram& sample, bool complete) {
+    if (block || !prefix.empty()) {
+        throw std::logic_error("Adaptive encoder seeded after input");
+    }
+    useTable(sample, complete);
+    block = std::make_unique<TableEncoder>(codes);
+}
+
+void AdaptiveEncoder::encodePrefix(bool complete) {
+    Histogram sample{};
+    countFrequencies(prefix.data(), prefix.size(), sample);
+    useTable(sample, complete);
+    block = std::make_unique<TableEncoder>(codes);
+
+    const std::string held = std::move(prefix);
+    prefix.clear();
+    encode(held.data(), held.size());
+}
+
+void AdaptiveEncoder::append(const char* data, size_t length) {
+    if (!block) {
+        const size_t take = std::min(length, sampleSize - prefix.size());
+        prefix.append(data, take);
+        data += take;
+        length -= take;
+        if (prefix.size() < sampleSize) return;
+        encodePrefix(false);
+    }
+    encode(data, length);
+}
+
+void AdaptiveEncoder::encode(const char* data, size_t length) {
+    while (length > 0) {
+        // Stop at the next drift check, and where a line end or the size limit ends the block
+        const size_t limit = 2 * blockSize - blockBytes;
+        size_t take = std::min({length, limit, CHECK_INTERVAL - blockBytes % CHECK_INTERVAL});
+        bool ends = take == limit;
+        const size_t from = blockBytes + 1 >= blockSize ? 0 : blockSize - 1 - blockBytes;
+        if (from < take) {
+            const void* newline = std::memchr(data + from, '\n', take - from);
+            if (newline) {
+                take = static_cast<const char*>(newline) - data + 1;
+                ends = true;
+            }
+        }
+
+        countFrequencies(data, take, blockHist);
+        block->append(data, take);
+        blockBytes += take;
+        data += take;
+        length -= take;
+
+        if (ends || blockBytes % CHECK_INTERVAL == 0) {
+            const bool drift = encodedBitCount(blockHist, codes) > rebuiltBitCount(blockHist) * (1 + driftThreshold);
+            if (ends || drift) endBlock(drift);
+        }
+    }
+}
+
+void AdaptiveEncoder::endBlock(bool rebuild) {
+    const BitStream encoded = block->finish();
+    actualBits += encoded.bitCount;
+    estimatedBits += rebuiltBitCount(blockHist);
+    if (tableChanged) ++tables;
+    sink(tableChanged ? &table : nullptr, encoded, blockBytes);
+    tableChanged = false;
+
+    if (rebuild) useTable(blockHist, false);
+    block = std::make_unique<TableEncoder>(codes);
+    blockHist.fill(0);
+    blockBytes = 0;
+}
+
+void AdaptiveEncoder::finish() {
+    if (!block) {
+        if (prefix.empty()) return;
+        encodePrefix(true);     // The whole input fit in the sample
+    }
+    if (blockBytes > 0) endBlock(false);
+}
+
+} // namespace Shannon
@@ -0,0 +1,127 @@
+/**
+ * @file adaptive.h
+ * @brief One-pass encoding with code tables estimated from a sample
+ *
+ * Exact Shannon codes depend on the whole input, so an exact encoding either
+ * keeps all of it or reads it twice. The adaptive encoder instead builds its
+ * table from a sample, a prefix of a stream or evenly spaced slices of a
+ * file, and encodes every byte as it arrives, so each block is ready as soon
+ * as its last byte is in.
+ *
+ * Every 64 KiB, and at the end of each block, the bits spent on the block
+ * so far are compared with what a table rebuilt from it would have needed.
+ * When the excess passes the drift threshold the block ends there and the
+ * table is rebuilt from it, so the blocks after it use the new one.
+ * Estimated tables give every byte a code, so no input can fail.
+ */
+
+#ifndef SHANNON_ADAPTIVE_H
+#define SHANNON_ADAPTIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "shannon.h"
+#include "container.h"
+
+namespace Shannon {
+
+/// Bytes counted for the first table
+constexpr size_t DEFAULT_SAMPLE_SIZE = 64 * 1024;
+
+/// Extra bits over a block's own table, as a fraction, that trigger a rebuild
+constexpr double DEFAULT_DRIFT_THRESHOLD = 0.05;
+
+/**
+ * @brief Symbol counts of about sampleSize bytes of data, taken in evenly spaced slices
+ *
+ * Counts all of data if it is no longer than sampleSize.
+ */
+Histogram sampleHistogram(std::string_view data, size_t sampleSize = DEFAULT_SAMPLE_SIZE);
+
+/**
+ * @class AdaptiveEncoder
+ * @brief Encodes a stream block by block in one pass, switching tables when the data drifts
+ */
+class AdaptiveEncoder {
+public:
+    /**
+     * @brief Receives each finished block in order
+     * @param table The block's table if the previous block used another, otherwise nullptr
+     */
+    using BlockSink = std::function<void(const std::vector<CharCode>* table, const BitStream& encoded,
+                                         size_t symbols)>;
+
+    /**
+     * @param sink Called from append() and finish()
+     * @param blockSize A block ends at the first line end at or past this many bytes, at twice as many,
+     *                  or early where it drifts
+     * @throws std::invalid_argument if blockSize or sampleSize is zero
+     */
+    explicit AdaptiveEncoder(BlockSink sink, size_t blockSize = DEFAULT_BLOCK_SIZE,
+                             size_t sampleSize = DEFAULT_SAMPLE_SIZE,
+                             double driftThreshold = DEFAULT_DRIFT_THRESHOLD);
+
+    /**
+     * @brief Builds the first table from sample, so no prefix is held back
+     * @param complete sample counts the whole input, so unseen bytes need no codes
+     * @throws std::logic_error once bytes have been appended
+     */
+    void seed(const Histogram& sample, bool complete = false);
+
+    /**
+     * @brief Encodes length bytes of data; until there is a table, holds up to sampleSize of them
+     */
+    void append(const char* data, size_t length);
+
+    /**
+     * @brief Emits the last block
+     */
+    void finish();
+
+    /**
+     * @brief Tables the emitted blocks use
+     */
+    size_t tableCount() const { return tables; }
+
+    /**
+     * @brief Bits emitted so far over the bits tables rebuilt at every block would have needed
+     */
+    double overhead() const { return estimatedBits ? double(actualBits) / double(estimatedBits) - 1 : 0; }
+
+private:
+    BlockSink sink;
+    size_t blockSize;
+    size_t sampleSize;
+    double driftThreshold;
+
+    std::string prefix;                     ///< Bytes held until the first table is built
+    CodeTable codes;
+    std::vector<CharCode> table;
+    bool tableChanged = false;              ///< The next block is the first on table
+    size_t tables = 0;                      ///< Emitted with a block
+
+    std::unique_ptr<TableEncoder> block;    ///< Encodes the current block; null before the first table
+    Histogram blockHist{};
+    size_t blockBytes = 0;
+
+    uint64_t actualBits = 0;
+    uint64_t estimatedBits = 0;
+
+    /**
+     * @param complete counts cover the rest of the input, so unseen bytes need no codes
+     */
+    void useTable(const Histogram& counts, bool complete);
+    void encodePrefix(bool complete);   ///< Builds the first table from prefix, then encodes it
+    void encode(const char* data, size_t length);
+    void endBlock(bool rebuild);
+};
+
+} // namespace Shannon
+
+#endif // SHANNON_ADAPTIVE_H
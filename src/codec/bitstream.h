@@ -0,0 +1,181 @@
+/**
+ * @file bitstream.h
+ * @brief Packed bitstream container and writer for encoded messages
+ *
+ * Encoded messages are stored MSB-first, eight code bits per byte. The ASCII
+ * '0'/'1' form is only produced for display.
+ */
+
+#ifndef SHANNON_BITSTREAM_H
+#define SHANNON_BITSTREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Shannon {
+
+/**
+ * @class PageAllocator
+ * @brief Allocator that page-aligns large buffers and leaves new elements uninitialized
+ *
+ * A payload that starts on a page boundary can be sent with MSG_ZEROCOPY
+ * without pinning the heap data around it. Encoders overwrite everything
+ * they resize to, so growing a buffer does not clear it first.
+ */
+template <typename T>
+class PageAllocator {
+public:
+    using value_type = T;
+
+    static constexpr size_t PAGE_SIZE = 4096;
+    static constexpr size_t ALIGNED_SIZE = 64 * 1024;  ///< Smaller buffers come from operator new
+
+    PageAllocator() = default;
+    template <typename U>
+    PageAllocator(const PageAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        const size_t size = n * sizeof(T);
+        if (size < ALIGNED_SIZE) {
+            return static_cast<T*>(::operator new(size));
+        }
+        void* buffer = std::aligned_alloc(PAGE_SIZE, (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE);
+        if (!buffer) throw std::bad_alloc();
+        return static_cast<T*>(buffer);
+    }
+
+    void deallocate(T* buffer, size_t n) noexcept {
+        if (n * sizeof(T) < ALIGNED_SIZE) {
+            ::operator delete(buffer);
+        } else {
+            std::free(buffer);
+        }
+    }
+
+    /// Default-initializes, so resizing a byte buffer writes nothing
+    template <typename U>
+    void construct(U* p) noexcept { ::new (static_cast<void*>(p)) U; }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+
+    template <typename U>
+    bool operator==(const PageAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const PageAllocator<U>&) const noexcept { return false; }
+};
+
+/// Storage of packed code bits
+using PackedBytes = std::vector<uint8_t, PageAllocator<uint8_t>>;
+
+/**
+ * @struct BitStream
+ * @brief Packed encoded message
+ */
+struct BitStream {
+    PackedBytes bytes;            ///< Code bits packed MSB-first
+    uint64_t bitCount = 0;        ///< Number of valid bits in bytes
+};
+
+/**
+ * @brief Number of bytes needed to hold bitCount bits
+ */
+inline size_t packedSize(uint64_t bitCount) {
+    return (bitCount + 7) / 8;
+}
+
+/**
+ * @brief Bytes a BitWriter may touch when writing bitCount bits
+ *
+ * The writer always stores whole 64-bit words, so buffers are sized up to
+ * the next word. Trim to packedSize() once writing is finished.
+ */
+inline size_t writerCapacity(uint64_t bitCount) {
+    return ((bitCount + 63) / 64) * 8;
+}
+
+/**
+ * @class BitWriter
+ * @brief Appends variable-length codes through a 64-bit accumulator
+ *
+ * Codes are shifted into the accumulator and stored one big-endian word at a
+ * time. The caller provides a buffer of at least writerCapacity() bytes.
+ */
+class BitWriter {
+private:
+    uint8_t* out;
+    uint64_t acc = 0;
+    unsigned fill = 0;
+
+    void store(uint64_t word) {
+        word = __builtin_bswap64(word);
+        std::memcpy(out, &word, sizeof(word));
+        out += sizeof(word);
+    }
+
+public:
+    explicit BitWriter(uint8_t* buffer) : out(buffer) {}
+
+    /**
+     * @brief Appends the low length bits of bits (length <= 63)
+     *
+     * Encoders may merge several short codes into one call.
+     */
+    void put(uint64_t bits, unsigned length) {
+        if (length < 64 - fill) {
+            acc = (acc << length) | bits;
+            fill += length;
+            return;
+        }
+
+        // Top part completes the current word, the rest starts the next one
+        const unsigned spill = length - (64 - fill);
+        store((acc << (64 - fill)) | (bits >> spill));
+        acc = bits & ((uint64_t(1) << spill) - 1);
+        fill = spill;
+    }
+
+    /**
+     * @brief Bytes stored so far into the buffer that starts at buffer
+     */
+    size_t written(const uint8_t* buffer) const { return out - buffer; }
+
+    /**
+     * @brief Continues at position, e.g. the same offset in a buffer that grew
+     */
+    void rebase(uint8_t* position) { out = position; }
+
+    /**
+     * @brief Stores the partially filled last word, left-aligned
+     */
+    void finish() {
+        if (fill > 0) {
+            store(acc << (64 - fill));
+            acc = 0;
+            fill = 0;
+        }
+    }
+};
+
+/**
+ * @brief Renders a packed bitstream as '0'/'1' characters for display
+ */
+inline std::string toAscii(const BitStream& stream) {
+    std::string ascii(stream.bitCount, '0');
+    for (uint64_t i = 0; i < stream.bitCount; ++i) {
+        if ((stream.bytes[i >> 3] >> (7 - (i & 7))) & 1) {
+            ascii[i] = '1';
+        }
+    }
+    return ascii;
+}
+
+} // namespace Shannon
+
+#endif // SHANNON_BITSTREAM_H
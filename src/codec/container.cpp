@@ -0,0 +1,293 @@
+/**
+ * @file container.cpp
+ * @brief Seekable .shn archive of independently encoded blocks
+ */
+
+#include "container.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace Shannon {
+
+namespace {
+    constexpr char MAGIC[4] = {'S', 'H', 'N', 'C'};
+    constexpr uint32_t VERSION = 2;
+    constexpr uint32_t LEGACY_VERSION = 1;  // One table, at LEGACY_TABLE_OFFSET
+    constexpr size_t LEGACY_TABLE_OFFSET = sizeof(MAGIC) + sizeof(uint32_t) + sizeof(uint64_t);
+    constexpr size_t WRITE_WINDOW = 64;     // Blocks encoded ahead of the file write
+    constexpr size_t INDEX_ENTRY_SIZE = 4 * sizeof(uint64_t);
+    constexpr size_t LEGACY_ENTRY_SIZE = 3 * sizeof(uint64_t);
+    constexpr size_t FOOTER_SIZE = 2 * sizeof(uint64_t) + sizeof(MAGIC);
+
+    void runTasks(const ParallelFor& parallelFor, size_t count, const std::function<void(size_t)>& task) {
+        if (parallelFor) {
+            parallelFor(count, task);
+        } else {
+            for (size_t i = 0; i < count; ++i) task(i);
+        }
+    }
+
+    template <typename T>
+    void append(std::string& out, T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    /**
+     * @brief Bounds-checked reads from a container held in memory
+     */
+    class Cursor {
+    public:
+        Cursor(std::string_view file, size_t position) : file(file), position(position) {}
+
+        template <typename T>
+        T read() {
+            if (position > file.size() || file.size() - position < sizeof(T)) {
+                throw std::runtime_error("Container is truncated");
+            }
+            T value;
+            std::memcpy(&value, file.data() + position, sizeof(T));
+            position += sizeof(T);
+            return value;
+        }
+
+        size_t offset() const { return position; }
+
+    private:
+        std::string_view file;
+        size_t position;
+    };
+}
+
+ContainerWriter::ContainerWriter(const std::string& path)
+    : path(path), out(path, std::ios::binary | std::ios::trunc) {
+    if (!out) {
+        throw std::runtime_error("Cannot create container " + path);
+    }
+    std::string header(MAGIC, sizeof(MAGIC));
+    append(header, VERSION);
+    out.write(header.data(), header.size());
+    offset = header.size();
+}
+
+void ContainerWriter::writeTable(const std::vector<CharCode>& table) {
+    // Held until a block uses it, so every table in the file is referenced
+    pendingTable.clear();
+    append(pendingTable, static_cast<uint16_t>(table.size()));
+    for (const CharCode& charCode : table) {
+        append(pendingTable, static_cast<uint8_t>(charCode.character));
+        append(pendingTable, static_cast<uint32_t>(charCode.freq));
+    }
+}
+
+void ContainerWriter::writeBlock(const BitStream& encoded, uint64_t symbols) {
+    if (!pendingTable.empty()) {
+        out.write(pendingTable.data(), pendingTable.size());
+        tableOffset = offset;
+        offset += pendingTable.size();
+        pendingTable.clear();
+    }
+    if (tableOffset == 0) {
+        throw std::logic_error("Container block written before its table");
+    }
+
+    const size_t length = packedSize(encoded.bitCount);
+    out.write(reinterpret_cast<const char*>(encoded.bytes.data()), length);
+    append(index, offset);
+    append(index, encoded.bitCount);
+    append(index, symbols);
+    append(index, tableOffset);
+    offset += length;
+    ++blocks;
+}
+
+void ContainerWriter::finish() {
+    std::string footer;
+    append(footer, offset);
+    append(footer, static_cast<uint64_t>(blocks));
+    footer.append(MAGIC, sizeof(MAGIC));
+    out.write(index.data(), index.size());
+    out.write(footer.data(), footer.size());
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Error writing container " + path);
+    }
+}
+
+std::vector<std::string_view> splitBlocks(std::string_view data, size_t blockSize) {
+    std::vector<std::string_view> blocks;
+    size_t begin = 0;
+    while (begin < data.size()) {
+        size_t length = std::min(blockSize, data.size() - begin);
+        if (begin + length < data.size()) {
+            const void* newline = memrchr(data.data() + begin, '\n', length);
+            if (newline) {
+                length = static_cast<const char*>(newline) - (data.data() + begin) + 1;
+            }
+        }
+        blocks.push_back(data.substr(begin, length));
+        begin += length;
+    }
+    return blocks;
+}
+
+void writeContainer(std::string_view data, const std::string& path, size_t blockSize,
+                    const ParallelFor& parallelFor) {
+    if (blockSize == 0) {
+        throw std::invalid_argument("Block size must be positive");
+    }
+    if (data.size() > MAX_FREQ) {
+        throw std::invalid_argument("Container input must be under 2 GiB");  // Counts must fit CharCode::freq
+    }
+
+    const std::vector<std::string_view> blocks = splitBlocks(data, blockSize);
+    std::vector<Histogram> hists(blocks.size());
+    runTasks(parallelFor, blocks.size(), [&](size_t i) {
+        hists[i] = Histogram{};
+        countFrequencies(blocks[i].data(), blocks[i].size(), hists[i]);
+    });
+
+    Histogram hist{};
+    for (const Histogram& blockHist : hists) {
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            hist[symbol] += blockHist[symbol];
+        }
+    }
+    CodeTable codes;
+    ContainerWriter writer(path);
+    writer.writeTable(buildCodeTable(hist, codes));
+
+    std::vector<BitStream> encoded(std::min(WRITE_WINDOW, blocks.size()));
+    for (size_t start = 0; start < blocks.size(); start += WRITE_WINDOW) {
+        const size_t count = std::min(WRITE_WINDOW, blocks.size() - start);
+        runTasks(parallelFor, count, [&](size_t i) {
+            BitStream& stream = encoded[i];
+            stream.bitCount = encodedBitCount(hists[start + i], codes);
+            stream.bytes.resize(writerCapacity(stream.bitCount));
+            BitWriter bitWriter(stream.bytes.data());
+            encodeSymbols(blocks[start + i].data(), blocks[start + i].size(), codes, bitWriter);
+            bitWriter.finish();
+        });
+
+        for (size_t i = 0; i < count; ++i) {
+            writer.writeBlock(encoded[i], blocks[start + i].size());
+        }
+    }
+    writer.finish();
+}
+
+ContainerReader::ContainerReader(std::string_view file) : file(file) {
+    Cursor header(file, 0);
+    char magic[sizeof(MAGIC)];
+    for (char& c : magic) c = header.read<char>();
+    if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("Not a .shn container");
+    }
+    const uint32_t version = header.read<uint32_t>();
+    if (version != VERSION && version != LEGACY_VERSION) {
+        throw std::runtime_error("Unsupported container version");
+    }
+    const bool legacy = version == LEGACY_VERSION;
+    size_t expected = header.offset();
+    if (legacy) {
+        header.read<uint64_t>();    // Symbol count, which the index gives as well
+        expected = readTable(header.offset());
+    }
+
+    if (file.size() < expected + FOOTER_SIZE ||
+        std::memcmp(file.data() + file.size() - sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("Container is truncated");
+    }
+    Cursor footer(file, file.size() - FOOTER_SIZE);
+    const uint64_t indexOffset = footer.read<uint64_t>();
+    const uint64_t count = footer.read<uint64_t>();
+    const uint64_t indexEnd = file.size() - FOOTER_SIZE;
+    const size_t entrySize = legacy ? LEGACY_ENTRY_SIZE : INDEX_ENTRY_SIZE;
+    if (indexOffset < expected || indexOffset > indexEnd || count != (indexEnd - indexOffset) / entrySize ||
+        (indexEnd - indexOffset) % entrySize != 0) {
+        throw std::runtime_error("Container index is corrupt");
+    }
+
+    // Tables and blocks must tile the data section exactly, each table just before its first block
+    Cursor index(file, indexOffset);
+    blocks.reserve(count);
+    uint64_t tableOffset = legacy ? LEGACY_TABLE_OFFSET : 0;
+    uint64_t position = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        Block block;
+        block.offset = index.read<uint64_t>();
+        block.bitCount = index.read<uint64_t>();
+        block.symbols = index.read<uint64_t>();
+        block.position = position;
+        const uint64_t blockTable = legacy ? LEGACY_TABLE_OFFSET : index.read<uint64_t>();
+        if (!legacy && blockTable == expected && blockTable != tableOffset) {
+            tableOffset = blockTable;
+            expected = readTable(blockTable);
+        }
+        block.table = tables.size() - 1;
+        if (blockTable != tableOffset || tables.empty() || !tables.back().decoder || block.offset != expected ||
+            block.offset > indexOffset || block.bitCount > (indexOffset - block.offset) * 8 || block.symbols == 0) {
+            throw std::runtime_error("Container index is corrupt");
+        }
+        expected += packedSize(block.bitCount);
+        position += block.symbols;
+        blocks.push_back(block);
+    }
+    if (expected != indexOffset) {
+        throw std::runtime_error("Container index does not match its data");
+    }
+    totalSymbols = position;
+}
+
+size_t ContainerReader::readTable(size_t offset) {
+    Cursor record(file, offset);
+    const uint16_t tableSize = record.read<uint16_t>();
+    if (tableSize > 256) {
+        throw std::runtime_error("Container code table is corrupt");
+    }
+    Histogram hist{};
+    for (uint16_t i = 0; i < tableSize; ++i) {
+        const uint8_t symbol = record.read<uint8_t>();
+        const uint32_t freq = record.read<uint32_t>();
+        if (freq == 0 || hist[symbol] != 0) {
+            throw std::runtime_error("Container code table is corrupt");
+        }
+        hist[symbol] = freq;
+    }
+
+    Table table;
+    try {
+        table.charCodeVec = buildCodeTable(hist);
+        if (!table.charCodeVec.empty()) table.decoder = std::make_unique<Decoder>(table.charCodeVec);
+    } catch (const std::exception& e) {
+        throw std::runtime_error(std::string("Container code table is corrupt: ") + e.what());
+    }
+    tables.push_back(std::move(table));
+    return record.offset();
+}
+
+std::string ContainerReader::decode(size_t first, size_t last, const ParallelFor& parallelFor) const {
+    if (first > last || last > blocks.size()) {
+        throw std::out_of_range("Block range is outside the container");
+    }
+    if (first == last) return std::string();
+
+    const uint64_t begin = blocks[first].position;
+    const uint64_t end = blocks[last - 1].position + blocks[last - 1].symbols;
+    std::string out(end - begin, '\0');
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(file.data());
+
+    runTasks(parallelFor, last - first, [&](size_t i) {
+        const Block& block = blocks[first + i];
+        const uint64_t endBit = tables[block.table].decoder->decode(bytes + block.offset, 0, block.bitCount,
+                                                                    block.symbols, out.data() + (block.position - begin));
+        if (endBit != block.bitCount) {
+            throw std::invalid_argument("Container block does not match code table");
+        }
+    });
+    return out;
+}
+
+} // namespace Shannon
@@ -0,0 +1,166 @@
+/**
+ * @file container.h
+ * @brief Seekable .shn archive of independently encoded blocks
+ *
+ * The input is cut into blocks at line ends, each encoded on its own from a
+ * byte boundary. An index at the end of the file gives every block's
+ * offset, bit length, symbol count and code table, so any range of blocks
+ * can be decoded in parallel without reading the blocks before it.
+ * writeContainer() codes the whole input with one table; a one-pass
+ * encoder (see adaptive.h) may switch tables between blocks.
+ *
+ * Layout, native little-endian like the wire protocol:
+ * - header: magic "SHNC", u32 version
+ * - tables and blocks, each table directly before the first block coded
+ *   with it; a table is u16 size, then (u8 symbol, u32 count) per symbol,
+ *   and its codes are rebuilt from the counts
+ * - index: (u64 file offset, u64 bit count, u64 symbol count, u64 table
+ *   offset) per block
+ * - footer: u64 index offset, u64 block count, magic "SHNC"
+ *
+ * The index comes last so the writer never seeks back. Version 1 files,
+ * with one table after a u64 symbol count in the header and no table
+ * offsets in the index, are still read.
+ */
+
+#ifndef SHANNON_CONTAINER_H
+#define SHANNON_CONTAINER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "shannon.h"
+
+namespace Shannon {
+
+/// Input bytes per block; a block ends at the last line end within this
+constexpr size_t DEFAULT_BLOCK_SIZE = size_t(1) << 20;
+
+/**
+ * @brief Cuts data into blocks of at most blockSize bytes, each ending at its last line end
+ *
+ * A block with no line end is cut at blockSize.
+ */
+std::vector<std::string_view> splitBlocks(std::string_view data, size_t blockSize = DEFAULT_BLOCK_SIZE);
+
+/**
+ * @class ContainerWriter
+ * @brief Streams tables and encoded blocks into a container file
+ */
+class ContainerWriter {
+public:
+    /**
+     * @throws std::runtime_error if the file cannot be created
+     */
+    explicit ContainerWriter(const std::string& path);
+
+    /**
+     * @brief Sets the table the blocks that follow are coded with
+     *
+     * It goes into the file just before the first of those blocks.
+     */
+    void writeTable(const std::vector<CharCode>& table);
+
+    /**
+     * @brief Writes one block of symbols encoded with the last table written
+     * @throws std::logic_error if no table has been written
+     */
+    void writeBlock(const BitStream& encoded, uint64_t symbols);
+
+    /**
+     * @brief Writes the index and footer and closes the file
+     * @throws std::runtime_error if any write failed
+     */
+    void finish();
+
+    size_t blockCount() const { return blocks; }
+
+private:
+    std::string path;
+    std::ofstream out;
+    uint64_t offset = 0;            ///< Bytes written so far
+    uint64_t tableOffset = 0;       ///< Where the current table starts; 0 before the first
+    std::string pendingTable;       ///< Written before the next block
+    std::string index;
+    size_t blocks = 0;
+};
+
+/**
+ * @brief Encodes data into a container at path with one code table
+ *
+ * Blocks are counted and encoded in parallel, a bounded window of them at
+ * a time, and written in order.
+ * @param parallelFor Executes the per-block tasks; empty runs them inline
+ * @throws std::runtime_error if the file cannot be written
+ * @throws std::invalid_argument if blockSize is zero
+ */
+void writeContainer(std::string_view data, const std::string& path, size_t blockSize = DEFAULT_BLOCK_SIZE,
+                    const ParallelFor& parallelFor = ParallelFor());
+
+/**
+ * @class ContainerReader
+ * @brief Validated view of a container held in memory, such as a mapped file
+ */
+class ContainerReader {
+public:
+    /**
+     * @param file The whole container; must outlive the reader
+     * @throws std::runtime_error if file is not a well-formed container
+     */
+    explicit ContainerReader(std::string_view file);
+
+    size_t blockCount() const { return blocks.size(); }
+    size_t tableCount() const { return tables.size(); }
+    uint64_t symbolCount() const { return totalSymbols; }
+    const std::vector<CharCode>& table(size_t i) const { return tables[i].charCodeVec; }
+
+    /**
+     * @brief Decodes blocks first .. last - 1 into their original bytes
+     * @param parallelFor Executes one task per block; empty runs them inline
+     * @throws std::out_of_range if the range is not within the blocks
+     * @throws std::invalid_argument if a block's bits do not match the table
+     */
+    std::string decode(size_t first, size_t last, const ParallelFor& parallelFor = ParallelFor()) const;
+
+private:
+    /**
+     * @struct Block
+     * @brief One index entry and where its symbols go in the input
+     */
+    struct Block {
+        uint64_t offset;      ///< First byte in the file
+        uint64_t bitCount;
+        uint64_t symbols;
+        uint64_t position;    ///< Symbols in all earlier blocks
+        size_t table;         ///< Index into tables
+    };
+
+    /**
+     * @struct Table
+     * @brief One code table of the file and its decoder
+     */
+    struct Table {
+        std::vector<CharCode> charCodeVec;
+        std::unique_ptr<Decoder> decoder;
+    };
+
+    std::string_view file;
+    uint64_t totalSymbols = 0;
+    std::vector<Table> tables;
+    std::vector<Block> blocks;
+
+    /**
+     * @brief Adds the table record that starts at offset to tables
+     * @return Where the record ends
+     */
+    size_t readTable(size_t offset);
+};
+
+} // namespace Shannon
+
+#endif // SHANNON_CONTAINER_H
@@ -0,0 +1,164 @@
+/**
+ * @file decoder.cpp
+ * @brief Table-driven Shannon decoder
+ */
+
+#include "shannon.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace Shannon {
+
+namespace {
+    // Probes of LOOKUP_BITS each that fit in the 57 valid bits of one load
+    constexpr unsigned PROBES_PER_LOAD = 57 / Decoder::LOOKUP_BITS;
+
+    // Shorter messages decode faster by search than by first filling the table
+    constexpr size_t LOOKUP_MIN_SYMBOLS = size_t(1) << Decoder::LOOKUP_BITS;
+
+    /**
+     * @brief Loads at least 57 bits starting at bit pos, MSB-first, zero past endBit
+     */
+    uint64_t peekSafe(const uint8_t* bytes, uint64_t pos, uint64_t endBit) {
+        const uint64_t endByte = packedSize(endBit);
+        uint64_t window = 0;
+        for (uint64_t byte = pos >> 3, shift = 56; byte < endByte && shift < 64; ++byte, shift -= 8) {
+            window |= uint64_t(bytes[byte]) << shift;
+        }
+        return window << (pos & 7);
+    }
+}
+
+Decoder::Decoder(const std::vector<CharCode>& table) {
+    for (const auto& charCode : table) {
+        totalSymbols += charCode.freq;
+    }
+
+    if (table.size() == 1) {
+        singleSymbol = true;
+        onlySymbol = table.front().character;
+        return;
+    }
+
+    const CodeTable codes = makeCodeTable(table);
+    sortedCodes.reserve(table.size());
+    for (const auto& charCode : table) {
+        const unsigned char symbol = charCode.character;
+        if (codes.length[symbol] == 0) {
+            throw std::invalid_argument("Empty code in multi-symbol table");
+        }
+        const uint32_t aligned = codes.bits[symbol] << (CodeTable::MAX_CODE_LENGTH - codes.length[symbol]);
+        sortedCodes.push_back({aligned, codes.length[symbol], charCode.character});
+    }
+    std::sort(sortedCodes.begin(), sortedCodes.end(),
+              [](const LongCode& a, const LongCode& b) { return a.aligned < b.aligned; });
+
+    if (totalSymbols < LOOKUP_MIN_SYMBOLS) return;
+
+    // Fill each probe entry with as many complete codes as fit in its bits
+    lookup.resize(size_t(1) << LOOKUP_BITS);
+    for (uint32_t prefix = 0; prefix < lookup.size(); ++prefix) {
+        Entry& entry = lookup[prefix];
+        entry.count = 0;
+        entry.bits = 0;
+
+        while (entry.count < MAX_SYMBOLS_PER_ENTRY) {
+            const unsigned validBits = LOOKUP_BITS - entry.bits;
+            const uint32_t window = (prefix << (32 - LOOKUP_BITS)) << entry.bits;
+            const LongCode* code = match(window, validBits);
+            if (!code) break;
+
+            entry.symbols[entry.count++] = code->symbol;
+            entry.bits += code->length;
+        }
+    }
+}
+
+const Decoder::LongCode* Decoder::match(uint32_t window, unsigned validBits) const {
+    auto it = std::upper_bound(sortedCodes.begin(), sortedCodes.end(), window,
+                               [](uint32_t value, const LongCode& code) { return value < code.aligned; });
+    if (it == sortedCodes.begin()) return nullptr;
+    --it;
+
+    if (it->length > validBits) return nullptr;
+    if (((window ^ it->aligned) >> (32 - it->length)) != 0) return nullptr;
+    return &*it;
+}
+
+uint64_t Decoder::decode(const uint8_t* bytes, uint64_t firstBit, uint64_t endBit,
+                         size_t symbolCount, char* out) const {
+    if (singleSymbol) {
+        std::memset(out, onlySymbol, symbolCount);
+        return firstBit;
+    }
+
+    uint64_t pos = firstBit;
+    char* const outEnd = out + symbolCount;
+
+    // Fast path: one 64-bit load feeds several table probes
+    const uint64_t fastEnd = (endBit >= 64 && !lookup.empty()) ? ((endBit >> 3) - 8) * 8 : 0;
+    const ptrdiff_t slack = PROBES_PER_LOAD * MAX_SYMBOLS_PER_ENTRY;
+    while (pos < fastEnd && outEnd - out >= slack) {
+        uint64_t window;
+        std::memcpy(&window, bytes + (pos >> 3), sizeof(window));
+        window = __builtin_bswap64(window) << (pos & 7);
+
+        // At least 57 bits of the window are valid
+        unsigned used = 0;
+        for (unsigned probe = 0; probe < PROBES_PER_LOAD; ++probe) {
+            const Entry& entry = lookup[(window << used) >> (64 - LOOKUP_BITS)];
+            if (entry.count == 0) break;
+            std::memcpy(out, entry.symbols, MAX_SYMBOLS_PER_ENTRY);
+            out += entry.count;
+            used += entry.bits;
+        }
+
+        if (used == 0) {
+            const LongCode* code = match(static_cast<uint32_t>(window >> 32), 32);
+            if (!code) {
+                throw std::invalid_argument("Encoded message does not match code table");
+            }
+            *out++ = code->symbol;
+            used = code->length;
+        }
+        pos += used;
+    }
+
+    // Tail: one symbol at a time against a zero-padded window
+    while (out < outEnd) {
+        const uint64_t window = peekSafe(bytes, pos, endBit);
+        const unsigned validBits = (endBit - pos < 32) ? static_cast<unsigned>(endBit - pos) : 32;
+        const LongCode* code = match(static_cast<uint32_t>(window >> 32), validBits);
+        if (!code) {
+            throw std::invalid_argument("Encoded message does not match code table");
+        }
+        *out++ = code->symbol;
+        pos += code->length;
+    }
+
+    if (pos > endBit) {
+        throw std::invalid_argument("Encoded message does not match code table");
+    }
+    return pos;
+}
+
+std::string Decoder::decode(const BitStream& encoded) const {
+    if (encoded.bytes.size() < packedSize(encoded.bitCount)) {
+        throw std::invalid_argument("Encoded message is truncated");
+    }
+
+    std::string line(totalSymbols, '\0');
+    const uint64_t end = decode(encoded.bytes.data(), 0, encoded.bitCount, totalSymbols, line.data());
+    if (end != encoded.bitCount) {
+        throw std::invalid_argument("Encoded message does not match code table");
+    }
+    return line;
+}
+
+std::string decode(const BitStream& encoded, const std::vector<CharCode>& table) {
+    return Decoder(table).decode(encoded);
+}
+
+} // namespace Shannon
@@ -0,0 +1,105 @@
+/**
+ * @file fixedAlphabet.cpp
+ * @brief Run-time selection of the specialized fixed-alphabet encoders
+ */
+
+#include "fixedAlphabet.h"
+#include "../metrics/metrics.h"
+
+namespace Shannon {
+
+namespace {
+    // Four equally likely bases take two bits each, worked out by the compiler
+    constexpr FixedCodes<4> UNIFORM_DNA = makeFixedCodes<Alphabets::Dna>({1, 1, 1, 1});
+    static_assert(UNIFORM_DNA.length[0] == 2 && UNIFORM_DNA.length[3] == 2, "Uniform DNA codes are two bits");
+
+    template <typename A>
+    constexpr std::array<bool, 256> membership() {
+        std::array<bool, 256> member{};
+        for (char symbol : A::symbols) member[static_cast<unsigned char>(symbol)] = true;
+        return member;
+    }
+
+    template <typename A>
+    bool containsOnly(const Histogram& hist) {
+        static constexpr std::array<bool, 256> member = membership<A>();
+        uint32_t outside = 0;
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            outside |= member[symbol] ? 0 : hist[symbol];
+        }
+        return outside == 0;
+    }
+
+    template <typename Encoder>
+    bool encodeSpans(std::string_view line, const CodeTable& codes, BitWriter& writer) {
+        if (Encoder::SPAN == 1 || line.length() < Encoder::SPAN_MIN_LENGTH) return false;
+        Metrics::StageTimer timer(Metrics::Stage::ENCODE);
+        Encoder::encode(line, fixedCodes<typename Encoder::Symbols>(codes), writer);
+        return true;
+    }
+
+    /**
+     * @brief Runs the instance of FixedEncoder<A> for the table's longest code if it uses spans
+     * @return false if line was left for the generic encoder
+     */
+    template <typename A>
+    bool encodeFixed(std::string_view line, const CodeTable& codes, BitWriter& writer) {
+        if (codes.maxLength <= 3) return encodeSpans<FixedEncoder<A, 3>>(line, codes, writer);
+        if (codes.maxLength <= 5) return encodeSpans<FixedEncoder<A, 5>>(line, codes, writer);
+        if (codes.maxLength <= 7) return encodeSpans<FixedEncoder<A, 7>>(line, codes, writer);
+        if (codes.maxLength <= 15) return encodeSpans<FixedEncoder<A, 15>>(line, codes, writer);
+        return false;   // Two codes no longer fit one 32-bit entry
+    }
+}
+
+bool inAlphabet(Alphabet alphabet, const Histogram& hist) {
+    switch (alphabet) {
+        case Alphabet::DNA:
+            return containsOnly<Alphabets::Dna>(hist);
+        case Alphabet::HEX:
+            return containsOnly<Alphabets::Hex>(hist);
+        case Alphabet::BASE64:
+            return containsOnly<Alphabets::Base64>(hist);
+        case Alphabet::ANY:
+            break;
+    }
+    return true;
+}
+
+BitStream encode(Alphabet alphabet, std::string_view line, const Histogram& hist, const CodeTable& codes) {
+    BitStream encoded;
+    encode(alphabet, line, hist, codes, encoded);
+    return encoded;
+}
+
+void encode(Alphabet alphabet, std::string_view line, const Histogram& hist, const CodeTable& codes,
+            BitStream& encoded) {
+    const uint64_t totalBits = encodedBitCount(hist, codes);
+
+    encoded.bytes.resize(writerCapacity(totalBits));
+    encoded.bitCount = totalBits;
+    BitWriter writer(encoded.bytes.data());
+
+    bool specialized = false;
+    switch (inAlphabet(alphabet, hist) ? alphabet : Alphabet::ANY) {
+        case Alphabet::DNA:
+            specialized = encodeFixed<Alphabets::Dna>(line, codes, writer);
+            break;
+        case Alphabet::HEX:
+            specialized = encodeFixed<Alphabets::Hex>(line, codes, writer);
+            break;
+        case Alphabet::BASE64:
+            specialized = encodeFixed<Alphabets::Base64>(line, codes, writer);
+            break;
+        case Alphabet::ANY:
+            break;
+    }
+    if (!specialized) {
+        encodeSymbols(line.data(), line.length(), codes, writer);
+    }
+
+    writer.finish();
+    encoded.bytes.resize(packedSize(totalBits));
+}
+
+} // namespace Shannon
@@ -0,0 +1,312 @@
+/**
+ * @file fixedAlphabet.h
+ * @brief Encoders specialized at compile time on a fixed alphabet
+ *
+ * Streams known to be DNA, hex or base64 use a handful of symbols. An
+ * encoder specialized on the alphabet and on the longest code can look up
+ * several symbols at once in a table of every short string of them, and
+ * merges a compile-time number of lookups per write with no per-symbol
+ * branches. The bits are the same as the generic encoder's, so results
+ * decode with the usual tables.
+ */
+
+#ifndef SHANNON_FIXED_ALPHABET_H
+#define SHANNON_FIXED_ALPHABET_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+#include "shannon.h"
+
+namespace Shannon {
+
+/**
+ * @enum Alphabet
+ * @brief Fixed alphabets with a specialized encoder
+ */
+enum class Alphabet : uint8_t {
+    ANY = 0,        ///< No specialization
+    DNA = 1,        ///< ACGT
+    HEX = 2,        ///< 0-9, A-F, a-f
+    BASE64 = 3,     ///< A-Z, a-z, 0-9, +, / and = padding
+};
+
+/**
+ * @brief Position of every byte in symbols; bytes outside it map to 0
+ */
+constexpr std::array<uint8_t, 256> indexTable(std::string_view symbols) {
+    std::array<uint8_t, 256> positions{};
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        positions[static_cast<unsigned char>(symbols[i])] = static_cast<uint8_t>(i);
+    }
+    return positions;
+}
+
+namespace Alphabets {
+    struct Dna {
+        static constexpr std::string_view symbols = "ACGT";
+
+        /// A, C, T and G already differ in bits 1-2, so no table is needed
+        static constexpr unsigned index(unsigned char symbol) { return (symbol >> 1) & 3; }
+    };
+
+    struct Hex {
+        static constexpr std::string_view symbols = "0123456789ABCDEFabcdef";
+        static constexpr std::array<uint8_t, 256> positions = indexTable(symbols);
+
+        static constexpr unsigned index(unsigned char symbol) { return positions[symbol]; }
+    };
+
+    struct Base64 {
+        static constexpr std::string_view symbols =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=";
+        static constexpr std::array<uint8_t, 256> positions = indexTable(symbols);
+
+        static constexpr unsigned index(unsigned char symbol) { return positions[symbol]; }
+    };
+}
+
+/**
+ * @struct FixedCodes
+ * @brief Codes of an N-symbol alphabet, indexed by position in the alphabet
+ */
+template <size_t N>
+struct FixedCodes {
+    std::array<uint32_t, N> bits{};     ///< Code bits, right-aligned
+    std::array<uint8_t, N> length{};    ///< Code length in bits
+};
+
+/**
+ * @brief The codes of A's symbols in a direct-indexed table
+ */
+template <typename A>
+FixedCodes<A::symbols.size()> fixedCodes(const CodeTable& codes) {
+    FixedCodes<A::symbols.size()> fixed;
+    for (size_t i = 0; i < A::symbols.size(); ++i) {
+        const unsigned char symbol = A::symbols[i];
+        fixed.bits[A::index(symbol)] = codes.bits[symbol];
+        fixed.length[A::index(symbol)] = codes.length[symbol];
+    }
+    return fixed;
+}
+
+/**
+ * @brief Shannon codes of A's symbols for freqs, as buildCodeTable would make them
+ *
+ * Usable in constant expressions, so a static table known at compile time
+ * costs nothing at run time:
+ * constexpr auto codes = makeFixedCodes<Alphabets::Dna>({30, 20, 20, 30});
+ * @param freqs Counts in the order of A::symbols
+ * @throws std::length_error if a code exceeds CodeTable::MAX_CODE_LENGTH
+ */
+template <typename A>
+constexpr FixedCodes<A::symbols.size()> makeFixedCodes(const std::array<uint32_t, A::symbols.size()>& freqs) {
+    constexpr size_t N = A::symbols.size();
+
+    // Same order as compareFreqChar; insertion sort, since std::sort is not constexpr
+    std::array<size_t, N> order{};
+    size_t count = 0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < N; ++i) {
+        if (freqs[i] == 0) continue;
+        total += freqs[i];
+        size_t j = count++;
+        for (; j > 0; --j) {
+            const size_t other = order[j - 1];
+            const bool before = (freqs[i] != freqs[other]) ? (freqs[i] > freqs[other])
+                                                           : (A::symbols[i] > A::symbols[other]);
+            if (!before) break;
+            order[j] = other;
+        }
+        order[j] = i;
+    }
+
+    FixedCodes<N> codes;
+    uint64_t cumulative = 0;
+    for (size_t k = 0; k < count; ++k) {
+        const size_t i = order[k];
+        const unsigned length = codeLength(freqs[i], total);
+        if (length > CodeTable::MAX_CODE_LENGTH) {
+            throw std::length_error("Shannon code too long");
+        }
+        const unsigned position = A::index(static_cast<unsigned char>(A::symbols[i]));
+        codes.bits[position] = codeBits(cumulative, total, length);
+        codes.length[position] = static_cast<uint8_t>(length);
+        cumulative += freqs[i];
+    }
+    return codes;
+}
+
+/**
+ * @brief Symbols per lookup for an alphabet of size symbols and codes of at most maxLength bits
+ *
+ * As many as keep a table of every string of that many symbols within
+ * maxEntries entries of at most 32 bits.
+ */
+constexpr unsigned spanLength(size_t size, unsigned maxLength, size_t maxEntries) {
+    unsigned span = 1;
+    size_t entries = size;
+    while (span < 8 && (span + 1) * maxLength <= 32 && entries * size <= maxEntries) {
+        ++span;
+        entries *= size;
+    }
+    return span;
+}
+
+/**
+ * @brief base to the power exponent
+ */
+constexpr size_t power(size_t base, unsigned exponent) {
+    size_t result = 1;
+    for (unsigned i = 0; i < exponent; ++i) result *= base;
+    return result;
+}
+
+/**
+ * @class FixedEncoder
+ * @brief Encoder for alphabet A whose codes are at most MaxLength bits
+ *
+ * Codes are merged into words of up to 63 bits, pairwise as a tree so the
+ * merges of one word run in parallel. Small alphabets look up SPAN symbols
+ * at once in a table of every SPAN-symbol string, built per message when the
+ * message is at least SPAN_MIN_LENGTH long; shorter ones, and alphabets too
+ * big for a span table, look up one symbol at a time.
+ */
+template <typename A, unsigned MaxLength>
+class FixedEncoder {
+public:
+    using Symbols = A;
+    static constexpr size_t SIZE = A::symbols.size();
+    static constexpr size_t MAX_TABLE = 1024;
+    static constexpr unsigned SPAN = spanLength(SIZE, MaxLength, MAX_TABLE);
+    static constexpr size_t TABLE_SIZE = power(SIZE, SPAN);
+
+    /// Shorter messages would spend longer building the span table than using it
+    static constexpr size_t SPAN_MIN_LENGTH = 16 * TABLE_SIZE;
+
+    static_assert(MaxLength <= CodeTable::MAX_CODE_LENGTH, "Codes are at most 32 bits");
+
+    /**
+     * @brief Appends the codes of line, every symbol of which must be in A
+     */
+    static void encode(std::string_view line, const FixedCodes<SIZE>& codes, BitWriter& writer) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(line.data());
+        const size_t length = line.length();
+
+        if constexpr (SPAN > 1) {
+            if (length >= SPAN_MIN_LENGTH) {
+                encodeSpans(bytes, length, codes, writer);
+                return;
+            }
+        }
+
+        std::array<uint64_t, SIZE> entries;
+        for (size_t i = 0; i < SIZE; ++i) {
+            entries[i] = pack(codes.bits[i], codes.length[i]);
+        }
+        encodeWith<1>(bytes, length, writer, [&entries](const unsigned char* symbol) {
+            return unpack(entries[A::index(*symbol)]);
+        });
+    }
+
+private:
+    struct Code {
+        uint64_t bits;
+        unsigned length;
+    };
+
+    /// Bits and length side by side, so a lookup costs one load
+    static constexpr uint64_t pack(uint64_t bits, unsigned length) { return bits | (uint64_t(length) << 32); }
+    static constexpr Code unpack(uint64_t entry) {
+        return Code{entry & 0xFFFFFFFF, static_cast<unsigned>(entry >> 32)};
+    }
+
+    static void encodeSpans(const unsigned char* bytes, size_t length, const FixedCodes<SIZE>& codes,
+                            BitWriter& writer) {
+        // Entry i * SIZE + j is string i followed by symbol j
+        std::array<uint64_t, TABLE_SIZE> table;
+        for (size_t j = 0; j < SIZE; ++j) table[j] = pack(codes.bits[j], codes.length[j]);
+        for (size_t entries = SIZE; entries < TABLE_SIZE; entries *= SIZE) {
+            for (size_t i = entries; i-- > 0;) {
+                const Code front = unpack(table[i]);
+                for (size_t j = 0; j < SIZE; ++j) {
+                    table[i * SIZE + j] = pack((front.bits << codes.length[j]) | codes.bits[j],
+                                               front.length + codes.length[j]);
+                }
+            }
+        }
+
+        const size_t spans = length / SPAN;
+        encodeWith<SPAN>(bytes, spans * SPAN, writer, [&table](const unsigned char* symbols) {
+            size_t index = 0;
+            for (unsigned k = 0; k < SPAN; ++k) index = index * SIZE + A::index(symbols[k]);
+            return unpack(table[index]);
+        });
+        for (size_t i = spans * SPAN; i < length; ++i) {
+            const unsigned position = A::index(bytes[i]);
+            writer.put(codes.bits[position], codes.length[position]);
+        }
+    }
+
+    /**
+     * @brief The codes of Count lookups merged into one word, earliest in front
+     */
+    template <unsigned Count, unsigned Span, typename Lookup>
+    static Code merge(const unsigned char* bytes, const Lookup& lookup) {
+        if constexpr (Count == 1) {
+            return lookup(bytes);
+        } else {
+            const Code front = merge<Count / 2, Span>(bytes, lookup);
+            const Code back = merge<Count - Count / 2, Span>(bytes + (Count / 2) * Span, lookup);
+            return Code{(front.bits << back.length) | back.bits, front.length + back.length};
+        }
+    }
+
+    /**
+     * @brief Encodes length bytes, a multiple of Span, Span symbols per lookup
+     */
+    template <unsigned Span, typename Lookup>
+    static void encodeWith(const unsigned char* bytes, size_t length, BitWriter& writer, const Lookup& lookup) {
+        constexpr unsigned GROUP = (MaxLength == 0) ? 1 : 63 / (Span * MaxLength);
+        constexpr size_t STEP = GROUP * Span;
+
+        size_t i = 0;
+        for (; i + STEP <= length; i += STEP) {
+            const Code word = merge<GROUP, Span>(bytes + i, lookup);
+            writer.put(word.bits, word.length);
+        }
+        for (; i < length; i += Span) {
+            const Code code = lookup(bytes + i);
+            writer.put(code.bits, code.length);
+        }
+    }
+};
+
+/**
+ * @brief Whether every symbol counted in hist belongs to alphabet; always true for ANY
+ */
+bool inAlphabet(Alphabet alphabet, const Histogram& hist);
+
+/**
+ * @brief Encodes line, whose symbols are counted in hist, with a ready code table
+ *
+ * Uses the encoder specialized for alphabet and the table's longest code
+ * when it can use span lookups; the generic encode kernels are as fast
+ * otherwise. A line with symbols outside the alphabet is encoded by the
+ * generic encoder too, so the alphabet is only ever a hint.
+ * @throws std::invalid_argument if a counted symbol has no code
+ */
+BitStream encode(Alphabet alphabet, std::string_view line, const Histogram& hist, const CodeTable& codes);
+
+/**
+ * @brief As encode(), into encoded, reusing the capacity of its buffer
+ */
+void encode(Alphabet alphabet, std::string_view line, const Histogram& hist, const CodeTable& codes,
+            BitStream& encoded);
+
+} // namespace Shannon
+
+#endif // SHANNON_FIXED_ALPHABET_H
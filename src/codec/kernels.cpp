@@ -0,0 +1,229 @@
+/**
+ * @file kernels.cpp
+ * @brief Scalar, AVX2 and AVX-512 encode kernels and their run-time selection
+ *
+ * Codes of at most 7, 15 or 31 bits are merged eight, four or two at a time
+ * into words of at most 63 bits, so the writer sees a fraction of the calls.
+ * The vector kernels gather the bits and lengths of 8 or 16 symbols and do
+ * the merging in 64-bit lanes. There is no NEON kernel: NEON has no gather,
+ * so ARM builds use the merging scalar kernel.
+ */
+
+#include "kernels.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace Shannon {
+
+namespace {
+    /**
+     * @brief Encodes Group symbols per writer call; Group * codes.maxLength <= 63
+     */
+    template <unsigned Group>
+    void encodeGroups(const unsigned char* bytes, size_t length, const CodeTable& codes, BitWriter& writer) {
+        size_t i = 0;
+        for (; i + Group <= length; i += Group) {
+            uint64_t word = 0;
+            unsigned wordLength = 0;
+            for (unsigned k = 0; k < Group; ++k) {
+                const unsigned symbolLength = codes.length[bytes[i + k]];
+                word = (word << symbolLength) | codes.bits[bytes[i + k]];
+                wordLength += symbolLength;
+            }
+            writer.put(word, wordLength);
+        }
+        for (; i < length; ++i) {
+            writer.put(codes.bits[bytes[i]], codes.length[bytes[i]]);
+        }
+    }
+
+    void encodeScalar(const char* data, size_t length, const CodeTable& codes, BitWriter& writer) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        if (codes.maxLength == 0) return;   // Single-symbol alphabet: every code is empty
+
+        if (codes.maxLength <= 7) {
+            encodeGroups<8>(bytes, length, codes, writer);
+        } else if (codes.maxLength <= 15) {
+            encodeGroups<4>(bytes, length, codes, writer);
+        } else if (codes.maxLength <= 31) {
+            encodeGroups<2>(bytes, length, codes, writer);
+        } else {
+            encodeGroups<1>(bytes, length, codes, writer);
+        }
+    }
+
+#if defined(__x86_64__)
+    /*
+     * The lengths are bytes, so they are gathered as the 32-bit word that
+     * ends at the wanted byte and shifted down. For the first symbols that
+     * word starts in bits, which precedes length in CodeTable, so every
+     * read stays inside the table.
+     */
+    static_assert(offsetof(CodeTable, length) >= 3, "Length gathers read three bytes before the array");
+
+    const int* gatherBits(const CodeTable& codes) {
+        return reinterpret_cast<const int*>(codes.bits.data());
+    }
+
+    const int* gatherLengths(const CodeTable& codes) {
+        return reinterpret_cast<const int*>(codes.length.data() - 3);
+    }
+
+    __attribute__((target("avx2")))
+    void encodeAvx2(const char* data, size_t length, const CodeTable& codes, BitWriter& writer) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        const unsigned maxLength = codes.maxLength;
+        if (maxLength == 0) return;
+        if (maxLength > 31) {
+            encodeGroups<1>(bytes, length, codes, writer);
+            return;
+        }
+
+        const int* bitsBase = gatherBits(codes);
+        const int* lengthBase = gatherLengths(codes);
+        const __m256i low = _mm256_set1_epi64x(0xFFFFFFFF);
+        alignas(32) uint64_t words[4];
+        alignas(32) uint64_t lengths[4];
+
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+            const __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(bytes + i)));
+            const __m256i bits = _mm256_i32gather_epi32(bitsBase, index, 4);
+            const __m256i lens = _mm256_srli_epi32(_mm256_i32gather_epi32(lengthBase, index, 1), 24);
+
+            // Pairs: the earlier symbol of each 64-bit lane goes in front
+            const __m256i secondLength = _mm256_srli_epi64(lens, 32);
+            const __m256i pair = _mm256_or_si256(_mm256_sllv_epi64(_mm256_and_si256(bits, low), secondLength),
+                                                 _mm256_srli_epi64(bits, 32));
+            const __m256i pairLength = _mm256_add_epi64(_mm256_and_si256(lens, low), secondLength);
+            if (maxLength > 15) {
+                _mm256_store_si256(reinterpret_cast<__m256i*>(words), pair);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(lengths), pairLength);
+                for (int k = 0; k < 4; ++k) writer.put(words[k], lengths[k]);
+                continue;
+            }
+
+            // Quads in lanes 0 and 2
+            const __m256i next = _mm256_permute4x64_epi64(pair, _MM_SHUFFLE(3, 3, 1, 1));
+            const __m256i nextLength = _mm256_permute4x64_epi64(pairLength, _MM_SHUFFLE(3, 3, 1, 1));
+            const __m256i quad = _mm256_or_si256(_mm256_sllv_epi64(pair, nextLength), next);
+            const __m256i quadLength = _mm256_add_epi64(pairLength, nextLength);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(words), quad);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lengths), quadLength);
+            if (maxLength > 7) {
+                writer.put(words[0], lengths[0]);
+                writer.put(words[2], lengths[2]);
+            } else {
+                writer.put((words[0] << lengths[2]) | words[2], lengths[0] + lengths[2]);
+            }
+        }
+        encodeScalar(data + i, length - i, codes, writer);
+    }
+
+    // GCC 12's AVX-512 headers trip -Wmaybe-uninitialized on their own placeholders
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+    __attribute__((target("avx512f")))
+    void encodeAvx512(const char* data, size_t length, const CodeTable& codes, BitWriter& writer) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        const unsigned maxLength = codes.maxLength;
+        if (maxLength == 0) return;
+        if (maxLength > 31) {
+            encodeGroups<1>(bytes, length, codes, writer);
+            return;
+        }
+
+        const int* bitsBase = gatherBits(codes);
+        const int* lengthBase = gatherLengths(codes);
+        const __m512i low = _mm512_set1_epi64(0xFFFFFFFF);
+        const __m512i oddPairs = _mm512_set_epi64(7, 7, 5, 5, 3, 3, 1, 1);
+        const __m512i oddQuads = _mm512_set_epi64(6, 6, 6, 6, 2, 2, 2, 2);
+        alignas(64) uint64_t words[8];
+        alignas(64) uint64_t lengths[8];
+
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16) {
+            const __m512i index = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i)));
+            const __m512i bits = _mm512_i32gather_epi32(index, bitsBase, 4);
+            const __m512i lens = _mm512_srli_epi32(_mm512_i32gather_epi32(index, lengthBase, 1), 24);
+
+            // Pairs: the earlier symbol of each 64-bit lane goes in front
+            const __m512i secondLength = _mm512_srli_epi64(lens, 32);
+            const __m512i pair = _mm512_or_si512(_mm512_sllv_epi64(_mm512_and_si512(bits, low), secondLength),
+                                                 _mm512_srli_epi64(bits, 32));
+            const __m512i pairLength = _mm512_add_epi64(_mm512_and_si512(lens, low), secondLength);
+            if (maxLength > 15) {
+                _mm512_store_si512(words, pair);
+                _mm512_store_si512(lengths, pairLength);
+                for (int k = 0; k < 8; ++k) writer.put(words[k], lengths[k]);
+                continue;
+            }
+
+            // Quads in the even lanes
+            const __m512i next = _mm512_permutexvar_epi64(oddPairs, pair);
+            const __m512i nextLength = _mm512_permutexvar_epi64(oddPairs, pairLength);
+            const __m512i quad = _mm512_or_si512(_mm512_sllv_epi64(pair, nextLength), next);
+            const __m512i quadLength = _mm512_add_epi64(pairLength, nextLength);
+            if (maxLength > 7) {
+                _mm512_store_si512(words, quad);
+                _mm512_store_si512(lengths, quadLength);
+                for (int k = 0; k < 8; k += 2) writer.put(words[k], lengths[k]);
+                continue;
+            }
+
+            // Eights in lanes 0 and 4
+            const __m512i last = _mm512_permutexvar_epi64(oddQuads, quad);
+            const __m512i lastLength = _mm512_permutexvar_epi64(oddQuads, quadLength);
+            _mm512_store_si512(words, _mm512_or_si512(_mm512_sllv_epi64(quad, lastLength), last));
+            _mm512_store_si512(lengths, _mm512_add_epi64(quadLength, lastLength));
+            writer.put(words[0], lengths[0]);
+            writer.put(words[4], lengths[4]);
+        }
+        encodeScalar(data + i, length - i, codes, writer);
+    }
+#pragma GCC diagnostic pop
+#endif
+
+    struct Selection {
+        EncodeKernel kernel;
+        const char* name;
+    };
+
+    Selection select() {
+        const char* forced = std::getenv("SHANNON_KERNEL");
+        const auto allowed = [forced](const char* name) {
+            return !forced || std::strcmp(forced, name) == 0;
+        };
+
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (allowed("avx512") && __builtin_cpu_supports("avx512f")) {
+            return {encodeAvx512, "avx512"};
+        }
+        if (allowed("avx2") && __builtin_cpu_supports("avx2")) {
+            return {encodeAvx2, "avx2"};
+        }
+#endif
+        return {encodeScalar, "scalar"};
+    }
+
+    const Selection& selection() {
+        static const Selection selected = select();
+        return selected;
+    }
+}
+
+EncodeKernel encodeKernel() {
+    return selection().kernel;
+}
+
+const char* encodeKernelName() {
+    return selection().name;
+}
+
+} // namespace Shannon
@@ -0,0 +1,37 @@
+/**
+ * @file kernels.h
+ * @brief Encode kernels chosen for the CPU at run time
+ *
+ * Every kernel produces the same bits. Short codes are merged into one
+ * 64-bit word before they reach the BitWriter, which is where encoding
+ * spends its time; the vector kernels also look up the codes with gathers.
+ */
+
+#ifndef SHANNON_KERNELS_H
+#define SHANNON_KERNELS_H
+
+#include <cstddef>
+
+#include "shannon.h"
+
+namespace Shannon {
+
+/// Appends the codes of length bytes of data; every symbol must have a code
+using EncodeKernel = void (*)(const char* data, size_t length, const CodeTable& codes, BitWriter& writer);
+
+/**
+ * @brief The fastest kernel this CPU supports, detected on the first call
+ *
+ * SHANNON_KERNEL=scalar|avx2|avx512 in the environment forces a kernel,
+ * falling back to scalar if the CPU lacks it.
+ */
+EncodeKernel encodeKernel();
+
+/**
+ * @brief Name of the kernel encodeKernel() picked
+ */
+const char* encodeKernelName();
+
+} // namespace Shannon
+
+#endif // SHANNON_KERNELS_H
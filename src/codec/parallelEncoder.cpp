@@ -0,0 +1,248 @@
+/**
+ * @file parallelEncoder.cpp
+ * @brief Chunked parallel Shannon encoding of a single large message
+ */
+
+#include "shannon.h"
+
+#include <pthread.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+namespace Shannon {
+
+namespace {
+    /**
+     * @struct ThreadBatch
+     * @brief Tasks shared by the threads of one threadParallelFor call
+     */
+    struct ThreadBatch {
+        const std::function<void(size_t)>* task;
+        size_t count;
+        std::atomic<size_t> next{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        pthread_mutex_t errorMutex = PTHREAD_MUTEX_INITIALIZER;
+    };
+
+    void* runBatch(void* void_ptr) {
+        ThreadBatch* batch = static_cast<ThreadBatch*>(void_ptr);
+
+        for (size_t i = batch->next++; i < batch->count; i = batch->next++) {
+            if (batch->failed) break;
+            try {
+                (*batch->task)(i);
+            } catch (...) {
+                pthread_mutex_lock(&batch->errorMutex);
+                if (!batch->error) batch->error = std::current_exception();
+                pthread_mutex_unlock(&batch->errorMutex);
+                batch->failed = true;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @struct Chunk
+     * @brief One slice of the message and its independently encoded bits
+     */
+    struct Chunk {
+        size_t begin = 0;
+        size_t length = 0;
+        Histogram hist{};
+        uint64_t bitOffset = 0;     ///< Position of the chunk's first bit in the message
+        uint64_t bitCount = 0;
+        uint8_t firstByte = 0;      ///< Shared with the previous chunk; merged after the join
+    };
+
+    /**
+     * @brief Builds one code table from the chunk histograms and encodes every chunk
+     */
+    void encodeChunks(std::string_view line, EncodedMsg& msg, std::vector<Chunk>& chunks,
+                      const ParallelFor& parallelFor) {
+        const size_t chunkCount = chunks.size();
+
+        Histogram hist{};
+        for (const Chunk& chunk : chunks) {
+            for (int symbol = 0; symbol < 256; ++symbol) {
+                hist[symbol] += chunk.hist[symbol];
+            }
+        }
+
+        CodeTable codes;
+        buildCodeTable(hist, codes, msg.charCodeVec);
+
+        // Exact chunk sizes give every chunk its bit offset before encoding
+        uint64_t totalBits = 0;
+        for (Chunk& chunk : chunks) {
+            chunk.bitOffset = totalBits;
+            chunk.bitCount = encodedBitCount(chunk.hist, codes);
+            totalBits += chunk.bitCount;
+        }
+
+        msg.encoded.bitCount = totalBits;
+        msg.encoded.bytes.assign(packedSize(totalBits), 0);
+        uint8_t* out = msg.encoded.bytes.data();
+
+        // Each chunk is encoded at its in-byte offset into a private buffer and
+        // copied into place, except for its first byte, which may also hold the
+        // previous chunk's last bits
+        parallelFor(chunkCount, [&](size_t i) {
+            Chunk& chunk = chunks[i];
+            const unsigned lead = chunk.bitOffset & 7;
+            const uint64_t localBits = lead + chunk.bitCount;
+            if (chunk.bitCount == 0) return;
+
+            std::vector<uint8_t> local(writerCapacity(localBits));
+            BitWriter writer(local.data());
+            writer.put(0, lead);
+            encodeSymbols(line.data() + chunk.begin, chunk.length, codes, writer);
+            writer.finish();
+
+            const size_t localBytes = packedSize(localBits);
+            chunk.firstByte = local[0];
+            std::memcpy(out + (chunk.bitOffset >> 3) + 1, local.data() + 1, localBytes - 1);
+        });
+
+        for (const Chunk& chunk : chunks) {
+            if (chunk.bitCount != 0) {
+                out[chunk.bitOffset >> 3] |= chunk.firstByte;
+            }
+        }
+    }
+}
+
+ParallelFor threadParallelFor(unsigned threads) {
+    return [threads](size_t count, const std::function<void(size_t)>& task) {
+        ThreadBatch batch;
+        batch.task = &task;
+        batch.count = count;
+
+        const size_t threadCount = std::min<size_t>(std::max(1u, threads), count);
+        std::vector<pthread_t> workers;
+        workers.reserve(threadCount);
+
+        // The calling thread works too, so spawn one fewer
+        for (size_t i = 1; i < threadCount; ++i) {
+            pthread_t tid;
+            if (pthread_create(&tid, nullptr, runBatch, &batch)) {
+                break;  // Fewer threads only costs speed
+            }
+            workers.push_back(tid);
+        }
+        runBatch(&batch);
+
+        for (pthread_t tid : workers) {
+            pthread_join(tid, nullptr);
+        }
+        pthread_mutex_destroy(&batch.errorMutex);
+
+        if (batch.error) std::rethrow_exception(batch.error);
+    };
+}
+
+void shannonCodeParallel(EncodedMsg& msg, const ParallelFor& parallelFor, size_t chunkSize) {
+    shannonCodeParallel(msg.line, msg, parallelFor, chunkSize);
+}
+
+void shannonCodeParallel(std::string_view line, EncodedMsg& msg, const ParallelFor& parallelFor,
+                         size_t chunkSize) {
+    if (chunkSize == 0) {
+        throw std::invalid_argument("Chunk size must be positive");
+    }
+    if (line.length() > MAX_FREQ) {
+        throw std::invalid_argument("Message must be under 2 GiB");  // Counts are summed in 32 bits
+    }
+
+    const size_t lineSize = line.length();
+    const size_t chunkCount = std::max<size_t>(1, (lineSize + chunkSize - 1) / chunkSize);
+    std::vector<Chunk> chunks(chunkCount);
+    for (size_t i = 0; i < chunkCount; ++i) {
+        chunks[i].begin = i * chunkSize;
+        chunks[i].length = std::min(chunkSize, lineSize - chunks[i].begin);
+    }
+
+    // Count every chunk in parallel and merge into the global table
+    parallelFor(chunkCount, [&](size_t i) {
+        countFrequencies(line.data() + chunks[i].begin, chunks[i].length, chunks[i].hist);
+    });
+
+    encodeChunks(line, msg, chunks, parallelFor);
+}
+
+void shannonCodeParallel(EncodedMsg& msg, unsigned threads) {
+    threads = std::max(1u, threads);
+    const size_t chunkSize = std::max<size_t>(1, (msg.line.length() + threads - 1) / threads);
+    shannonCodeParallel(msg, threadParallelFor(threads), chunkSize);
+}
+
+StreamEncoder::StreamEncoder(size_t chunkSize) : chunkSize(chunkSize) {
+    if (chunkSize == 0) {
+        throw std::invalid_argument("Chunk size must be positive");
+    }
+}
+
+void StreamEncoder::append(const char* data, size_t length) {
+    if (length > MAX_FREQ - line.size()) {
+        throw std::invalid_argument("Message must be under 2 GiB");
+    }
+    while (length > 0) {
+        // Start a new histogram at every chunk boundary
+        const size_t used = line.size() % chunkSize;
+        if (used == 0) chunkHists.emplace_back();
+
+        const size_t take = std::min(length, chunkSize - used);
+        countFrequencies(data, take, chunkHists.back());
+        line.append(data, take);
+        data += take;
+        length -= take;
+    }
+}
+
+Histogram StreamEncoder::take(std::string& out) {
+    Histogram hist{};
+    for (const Histogram& chunk : chunkHists) {
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            hist[symbol] += chunk[symbol];
+        }
+    }
+    chunkHists.clear();
+
+    out = std::move(line);
+    line.clear();
+    return hist;
+}
+
+void StreamEncoder::finish(EncodedMsg& msg, const ParallelFor& parallelFor) {
+    msg.line = std::move(line);
+    line.clear();
+
+    // A single chunk needs no stitching
+    if (chunkHists.size() <= 1) {
+        const Histogram hist = chunkHists.empty() ? Histogram{} : chunkHists[0];
+        chunkHists.clear();
+        shannonCode(msg, hist);
+        return;
+    }
+
+    std::vector<Chunk> chunks(chunkHists.size());
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        chunks[i].begin = i * chunkSize;
+        chunks[i].length = std::min(chunkSize, msg.line.size() - chunks[i].begin);
+        chunks[i].hist = chunkHists[i];
+    }
+    chunkHists.clear();
+
+    if (parallelFor) {
+        encodeChunks(msg.line, msg, chunks, parallelFor);
+    } else {
+        encodeChunks(msg.line, msg, chunks, [](size_t count, const std::function<void(size_t)>& task) {
+            for (size_t i = 0; i < count; ++i) task(i);
+        });
+    }
+}
+
+} // namespace Shannon
@@ -0,0 +1,251 @@
+/**
+ * @file shannon.cpp
+ * @brief Shannon codec implementation shared by all front ends
+ */
+
+#include "shannon.h"
+#include "kernels.h"
+#include "../metrics/metrics.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace Shannon {
+
+bool compareFreqChar(const CharCode& a, const CharCode& b) {
+    return (a.freq != b.freq) ? (a.freq > b.freq) : (a.character > b.character);
+}
+
+namespace {
+    constexpr int SUB_HISTOGRAMS = 4;
+
+    /**
+     * @brief Packs the code of every byte into out, sized from totalBits
+     */
+    void encodePacked(std::string_view line, const CodeTable& codes,
+                      uint64_t totalBits, BitStream& out) {
+        out.bytes.resize(writerCapacity(totalBits));
+        out.bitCount = totalBits;
+
+        BitWriter writer(out.bytes.data());
+        encodeSymbols(line.data(), line.length(), codes, writer);
+        writer.finish();
+
+        out.bytes.resize(packedSize(totalBits));
+    }
+}
+
+std::string toAscii(const CharCode& charCode) {
+    std::string code(charCode.length, '0');
+    for (unsigned i = 0; i < charCode.length; ++i) {
+        if ((charCode.bits >> (charCode.length - 1 - i)) & 1) code[i] = '1';
+    }
+    return code;
+}
+
+void countFrequencies(const char* data, size_t length, Histogram& hist) {
+    Metrics::StageTimer timer(Metrics::Stage::COUNT);
+    uint32_t sub[SUB_HISTOGRAMS][256] = {};
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+
+    // Eight bytes per step, spread over the sub-histograms
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        ++sub[0][word & 0xFF];
+        ++sub[1][(word >> 8) & 0xFF];
+        ++sub[2][(word >> 16) & 0xFF];
+        ++sub[3][(word >> 24) & 0xFF];
+        ++sub[0][(word >> 32) & 0xFF];
+        ++sub[1][(word >> 40) & 0xFF];
+        ++sub[2][(word >> 48) & 0xFF];
+        ++sub[3][word >> 56];
+    }
+    for (; i < length; ++i) {
+        ++sub[0][bytes[i]];
+    }
+
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        hist[symbol] += sub[0][symbol] + sub[1][symbol] + sub[2][symbol] + sub[3][symbol];
+    }
+}
+
+void buildCodeTable(const Histogram& hist, CodeTable& codes, std::vector<CharCode>& table) {
+    uint64_t lineSize = 0;
+    int symbolCount = 0;
+    for (uint32_t freq : hist) {
+        if (freq > MAX_FREQ) {
+            throw std::invalid_argument("Symbol count " + std::to_string(freq) + " exceeds MAX_FREQ");
+        }
+        lineSize += freq;
+        symbolCount += (freq != 0);
+    }
+
+    table.clear();
+    table.reserve(symbolCount);
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        if (hist[symbol] != 0) {
+            table.push_back({static_cast<char>(symbol), static_cast<int>(hist[symbol]), 0, 0});
+        }
+    }
+
+    // Sort by frequency and character
+    {
+        Metrics::StageTimer timer(Metrics::Stage::SORT);
+        std::sort(table.begin(), table.end(), compareFreqChar);
+    }
+
+    // Calculate Shannon codes from the exact cumulative count
+    Metrics::StageTimer timer(Metrics::Stage::CODEGEN);
+    codes = CodeTable();
+    uint64_t cumulative = 0;
+    for (auto& charCode : table) {
+        const unsigned length = codeLength(charCode.freq, lineSize);
+        if (length > CodeTable::MAX_CODE_LENGTH) {
+            throw std::length_error("Shannon code too long");
+        }
+        const uint32_t bits = codeBits(cumulative, lineSize, length);
+
+        const unsigned char symbol = charCode.character;
+        codes.bits[symbol] = bits;
+        codes.length[symbol] = static_cast<uint8_t>(length);
+        codes.maxLength = std::max(codes.maxLength, static_cast<uint8_t>(length));
+        charCode.length = static_cast<uint8_t>(length);
+        charCode.bits = bits;
+        cumulative += charCode.freq;
+    }
+}
+
+std::vector<CharCode> buildCodeTable(const Histogram& hist, CodeTable& codes) {
+    std::vector<CharCode> table;
+    buildCodeTable(hist, codes, table);
+    return table;
+}
+
+std::vector<CharCode> buildCodeTable(const Histogram& hist) {
+    CodeTable codes;
+    return buildCodeTable(hist, codes);
+}
+
+std::vector<CharCode> buildCodeTable(const std::string& line) {
+    Histogram hist{};
+    countFrequencies(line.data(), line.length(), hist);
+    return buildCodeTable(hist);
+}
+
+CodeTable makeCodeTable(const std::vector<CharCode>& table) {
+    CodeTable codes;
+    for (const auto& charCode : table) {
+        if (charCode.length > CodeTable::MAX_CODE_LENGTH) {
+            throw std::length_error("Shannon code too long");
+        }
+
+        const unsigned char symbol = charCode.character;
+        codes.bits[symbol] = charCode.bits;
+        codes.length[symbol] = charCode.length;
+        codes.maxLength = std::max(codes.maxLength, charCode.length);
+    }
+    return codes;
+}
+
+uint64_t encodedBitCount(const Histogram& hist, const CodeTable& codes) {
+    uint64_t totalBits = 0;
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        if (hist[symbol] == 0) continue;
+        if (codes.length[symbol] == CodeTable::NO_CODE) {
+            throw std::invalid_argument("Symbol missing from code table");
+        }
+        totalBits += static_cast<uint64_t>(hist[symbol]) * codes.length[symbol];
+    }
+    return totalBits;
+}
+
+void encodeSymbols(const char* data, size_t length, const CodeTable& codes, BitWriter& writer) {
+    static const EncodeKernel kernel = encodeKernel();
+    Metrics::StageTimer timer(Metrics::Stage::ENCODE);
+    kernel(data, length, codes, writer);
+}
+
+BitStream encode(const std::string& line, const std::vector<CharCode>& table) {
+    const CodeTable codes = makeCodeTable(table);
+
+    Histogram hist{};
+    countFrequencies(line.data(), line.length(), hist);
+
+    BitStream encoded;
+    encodePacked(line, codes, encodedBitCount(hist, codes), encoded);
+    return encoded;
+}
+
+BitStream encode(const std::string& line, const Histogram& hist, const CodeTable& codes) {
+    BitStream encoded;
+    encodePacked(line, codes, encodedBitCount(hist, codes), encoded);
+    return encoded;
+}
+
+TableEncoder::TableEncoder(const CodeTable& codes) : codes(codes), writer(nullptr) {}
+
+void TableEncoder::append(const char* data, size_t length) {
+    const unsigned char* symbolBytes = reinterpret_cast<const unsigned char*>(data);
+    uint64_t pieceBits = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (codes.length[symbolBytes[i]] == CodeTable::NO_CODE) {
+            throw std::invalid_argument("Symbol has no code in the table");
+        }
+        pieceBits += codes.length[symbolBytes[i]];
+    }
+
+    // Room for this piece; growth keeps the writer's offset
+    const size_t stored = bytes.empty() ? 0 : writer.written(bytes.data());
+    const size_t needed = stored + writerCapacity(64 + pieceBits);
+    if (bytes.size() < needed) {
+        bytes.resize(std::max(needed, 2 * bytes.size()));
+        writer.rebase(bytes.data() + stored);
+    }
+
+    encodeSymbols(data, length, codes, writer);
+    bitCount += pieceBits;
+    symbols += length;
+}
+
+BitStream TableEncoder::finish() {
+    if (bytes.empty()) {
+        bytes.resize(writerCapacity(64));
+        writer.rebase(bytes.data());
+    }
+    writer.finish();
+
+    BitStream encoded;
+    encoded.bitCount = bitCount;
+    bytes.resize(packedSize(bitCount));
+    encoded.bytes = std::move(bytes);
+    return encoded;
+}
+
+void shannonCode(EncodedMsg& msg) {
+    shannonCode(msg.line, msg);
+}
+
+void shannonCode(EncodedMsg& msg, const Histogram& hist) {
+    CodeTable codes;
+    buildCodeTable(hist, codes, msg.charCodeVec);
+
+    encodePacked(msg.line, codes, encodedBitCount(hist, codes), msg.encoded);
+}
+
+void shannonCode(std::string_view line, EncodedMsg& msg) {
+    // Longer lines would wrap the 32-bit counts
+    if (line.length() > MAX_FREQ) {
+        throw std::invalid_argument("Message must be under 2 GiB");
+    }
+    Histogram hist{};
+    countFrequencies(line.data(), line.length(), hist);
+
+    CodeTable codes;
+    buildCodeTable(hist, codes, msg.charCodeVec);
+    encodePacked(line, codes, encodedBitCount(hist, codes), msg.encoded);
+}
+
+} // namespace Shannon
@@ -0,0 +1,382 @@
+/**
+ * @file shannon.h
+ * @brief Shared Shannon codec used by the threading, sync and network tools
+ *
+ * Every front end in the project links against this codec instead of keeping
+ * its own copy of the encoding routine. The API is split into three steps:
+ * - buildCodeTable: count symbol frequencies and derive the Shannon codes
+ * - encode: translate a message through a code table
+ * - decode: recover a message from its encoding and code table
+ */
+
+#ifndef SHANNON_CODEC_H
+#define SHANNON_CODEC_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bitstream.h"
+
+namespace Shannon {
+
+/**
+ * @struct CharCode
+ * @brief Stores character encoding information
+ *
+ * A fixed record rather than a code string, so building a table allocates
+ * nothing beyond the vector that holds it.
+ */
+struct CharCode {
+    char character;          ///< The character being encoded
+    int freq;                ///< Frequency of occurrence
+    uint8_t length;          ///< Generated Shannon code length in bits
+    uint32_t bits;           ///< Generated Shannon code, right-aligned
+};
+
+/**
+ * @brief The code of charCode as a string of '0' and '1' characters
+ */
+std::string toAscii(const CharCode& charCode);
+
+/**
+ * @struct EncodedMsg
+ * @brief Container for message encoding data
+ *
+ * Encoding into a message overwrites its vectors in place, so a message
+ * reused for line after line stops allocating once it has seen the largest.
+ */
+struct EncodedMsg {
+    std::string line;                   ///< Original input message
+    std::vector<CharCode> charCodeVec;  ///< Vector of character encodings
+    BitStream encoded;                  ///< Final encoded message, packed
+};
+
+/// Symbol counts indexed by unsigned byte value
+using Histogram = std::array<uint32_t, 256>;
+
+/// Largest symbol count a table can hold, since CharCode::freq is an int
+constexpr uint32_t MAX_FREQ = std::numeric_limits<int>::max();
+
+/**
+ * @struct CodeTable
+ * @brief Direct-indexed code lookup used on the encode hot path
+ *
+ * Codes are stored right-aligned in bits; symbols without a code have
+ * length NO_CODE. A single-symbol alphabet legitimately has length 0.
+ */
+struct CodeTable {
+    static constexpr uint8_t NO_CODE = 0xFF;
+    static constexpr unsigned MAX_CODE_LENGTH = 32;
+
+    std::array<uint32_t, 256> bits{};   ///< Code bits, right-aligned
+    std::array<uint8_t, 256> length;    ///< Code length in bits or NO_CODE
+    uint8_t maxLength = 0;              ///< Longest code, which sizes the encode kernels' words
+
+    CodeTable() { length.fill(NO_CODE); }
+};
+
+/**
+ * @brief Shannon code length ceil(log2(total / freq)) in exact integer arithmetic
+ *
+ * The smallest L with freq * 2^L >= total is the bit width of
+ * ceil(total / freq) - 1.
+ */
+constexpr unsigned codeLength(uint64_t freq, uint64_t total) {
+    const uint64_t ratio = (total + freq - 1) / freq;
+    return (ratio <= 1) ? 0 : 64 - __builtin_clzll(ratio - 1);
+}
+
+/**
+ * @brief First length bits of the binary expansion of cumulative / total
+ */
+constexpr uint32_t codeBits(uint64_t cumulative, uint64_t total, unsigned length) {
+    const unsigned __int128 scaled = static_cast<unsigned __int128>(cumulative) << length;
+    return static_cast<uint32_t>(scaled / total);
+}
+
+/**
+ * @brief Comparison function for sorting CharCode objects
+ * @return true if a should come before b in sorted order
+ */
+bool compareFreqChar(const CharCode& a, const CharCode& b);
+
+/**
+ * @brief Adds the byte counts of data to hist
+ *
+ * Counts into several interleaved sub-histograms so runs of the same byte do
+ * not serialize on one counter, then merges them.
+ */
+void countFrequencies(const char* data, size_t length, Histogram& hist);
+
+/**
+ * @brief Builds the Shannon code table from symbol counts
+ *
+ * Code lengths are ceil(log2(total / freq)) and code words are the leading
+ * bits of cumulative / total, both computed in integer arithmetic so the
+ * codes are exact and identical on every machine.
+ * @param codes Receives the same codes in direct-indexed form
+ * @return Codes sorted by descending frequency (see compareFreqChar)
+ * @throws std::invalid_argument if a count exceeds MAX_FREQ
+ * @throws std::length_error if a code exceeds CodeTable::MAX_CODE_LENGTH
+ */
+std::vector<CharCode> buildCodeTable(const Histogram& hist, CodeTable& codes);
+
+/**
+ * @brief buildCodeTable into table, reusing its capacity
+ */
+void buildCodeTable(const Histogram& hist, CodeTable& codes, std::vector<CharCode>& table);
+
+/**
+ * @brief Builds the Shannon code table from symbol counts
+ * @return Codes sorted by descending frequency (see compareFreqChar)
+ */
+std::vector<CharCode> buildCodeTable(const Histogram& hist);
+
+/**
+ * @brief Builds the Shannon code table for a message
+ * @param line Message whose symbol frequencies define the codes
+ * @return Codes sorted by descending frequency (see compareFreqChar)
+ */
+std::vector<CharCode> buildCodeTable(const std::string& line);
+
+/**
+ * @brief Converts a code table into its direct-indexed form
+ * @throws std::length_error if a code exceeds CodeTable::MAX_CODE_LENGTH
+ */
+CodeTable makeCodeTable(const std::vector<CharCode>& table);
+
+/**
+ * @brief Exact encoded length in bits of the symbols counted in hist
+ * @throws std::invalid_argument if a counted symbol has no code
+ */
+uint64_t encodedBitCount(const Histogram& hist, const CodeTable& codes);
+
+/**
+ * @brief Appends the codes of length bytes of data to writer
+ *
+ * Runs the fastest encode kernel the CPU supports (see kernels.h).
+ */
+void encodeSymbols(const char* data, size_t length, const CodeTable& codes, BitWriter& writer);
+
+/**
+ * @brief Encodes a message with a previously built code table
+ * @return Packed bitstream; use toAscii() to display it
+ * @throws std::invalid_argument if a symbol has no code in the table
+ */
+BitStream encode(const std::string& line, const std::vector<CharCode>& table);
+
+/**
+ * @brief Encodes a message whose symbols are counted in hist with a ready code table
+ * @throws std::invalid_argument if a counted symbol has no code
+ */
+BitStream encode(const std::string& line, const Histogram& hist, const CodeTable& codes);
+
+/**
+ * @class TableEncoder
+ * @brief Single-pass encoder for messages that arrive in pieces
+ *
+ * The table is fixed in advance, so nothing has to be counted: every piece
+ * is encoded as soon as it arrives, into a buffer that grows as needed.
+ */
+class TableEncoder {
+public:
+    /**
+     * @param codes Must outlive the encoder and hold a code for every symbol encoded
+     */
+    explicit TableEncoder(const CodeTable& codes);
+
+    /**
+     * @brief Encodes length bytes of data
+     * @throws std::invalid_argument if a symbol has no code
+     */
+    void append(const char* data, size_t length);
+
+    size_t symbolCount() const { return symbols; }
+
+    /**
+     * @brief Returns the packed encoding of everything appended
+     */
+    BitStream finish();
+
+private:
+    const CodeTable& codes;
+    PackedBytes bytes;
+    BitWriter writer;
+    uint64_t bitCount = 0;
+    size_t symbols = 0;
+};
+
+/**
+ * @class Decoder
+ * @brief Table-driven decoder for packed bitstreams
+ *
+ * Each probe looks up the next LOOKUP_BITS bits in a table that lists every
+ * complete code within them, so one hit emits up to MAX_SYMBOLS_PER_ENTRY
+ * symbols. Codes longer than the probe fall back to a binary search over the
+ * left-aligned code words, which is exact because Shannon codes are
+ * prefix-free. Tables for short messages skip the probe table and use the
+ * search alone.
+ */
+class Decoder {
+public:
+    static constexpr unsigned LOOKUP_BITS = 11;
+    static constexpr unsigned MAX_SYMBOLS_PER_ENTRY = 6;
+
+    explicit Decoder(const std::vector<CharCode>& table);
+
+    /**
+     * @brief Decodes a whole message; the symbol count is the table's total frequency
+     * @throws std::invalid_argument on bits that match no code
+     */
+    std::string decode(const BitStream& encoded) const;
+
+    /**
+     * @brief Decodes symbolCount symbols starting at bit firstBit of bytes
+     * @param out Receives the symbols; needs symbolCount bytes
+     * @return Bit position just past the last decoded symbol
+     * @throws std::invalid_argument on bits that match no code or run past endBit
+     */
+    uint64_t decode(const uint8_t* bytes, uint64_t firstBit, uint64_t endBit,
+                    size_t symbolCount, char* out) const;
+
+private:
+    struct Entry {
+        char symbols[MAX_SYMBOLS_PER_ENTRY];  ///< Symbols decoded by this probe
+        uint8_t count;                        ///< 0 when the first code is longer than the probe
+        uint8_t bits;                         ///< Bits consumed by the listed symbols
+    };
+
+    struct LongCode {
+        uint32_t aligned;   ///< Code word shifted to the top of 32 bits
+        uint8_t length;
+        char symbol;
+    };
+
+    std::vector<Entry> lookup;
+    std::vector<LongCode> sortedCodes;
+    size_t totalSymbols = 0;
+    bool singleSymbol = false;
+    char onlySymbol = 0;
+
+    /**
+     * @brief Matches the code at the top of window (32 bits, MSB-first)
+     * @return nullptr if no code word prefixes the window within validBits
+     */
+    const LongCode* match(uint32_t window, unsigned validBits) const;
+};
+
+/**
+ * @brief Decodes an encoded message with the table it was encoded with
+ *
+ * The symbol count is the sum of the table frequencies, which also covers
+ * single-symbol alphabets whose only code is empty.
+ * @throws std::invalid_argument on bits that match no code
+ */
+std::string decode(const BitStream& encoded, const std::vector<CharCode>& table);
+
+/**
+ * @brief Fills msg.charCodeVec and msg.encoded from msg.line
+ * @throws std::invalid_argument if the line is longer than MAX_FREQ bytes
+ */
+void shannonCode(EncodedMsg& msg);
+
+/**
+ * @brief shannonCode with the symbols of msg.line already counted in hist
+ */
+void shannonCode(EncodedMsg& msg, const Histogram& hist);
+
+/**
+ * @brief Fills msg.charCodeVec and msg.encoded from line, leaving msg.line alone
+ *
+ * For lines that live elsewhere, such as a memory-mapped file, so they
+ * need not be copied into msg.
+ */
+void shannonCode(std::string_view line, EncodedMsg& msg);
+
+/// Runs task(0) .. task(count - 1), possibly in parallel, and returns when all are done
+using ParallelFor = std::function<void(size_t count, const std::function<void(size_t)>& task)>;
+
+/// Chunk size used when a large message is split for parallel encoding
+constexpr size_t DEFAULT_CHUNK_SIZE = size_t(1) << 20;
+
+/// Messages at least this long are worth splitting across threads
+constexpr size_t PARALLEL_THRESHOLD = 4 * DEFAULT_CHUNK_SIZE;
+
+/**
+ * @brief shannonCode for one large message, split into chunks
+ *
+ * Per-chunk histograms are counted in parallel and merged into one code
+ * table. Each chunk is then encoded into its own bitstream, and the streams
+ * are stitched together at their exact bit offsets. The result is
+ * bit-identical to shannonCode.
+ * @param parallelFor Executes the per-chunk tasks
+ * @throws std::invalid_argument if the line is longer than MAX_FREQ bytes
+ */
+void shannonCodeParallel(EncodedMsg& msg, const ParallelFor& parallelFor,
+                         size_t chunkSize = DEFAULT_CHUNK_SIZE);
+
+/**
+ * @brief shannonCodeParallel for a line held outside msg; msg.line is left alone
+ */
+void shannonCodeParallel(std::string_view line, EncodedMsg& msg, const ParallelFor& parallelFor,
+                         size_t chunkSize = DEFAULT_CHUNK_SIZE);
+
+/**
+ * @brief shannonCodeParallel on up to threads POSIX threads, one chunk each
+ */
+void shannonCodeParallel(EncodedMsg& msg, unsigned threads);
+
+/**
+ * @brief ParallelFor that spreads tasks over up to threads POSIX threads
+ */
+ParallelFor threadParallelFor(unsigned threads);
+
+/**
+ * @class StreamEncoder
+ * @brief Collects a message piece by piece, counting symbols as they arrive
+ *
+ * Counts go into one histogram per chunk, so by the time the last piece is in
+ * only the code table and the encoding remain, and the chunks can be encoded
+ * in parallel exactly as in shannonCodeParallel. Shannon codes depend on the
+ * whole message, so the bytes are kept until finish().
+ */
+class StreamEncoder {
+public:
+    explicit StreamEncoder(size_t chunkSize = DEFAULT_CHUNK_SIZE);
+
+    void reserve(size_t length) { line.reserve(length); }
+    size_t size() const { return line.size(); }
+
+    /**
+     * @brief Appends length bytes of data to the message and counts them
+     * @throws std::invalid_argument if the message would grow past MAX_FREQ bytes
+     */
+    void append(const char* data, size_t length);
+
+    /**
+     * @brief Moves the message into msg and fills its codes and encoding
+     * @param parallelFor Executes the per-chunk tasks; empty runs them inline
+     */
+    void finish(EncodedMsg& msg, const ParallelFor& parallelFor = ParallelFor());
+
+    /**
+     * @brief Moves the message into line without encoding it
+     * @return The symbol counts of the whole message
+     */
+    Histogram take(std::string& line);
+
+private:
+    size_t chunkSize;
+    std::string line;
+    std::vector<Histogram> chunkHists;  ///< One per chunkSize bytes of line
+};
+
+} // namespace Shannon
+
+#endif // SHANNON_CODEC_H
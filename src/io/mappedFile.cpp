@@ -0,0 +1,44 @@
+/**
+ * @file mappedFile.cpp
+ * @brief Read-only memory mapping of input files
+ */
+
+#include "mappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdexcept>
+
+MappedFile::MappedFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Error opening " + path);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        throw std::runtime_error("Error reading the size of " + path);
+    }
+    length = static_cast<size_t>(info.st_size);
+
+    // An empty file has nothing to map
+    if (length > 0) {
+        void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Error mapping " + path);
+        }
+        madvise(mapping, length, MADV_SEQUENTIAL);
+        begin = static_cast<const char*>(mapping);
+    }
+    close(fd);  // The mapping keeps the file alive
+}
+
+MappedFile::~MappedFile() {
+    if (begin) {
+        munmap(const_cast<char*>(begin), length);
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * @file mappedFile.h
+ * @brief Read-only memory-mapped input files and a line scanner over them
+ *
+ * Mapping an input file lets the tools hand out each line as a view into
+ * the page cache instead of copying it through iostreams, and a file that
+ * is already cached opens without reading anything.
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/**
+ * @class MappedFile
+ * @brief A whole file mapped read-only for the lifetime of the object
+ *
+ * Views into data() stay valid until the MappedFile is destroyed.
+ */
+class MappedFile {
+public:
+    /**
+     * @throws std::runtime_error if the file cannot be opened or mapped
+     */
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view data() const { return std::string_view(begin, length); }
+
+private:
+    const char* begin = nullptr;
+    size_t length = 0;
+};
+
+/**
+ * @class LineScanner
+ * @brief Splits a buffer into lines without copying them
+ *
+ * Newlines are found with memchr, which compares a whole vector register
+ * of bytes per step.
+ */
+class LineScanner {
+public:
+    explicit LineScanner(std::string_view data) : data(data) {}
+
+    /**
+     * @brief The next line without its newline; the last line may lack one
+     * @return false once every line has been returned
+     */
+    bool next(std::string_view& line) {
+        if (pos >= data.size()) return false;
+
+        const void* newline = std::memchr(data.data() + pos, '\n', data.size() - pos);
+        const size_t end = newline ? static_cast<const char*>(newline) - data.data() : data.size();
+        line = data.substr(pos, end - pos);
+        pos = end + 1;
+        return true;
+    }
+
+    bool finished() const { return pos >= data.size(); }
+
+private:
+    std::string_view data;
+    size_t pos = 0;
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,283 @@
+/**
+ * @file metrics.cpp
+ * @brief Per-thread metric slots in a mapping shared across forks
+ */
+
+#include "metrics.h"
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace Metrics {
+
+namespace detail {
+    bool active = false;
+}
+
+namespace {
+    constexpr unsigned MAX_MAGNITUDE = 48;      ///< Samples of 2^48 ticks or more share the last bucket
+    constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+    constexpr size_t BUCKETS = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+    constexpr size_t MAX_SLOTS = 256;           ///< Threads and children recording at once
+
+    const char* const COUNTER_NAMES[COUNTERS] = {
+        "accepts", "forks", "requests", "messages", "bytes_in", "bytes_out",
+        "table_hits", "table_misses", "errors",
+    };
+    const char* const STAGE_NAMES[STAGES] = {
+        "count", "sort", "codegen", "encode", "send", "fork", "request",
+    };
+
+    /**
+     * @struct Slot
+     * @brief What one thread has recorded; written only by its owner
+     */
+    struct alignas(64) Slot {
+        std::atomic<uint32_t> owner;            ///< 0 while free
+        std::atomic<uint64_t> counters[COUNTERS];
+        std::atomic<uint64_t> sums[STAGES];     ///< Total ticks, for the mean
+        std::atomic<uint64_t> maxima[STAGES];
+        std::atomic<uint64_t> buckets[STAGES][BUCKETS];
+    };
+
+    /**
+     * @struct Region
+     * @brief The shared mapping: every slot and the total of the freed ones
+     */
+    struct Region {
+        double ticksPerMicrosecond;
+        Slot retired;   ///< Folded slots, and threads that found every slot taken
+        Slot slots[MAX_SLOTS];
+    };
+
+    Region* region = nullptr;
+
+    /**
+     * @struct Local
+     * @brief The calling thread's slot; frees it when the thread exits
+     */
+    struct Local {
+        Slot* slot = nullptr;
+        bool shared = false;    ///< slot is the retired total, updated by several threads
+
+        ~Local() { release(); }
+    };
+
+    thread_local Local local;
+
+    Slot& slot() {
+        if (!local.slot) {
+            for (Slot& candidate : region->slots) {
+                uint32_t expected = 0;
+                if (candidate.owner.compare_exchange_strong(expected, 1)) {
+                    local.slot = &candidate;
+                    local.shared = false;
+                    return candidate;
+                }
+            }
+            local.slot = &region->retired;
+            local.shared = true;
+        }
+        return *local.slot;
+    }
+
+    /// The owner is the only writer, so a plain load and store suffice
+    void bump(std::atomic<uint64_t>& field, uint64_t n) {
+        if (local.shared) {
+            field.fetch_add(n, std::memory_order_relaxed);
+        } else {
+            field.store(field.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+    }
+
+    void raise(std::atomic<uint64_t>& field, uint64_t value) {
+        uint64_t current = field.load(std::memory_order_relaxed);
+        while (current < value && !field.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+
+    size_t bucketOf(uint64_t value) {
+        if (value < SUB_BUCKETS) return value;
+        const unsigned magnitude = 63 - __builtin_clzll(value);
+        if (magnitude >= MAX_MAGNITUDE) return BUCKETS - 1;
+        const size_t sub = (value >> (magnitude - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+        return (magnitude - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+    }
+
+    /**
+     * @brief The largest value that falls in bucket
+     */
+    uint64_t bucketTop(size_t bucket) {
+        if (bucket < SUB_BUCKETS) return bucket;
+        const unsigned shift = static_cast<unsigned>(bucket / SUB_BUCKETS) - 1;
+        const uint64_t low = (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+        return low + (uint64_t(1) << shift) - 1;
+    }
+
+    /// A forked child starts with its parent's slot pointer; it must claim its own
+    void forgetSlotInChild() {
+        local.slot = nullptr;
+        local.shared = false;
+    }
+
+    double calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t first = ticks();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(10)) {}
+        const uint64_t last = ticks();
+        const double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        return (last - first) / micros;
+#else
+        return 1000.0;  // ticks() is already in nanoseconds
+#endif
+    }
+
+    /**
+     * @struct Totals
+     * @brief The sum of every slot, read without stopping the writers
+     */
+    struct Totals {
+        uint64_t counters[COUNTERS] = {};
+        uint64_t sums[STAGES] = {};
+        uint64_t maxima[STAGES] = {};
+        uint64_t buckets[STAGES][BUCKETS] = {};
+
+        void add(const Slot& from) {
+            for (size_t c = 0; c < COUNTERS; ++c) counters[c] += from.counters[c].load(std::memory_order_relaxed);
+            for (size_t s = 0; s < STAGES; ++s) {
+                sums[s] += from.sums[s].load(std::memory_order_relaxed);
+                maxima[s] = std::max(maxima[s], from.maxima[s].load(std::memory_order_relaxed));
+                for (size_t b = 0; b < BUCKETS; ++b) buckets[s][b] += from.buckets[s][b].load(std::memory_order_relaxed);
+            }
+        }
+    };
+
+    void appendNumber(std::string& out, double value) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.6g", value);
+        out += text;
+    }
+}
+
+void enable() {
+    if (detail::active) return;
+    void* mapping = mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Error mapping the metrics region");
+    }
+    // Anonymous pages start zeroed, so every slot is already free
+    region = static_cast<Region*>(mapping);
+    region->ticksPerMicrosecond = calibrate();
+    pthread_atfork(nullptr, nullptr, forgetSlotInChild);
+    detail::active = true;
+}
+
+void add(Counter counter, uint64_t n) {
+    if (!enabled()) return;
+    bump(slot().counters[static_cast<size_t>(counter)], n);
+}
+
+void record(Stage stage, uint64_t elapsed) {
+    if (!enabled()) return;
+    Slot& own = slot();
+    const size_t s = static_cast<size_t>(stage);
+    bump(own.buckets[s][bucketOf(elapsed)], 1);
+    bump(own.sums[s], elapsed);
+    if (local.shared) {
+        raise(own.maxima[s], elapsed);
+    } else if (elapsed > own.maxima[s].load(std::memory_order_relaxed)) {
+        own.maxima[s].store(elapsed, std::memory_order_relaxed);
+    }
+}
+
+void release() {
+    if (!local.slot || local.shared) {
+        local.slot = nullptr;
+        return;
+    }
+
+    // A report taken meanwhile may count this slot twice; it settles once the slot is free
+    Slot& own = *local.slot;
+    Slot& retired = region->retired;
+    auto fold = [](std::atomic<uint64_t>& from, std::atomic<uint64_t>& into) {
+        const uint64_t value = from.load(std::memory_order_relaxed);
+        if (value != 0) {
+            into.fetch_add(value, std::memory_order_relaxed);
+            from.store(0, std::memory_order_relaxed);
+        }
+    };
+    for (size_t c = 0; c < COUNTERS; ++c) fold(own.counters[c], retired.counters[c]);
+    for (size_t s = 0; s < STAGES; ++s) {
+        fold(own.sums[s], retired.sums[s]);
+        raise(retired.maxima[s], own.maxima[s].load(std::memory_order_relaxed));
+        own.maxima[s].store(0, std::memory_order_relaxed);
+        for (size_t b = 0; b < BUCKETS; ++b) fold(own.buckets[s][b], retired.buckets[s][b]);
+    }
+    own.owner.store(0, std::memory_order_release);
+    local.slot = nullptr;
+}
+
+std::string toJson() {
+    if (!enabled()) {
+        return "{\"enabled\": false}";
+    }
+
+    auto totals = std::make_unique<Totals>();
+    totals->add(region->retired);
+    for (const Slot& slot : region->slots) {
+        if (slot.owner.load(std::memory_order_acquire) != 0) totals->add(slot);
+    }
+
+    const double perMicro = region->ticksPerMicrosecond;
+    std::string out = "{\"enabled\": true, \"counters\": {";
+    for (size_t c = 0; c < COUNTERS; ++c) {
+        if (c > 0) out += ", ";
+        out += std::string("\"") + COUNTER_NAMES[c] + "\": " + std::to_string(totals->counters[c]);
+    }
+    out += "}, \"stages\": {";
+    for (size_t s = 0; s < STAGES; ++s) {
+        const uint64_t* buckets = totals->buckets[s];
+        uint64_t samples = 0;
+        for (size_t b = 0; b < BUCKETS; ++b) samples += buckets[b];
+
+        // Each percentile is the top of its bucket, never above the true maximum
+        auto percentile = [&](double fraction) {
+            const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * samples + 0.5));
+            uint64_t seen = 0;
+            for (size_t b = 0; b < BUCKETS; ++b) {
+                seen += buckets[b];
+                if (seen >= rank) return std::min(bucketTop(b), totals->maxima[s]) / perMicro;
+            }
+            return totals->maxima[s] / perMicro;
+        };
+
+        if (s > 0) out += ", ";
+        out += std::string("\"") + STAGE_NAMES[s] + "\": {\"samples\": " + std::to_string(samples);
+        if (samples > 0) {
+            out += ", \"mean_us\": ";
+            appendNumber(out, totals->sums[s] / perMicro / samples);
+            const std::pair<const char*, double> points[] = {
+                {"p50_us", 0.50}, {"p90_us", 0.90}, {"p99_us", 0.99}, {"p999_us", 0.999},
+            };
+            for (const auto& [name, fraction] : points) {
+                out += std::string(", \"") + name + "\": ";
+                appendNumber(out, percentile(fraction));
+            }
+            out += ", \"max_us\": ";
+            appendNumber(out, totals->maxima[s] / perMicro);
+        }
+        out += "}";
+    }
+    out += "}}";
+    return out;
+}
+
+} // namespace Metrics
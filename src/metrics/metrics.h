@@ -0,0 +1,144 @@
+/**
+ * @file metrics.h
+ * @brief Low-overhead counters and stage latency histograms
+ *
+ * Every thread records into its own slot, so the hot path is a plain load
+ * and store on a cache line no other thread writes. Slots live in one
+ * shared anonymous mapping created by enable(), so the children of the fork
+ * server record into the same table as their parent and any process can
+ * report the totals. A slot is folded into a shared total and freed when its
+ * thread exits, or when a forked child calls release() before _exit().
+ *
+ * Stage timers read the time stamp counter where there is one, so a timed
+ * stage costs a few nanoseconds; until enable() is called they cost a
+ * branch.
+ */
+
+#ifndef SHANNON_METRICS_H
+#define SHANNON_METRICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace Metrics {
+
+/**
+ * @enum Counter
+ * @brief Event counts
+ */
+enum class Counter : uint8_t {
+    ACCEPTS,        ///< Connections accepted
+    FORKS,          ///< Connection handlers forked
+    REQUESTS,       ///< Request frames parsed
+    MESSAGES,       ///< Messages encoded
+    BYTES_IN,       ///< Bytes read from sockets
+    BYTES_OUT,      ///< Bytes written to sockets
+    TABLE_HITS,     ///< Code tables found in the table cache
+    TABLE_MISSES,   ///< Code tables built for the table cache
+    ERRORS,         ///< Requests or connections that failed
+};
+constexpr size_t COUNTERS = 9;
+
+/**
+ * @enum Stage
+ * @brief Timed stages of the encode path and the server
+ */
+enum class Stage : uint8_t {
+    COUNT,          ///< Counting symbol frequencies
+    SORT,           ///< Sorting symbols for the code table
+    CODEGEN,        ///< Deriving codes from the sorted counts
+    ENCODE,         ///< Packing codes into the bitstream
+    SEND,           ///< Writing responses to sockets
+    FORK,           ///< fork() as seen by the server parent
+    REQUEST,        ///< Request parsed to response queued
+};
+constexpr size_t STAGES = 7;
+
+/**
+ * @brief Histograms keep 2^SUB_BUCKET_BITS buckets per power of two, about 3% apart
+ */
+constexpr unsigned SUB_BUCKET_BITS = 5;
+
+namespace detail {
+    extern bool active;     ///< Set once by enable(), before any thread records
+}
+
+/**
+ * @brief Whether enable() has been called
+ */
+inline bool enabled() { return detail::active; }
+
+/**
+ * @brief Starts recording; call before creating threads or forking
+ * @throws std::runtime_error if the shared mapping cannot be created
+ */
+void enable();
+
+/**
+ * @brief Time stamp counter ticks, or nanoseconds where there is none
+ */
+inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief Adds n to a counter of the calling thread
+ */
+void add(Counter counter, uint64_t n = 1);
+
+/**
+ * @brief Records one sample of elapsed ticks for a stage
+ */
+void record(Stage stage, uint64_t elapsed);
+
+/**
+ * @class StageTimer
+ * @brief Records the ticks between construction and destruction
+ */
+class StageTimer {
+public:
+    explicit StageTimer(Stage stage) : stage(stage), start(enabled() ? ticks() : 0) {}
+
+    ~StageTimer() {
+        if (start != 0) record(stage, ticks() - start);
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    Stage stage;
+    uint64_t start;
+};
+
+/**
+ * @brief Folds the calling thread's slot into the totals and frees it
+ *
+ * Threads do this on exit; a forked child must call it itself, since
+ * _exit() runs no destructors.
+ */
+void release();
+
+/**
+ * @brief The totals of every process and thread as a JSON object
+ *
+ * Counters appear by name; each stage gives its sample count and the mean,
+ * p50, p90, p99, p99.9 and maximum in microseconds.
+ */
+std::string toJson();
+
+} // namespace Metrics
+
+#endif // SHANNON_METRICS_H
@@ -1,249 +1,803 @@
 /**
  * @file client.cpp
  * @brief Client implementation for Shannon encoding service
- * 
+ *
  * This client demonstrates:
  * - Socket programming
- * - Multithreaded network communication
+ * - An epoll-driven engine that streams lines from stdin over a few
+ *   persistent, pipelined connections with a bounded number of requests in flight,
+ *   or the same engine on io_uring (--uring)
+ * - Ordered output through a reorder buffer, printed as results complete
+ * - Encoding against a static code table trained on the server (--train, --table ID)
+ * - An alphabet hint selecting the server's fixed-alphabet encoders (--alphabet)
+ * - Fetching the server's counters and stage latencies (--stats)
  * - Error handling and resource management
  * - Thread synchronization
  */
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <string_view>
 #include <sys/types.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <poll.h>
 #include <netinet/in.h>
-#include <netdb.h>
 #include <cstring>
 #include <pthread.h>
 #include <vector>
 #include <stdexcept>
 #include <memory>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <cerrno>
+
+#include "../codec/shannon.h"
+#include "../codec/fixedAlphabet.h"
+#include "../sync/reorderBuffer.h"
+#include "../io/mappedFile.h"
+#include "protocol.h"
+#include "networkClient.h"
+#include "uring.h"
 
 // Configuration constants
 namespace ClientConfig {
-    constexpr int BUFFER_SIZE = 32;
-    constexpr int MAX_RETRIES = 3;
+    constexpr unsigned CONNECTIONS = 4;         // Most persistent connections to the server
+    constexpr size_t IN_FLIGHT = 128;           // Requests sent ahead of the oldest unanswered one
+    constexpr size_t IN_FLIGHT_BYTES = 4 << 20; // Message bytes in flight across all connections
+    constexpr size_t BATCH_LINES = 256;         // Most lines sent in one request
+    constexpr size_t BATCH_BYTES = 16 * 1024;   // Lines at least this long go alone
+    constexpr size_t RECEIVE_SIZE = 64 * 1024;  // Input bytes requested per read
+    constexpr int MAX_EVENTS = 64;
+    constexpr unsigned URING_ENTRIES = 64;      // Submissions per io_uring_enter before it flushes early
 }
 
 /**
- * @struct CharCode
- * @brief Stores character encoding information
+ * @struct StaticTable
+ * @brief A trained table every request is encoded with; id 0 means none
  */
-struct CharCode {
-    char character;
-    int freq;
-    std::string code;
+struct StaticTable {
+    uint32_t id = 0;
+    std::vector<Shannon::CharCode> codes;
+    std::unique_ptr<Shannon::Decoder> decoder;  ///< Built once for every response
 };
 
 /**
- * @struct ThreadData
- * @brief Thread communication data structure
+ * @brief The entries of a static table that line uses, with their counts in line
  */
-struct ThreadData {
-    int portno;
-    std::string hostname;
-    std::string line;
-    std::string encodedLine;
-    std::vector<CharCode> charCodeVec;
-    
-    ThreadData(const std::string& host, int port) 
-        : portno(port), hostname(host) {}
-};
+std::vector<Shannon::CharCode> staticAlphabet(std::string_view line, const std::vector<Shannon::CharCode>& table) {
+    Shannon::Histogram hist{};
+    Shannon::countFrequencies(line.data(), line.size(), hist);
+
+    std::vector<Shannon::CharCode> alphabet;
+    for (const auto& charCode : table) {
+        const uint32_t freq = hist[static_cast<uint8_t>(charCode.character)];
+        if (freq > 0) {
+            alphabet.push_back(Shannon::CharCode{charCode.character, static_cast<int>(freq),
+                                                 charCode.length, charCode.bits});
+        }
+    }
+    return alphabet;
+}
+
+/**
+ * @brief Sends one request on its own connection and waits for the response frame
+ * @return The frame without its length field
+ */
+std::vector<char> exchange(const sockaddr_in& serv_addr, Protocol::RequestType type, std::string_view body) {
+    const int sockfd = connectToServer(serv_addr);
+    try {
+        const std::string header = Protocol::serializeRequestHeader(0, body.size(), type);
+        Protocol::writeAll(sockfd, header, body.data(), body.size());
+
+        uint64_t frameLength;
+        std::vector<char> frame;
+        if (!Protocol::readAll(sockfd, &frameLength, sizeof(frameLength))) {
+            throw std::runtime_error("Server closed the connection");
+        }
+        if (frameLength > Protocol::MAX_RESPONSE_SIZE) {
+            throw std::runtime_error("Response announces " + std::to_string(frameLength) + " bytes");
+        }
+        // Grown as it arrives rather than sized on the server's word
+        while (frame.size() < frameLength) {
+            const size_t chunk = std::min<uint64_t>(frameLength - frame.size(), Protocol::RESERVE_LIMIT);
+            const size_t old = frame.size();
+            frame.resize(old + chunk);
+            if (!Protocol::readAll(sockfd, frame.data() + old, chunk)) {
+                throw std::runtime_error("Server closed the connection");
+            }
+        }
+        close(sockfd);
+        return frame;
+    } catch (...) {
+        close(sockfd);
+        throw;
+    }
+}
+
+/**
+ * @brief Sends a TRAIN or TABLE request and waits for the table
+ * @return The static table id
+ */
+uint32_t requestTable(const sockaddr_in& serv_addr, Protocol::RequestType type, std::string_view body,
+                      std::vector<Shannon::CharCode>& table) {
+    const std::vector<char> frame = exchange(serv_addr, type, body);
+    return Protocol::parseTableResponse(frame.data(), frame.size(), table);
+}
 
 /**
- * @class NetworkClient
- * @brief Handles network communication for a single thread
+ * @class LineReader
+ * @brief Cuts input into batches of lines, reading only as much as they need
+ *
+ * On a pipe or terminal the descriptor is non-blocking: when no complete
+ * line is waiting, the lines gathered so far go out as a short batch
+ * instead of waiting for the batch to fill. Preloaded input, such as a
+ * mapped file, is handed out as views without copying.
  */
-class NetworkClient {
+class LineReader {
 private:
-    int sockfd;
-    struct sockaddr_in serv_addr;
-    struct hostent* server;
-    
-    void connectToServer(const std::string& hostname, int portno) {
-        sockfd = socket(AF_INET, SOCK_STREAM, 0);
-        if (sockfd < 0) {
-            throw std::runtime_error("Error opening socket");
-        }
-        
-        server = gethostbyname(hostname.c_str());
-        if (!server) {
-            throw std::runtime_error("Error: no such host");
-        }
-        
-        bzero((char*)&serv_addr, sizeof(serv_addr));
-        serv_addr.sin_family = AF_INET;
-        bcopy((char*)server->h_addr, (char*)&serv_addr.sin_addr.s_addr, server->h_length);
-        serv_addr.sin_port = htons(portno);
-        
-        if (connect(sockfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
-            throw std::runtime_error("Error connecting to server");
-        }
-    }
-    
+    int fd;
+    std::string buffer;         ///< Bytes read from fd
+    size_t begin = 0;           ///< Start of the first unread line
+    size_t scanned = 0;         ///< Bytes from begin already searched for a newline
+    bool ended = false;
+    bool ready = true;          ///< fd may have data; cleared when a read would block
+    std::unique_ptr<LineScanner> preloaded;  ///< Lines of preloaded input, instead of fd
+    std::string_view held;      ///< Line taken but left for the next batch
+    bool holding = false;
+
+    /**
+     * @return false if nothing more can be read right now
+     */
+    bool readMore() {
+        if (ended || !ready) return false;
+
+        // Keep only the partial line before reading behind it
+        if (begin > 0) {
+            buffer.erase(0, begin);
+            begin = 0;
+        }
+        const size_t old = buffer.size();
+        while (true) {
+            buffer.resize(old + ClientConfig::RECEIVE_SIZE);
+            const ssize_t n = read(fd, &buffer[old], ClientConfig::RECEIVE_SIZE);
+            if (n > 0) {
+                buffer.resize(old + n);
+                return true;
+            }
+            buffer.resize(old);
+            if (n == 0) {
+                ended = true;
+                return false;
+            }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                ready = false;
+                return false;
+            }
+            throw std::runtime_error("Error reading input");
+        }
+    }
+
+    /**
+     * @brief The next line; from fd, it stays valid only until the next call
+     */
+    bool takeLine(std::string_view& line) {
+        if (holding) {
+            line = held;
+            holding = false;
+            return true;
+        }
+        if (preloaded) {
+            return preloaded->next(line);
+        }
+
+        while (true) {
+            const size_t newline = buffer.find('\n', begin + scanned);
+            if (newline != std::string::npos) {
+                line = std::string_view(buffer).substr(begin, newline - begin);
+                begin = newline + 1;
+                scanned = 0;
+                return true;
+            }
+            scanned = buffer.size() - begin;
+            if (!readMore()) break;
+        }
+
+        // The last line may lack its newline
+        if (ended && begin < buffer.size()) {
+            line = std::string_view(buffer).substr(begin);
+            begin = buffer.size();
+            scanned = 0;
+            return true;
+        }
+        return false;
+    }
+
 public:
-    NetworkClient(const std::string& hostname, int portno) {
-        connectToServer(hostname, portno);
-    }
-    
-    ~NetworkClient() {
-        if (sockfd >= 0) {
-            close(sockfd);
-        }
-    }
-    
-    void sendMessage(const std::string& message) {
-        char buffer[ClientConfig::BUFFER_SIZE];
-        strncpy(buffer, message.c_str(), sizeof(buffer) - 1);
-        buffer[sizeof(buffer) - 1] = '\0';
-        
-        if (write(sockfd, buffer, sizeof(buffer)) < 0) {
-            throw std::runtime_error("Error writing to socket");
-        }
-    }
-    
-    void receiveResponse(ThreadData& data) {
-        // Receive character vector size
-        int charCodeVecSize;
-        if (read(sockfd, &charCodeVecSize, sizeof(int)) < 0) {
-            throw std::runtime_error("Error reading from socket");
-        }
-        
-        // Receive character data
-        data.charCodeVec.clear();
-        data.charCodeVec.reserve(charCodeVecSize);
-        
-        for (int i = 0; i < charCodeVecSize; ++i) {
-            CharCode charCode;
-            
-            // Read character
-            if (read(sockfd, &charCode.character, sizeof(char)) < 0) {
-                throw std::runtime_error("Error reading character from socket");
-            }
-            
-            // Read frequency
-            if (read(sockfd, &charCode.freq, sizeof(int)) < 0) {
-                throw std::runtime_error("Error reading frequency from socket");
-            }
-            
-            // Read code length
-            int codeLength;
-            if (read(sockfd, &codeLength, sizeof(int)) < 0) {
-                throw std::runtime_error("Error reading code length from socket");
-            }
-            
-            // Read code
-            std::vector<char> codeBuffer(codeLength + 1);
-            if (read(sockfd, codeBuffer.data(), codeLength) < 0) {
-                throw std::runtime_error("Error reading code from socket");
-            }
-            codeBuffer[codeLength] = '\0';
-            charCode.code = std::string(codeBuffer.data());
-            
-            data.charCodeVec.push_back(charCode);
-        }
-        
-        // Receive encoded message size
-        int encodedSize;
-        if (read(sockfd, &encodedSize, sizeof(int)) < 0) {
-            throw std::runtime_error("Error reading encoded size from socket");
-        }
-        
-        // Receive encoded message
-        std::vector<char> encodedBuffer(encodedSize + 1);
-        if (read(sockfd, encodedBuffer.data(), encodedSize) < 0) {
-            throw std::runtime_error("Error reading encoded message from socket");
-        }
-        encodedBuffer[encodedSize] = '\0';
-        data.encodedLine = std::string(encodedBuffer.data());
+    explicit LineReader(int fd) : fd(fd) {}
+
+    int descriptor() const { return fd; }
+
+    /**
+     * @brief Serves lines from data instead of the descriptor
+     * @param data Must outlive every batch taken from the reader
+     */
+    void preload(std::string_view data) {
+        preloaded = std::make_unique<LineScanner>(data);
+        ended = true;
+    }
+
+    void setReady() { ready = true; }
+
+    bool readsDescriptor() const { return !preloaded; }
+
+    bool finished() const {
+        return ended && !holding && (preloaded ? preloaded->finished() : begin == buffer.size());
+    }
+
+    /**
+     * @brief Fills batch with the next lines that are available now
+     *
+     * Lines read from fd are copied once into batch.storage, which is sized
+     * up front so the views into it never move.
+     * @return false if no line is available yet, or the input has ended
+     */
+    bool nextBatch(Batch& batch) {
+        std::string_view line;
+        while (batch.lines.size() < ClientConfig::BATCH_LINES && takeLine(line)) {
+            if (line.empty()) continue;
+            if (!batch.lines.empty() && batch.bytes + line.size() > ClientConfig::BATCH_BYTES) {
+                held = line;
+                holding = true;
+                break;
+            }
+            if (!preloaded) {
+                if (batch.lines.empty()) {
+                    batch.storage.reserve(std::max(line.size(), ClientConfig::BATCH_BYTES));
+                }
+                const size_t offset = batch.storage.size();
+                batch.storage.insert(batch.storage.end(), line.begin(), line.end());
+                line = std::string_view(batch.storage.data() + offset, line.size());
+            }
+            batch.bytes += line.size();
+            batch.lines.emplace_back();
+            batch.lines.back().line = line;
+            if (batch.bytes >= ClientConfig::BATCH_BYTES) break;  // Long lines go alone
+        }
+        return !batch.lines.empty();
     }
 };
 
 /**
- * @brief Thread function for communicating with server
+ * @class AsyncClient
+ * @brief Drives every connection from one epoll loop, or from one io_uring
+ *
+ * On io_uring every connection always has a read submitted into its
+ * receive space and at most one send of the frames queued before it, and
+ * one io_uring_enter() per iteration submits them and collects what
+ * finished.
+ *
+ * Batches are numbered in input order; the request id is the low 32 bits
+ * of that sequence number. A batch is sent only while it is fewer than
+ * the window ahead of the oldest unanswered one, so the reorder buffer
+ * never holds more than a window of results and memory stays constant
+ * however long the input is.
  */
-void* communicateWithServer(void* void_ptr) {
-    ThreadData* data = static_cast<ThreadData*>(void_ptr);
-    
-    try {
-        NetworkClient client(data->hostname, data->portno);
-        client.sendMessage(data->line);
-        client.receiveResponse(*data);
-    } catch (const std::exception& e) {
-        std::cerr << "Thread error: " << e.what() << std::endl;
+class AsyncClient {
+private:
+    sockaddr_in serv_addr;
+    unsigned maxConnections;
+    size_t window;
+    uint32_t staticTable;
+    uint16_t flags;
+    ReorderBuffer<Batch>& results;
+
+    int epollFd;
+    std::vector<std::unique_ptr<NetworkClient>> clients;
+    std::map<uint64_t, Batch> inFlight;     ///< Sent batches by sequence number
+    uint64_t nextSeq = 0;
+    size_t inFlightBytes = 0;
+
+    static constexpr uint64_t INPUT_TAG = 0;    ///< Connections are tagged index + 1
+
+    /**
+     * @struct Outgoing
+     * @brief A connection's frames handed to io_uring, which must stay put until sent
+     */
+    struct Outgoing {
+        std::string sending;
+        size_t offset = 0;
+        bool busy = false;
+    };
+
+    /**
+     * @enum UringOp
+     * @brief What a completion answers; user_data holds it below the connection index
+     */
+    enum class UringOp : uint8_t { INPUT, SEND, RECEIVE };
+    static constexpr unsigned OP_BITS = 8;
+
+    std::unique_ptr<Uring> ring;            ///< Set when connections are driven by io_uring
+    std::deque<Outgoing> outgoing;          ///< By connection index; a deque never moves them
+    int inputFd = -1;                       ///< Watched by io_uring
+    LineReader* input = nullptr;            ///< The input of the current run()
+
+    static uint64_t uringTag(size_t connection, UringOp op) {
+        return (static_cast<uint64_t>(connection) << OP_BITS) | static_cast<uint64_t>(op);
+    }
+
+    uint64_t firstUnanswered() const {
+        return inFlight.empty() ? nextSeq : inFlight.begin()->first;
+    }
+
+    bool canSend() const {
+        return nextSeq - firstUnanswered() < window &&
+               (inFlight.empty() || inFlightBytes < ClientConfig::IN_FLIGHT_BYTES);
+    }
+
+    /**
+     * @brief The index of the least loaded connection, opening another while every open one is busy
+     */
+    size_t pickConnection() {
+        size_t best = clients.size();
+        for (size_t i = 0; i < clients.size(); ++i) {
+            if (best == clients.size() || clients[i]->inFlight < clients[best]->inFlight) best = i;
+        }
+        if (best < clients.size() && (clients[best]->inFlight == 0 || clients.size() == maxConnections)) {
+            return best;
+        }
+
+        clients.push_back(std::make_unique<NetworkClient>(serv_addr));
+        const size_t index = clients.size() - 1;
+        if (ring) {
+            outgoing.emplace_back();
+            armReceive(index);
+            return index;
+        }
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = index + 1;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clients.back()->descriptor(), &event) < 0) {
+            throw std::runtime_error("Error registering connection");
+        }
+        return index;
+    }
+
+    void send(Batch batch) {
+        const size_t index = pickConnection();
+        NetworkClient& client = *clients[index];
+        client.queue(static_cast<uint32_t>(nextSeq), batch, staticTable, flags);
+        if (ring) {
+            startSend(index);
+        } else {
+            client.flush();
+        }
+        inFlightBytes += batch.bytes;
+        inFlight.emplace(nextSeq++, std::move(batch));
+    }
+
+    void receive(NetworkClient& client) {
+        // Edge-triggered: read until the socket has nothing more
+        bool more = true;
+        while (more) {
+            more = client.receive();
+            deliver(client);
+        }
+    }
+
+    /**
+     * @brief Hands every complete response that has arrived on client to results
+     */
+    void deliver(NetworkClient& client) {
+        const char* frame;
+        uint64_t length;
+        while (client.nextFrame(frame, length)) {
+            // Ids are unambiguous within a window of fewer than 2^32 requests
+            const uint64_t base = firstUnanswered();
+            const uint32_t requestId = Protocol::responseRequestId(frame, length);
+            const uint64_t seq = base + static_cast<uint32_t>(requestId - static_cast<uint32_t>(base));
+            auto it = inFlight.find(seq);
+            if (it == inFlight.end()) {
+                throw std::runtime_error("Response for unknown request " + std::to_string(requestId));
+            }
+
+            client.parse(frame, length, it->second);
+            inFlightBytes -= it->second.bytes;
+            Batch batch = std::move(it->second);
+            inFlight.erase(it);
+            results.put(seq, std::move(batch));  // Waits while the printer is a window behind
+        }
+    }
+
+    void waitEpoll() {
+        epoll_event events[ClientConfig::MAX_EVENTS];
+        const int n = epoll_wait(epollFd, events, ClientConfig::MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) return;
+            throw std::runtime_error("Error waiting for events");
+        }
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.u64 == INPUT_TAG) {
+                input->setReady();
+                continue;
+            }
+            NetworkClient& client = *clients[events[i].data.u64 - 1];
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                receive(client);
+            }
+            if (events[i].events & EPOLLOUT) {
+                client.flush();
+            }
+        }
+    }
+
+    void waitUring() {
+        // Sends and reads submitted since the last wait go in with it
+        ring->submitAndWait(1);
+        while (const io_uring_cqe* cqe = ring->peek()) {
+            const size_t index = cqe->user_data >> OP_BITS;
+            const UringOp op = static_cast<UringOp>(cqe->user_data & ((1u << OP_BITS) - 1));
+            const int32_t result = cqe->res;
+            const uint32_t cqeFlags = cqe->flags;
+            ring->advance();
+
+            switch (op) {
+                case UringOp::INPUT:
+                    if (!(cqeFlags & IORING_CQE_F_MORE)) armInput();
+                    input->setReady();
+                    break;
+                case UringOp::SEND:
+                    if (result < 0) {
+                        throw std::runtime_error("Error writing to socket");
+                    }
+                    outgoing[index].offset += result;
+                    outgoing[index].busy = false;
+                    submitSend(index);
+                    break;
+                case UringOp::RECEIVE:
+                    if (result < 0) {
+                        throw std::runtime_error("Error reading from socket");
+                    }
+                    clients[index]->received(result);
+                    deliver(*clients[index]);
+                    armReceive(index);
+                    break;
+            }
+        }
+    }
+
+    void armInput() {
+        io_uring_sqe* sqe = ring->next();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = inputFd;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = uringTag(0, UringOp::INPUT);
+    }
+
+    void armReceive(size_t index) {
+        char* space;
+        size_t length;
+        clients[index]->receiveSpace(space, length);
+        io_uring_sqe* sqe = ring->next();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = clients[index]->descriptor();
+        sqe->addr = reinterpret_cast<uint64_t>(space);
+        sqe->len = static_cast<uint32_t>(std::min<size_t>(length, UINT32_MAX));
+        sqe->user_data = uringTag(index, UringOp::RECEIVE);
+    }
+
+    /**
+     * @brief Hands the connection's queued frames to io_uring unless a send is already out
+     */
+    void startSend(size_t index) {
+        Outgoing& out = outgoing[index];
+        if (out.busy || !clients[index]->takeOutput(out.sending)) return;
+        out.offset = 0;
+        submitSend(index);
+    }
+
+    /**
+     * @brief Sends the rest of the frames in flight, or starts on the next ones once they are out
+     */
+    void submitSend(size_t index) {
+        Outgoing& out = outgoing[index];
+        if (out.offset == out.sending.size()) {
+            startSend(index);
+            return;
+        }
+        io_uring_sqe* sqe = ring->next();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = clients[index]->descriptor();
+        sqe->addr = reinterpret_cast<uint64_t>(out.sending.data() + out.offset);
+        sqe->len = static_cast<uint32_t>(std::min<size_t>(out.sending.size() - out.offset, UINT32_MAX));
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = uringTag(index, UringOp::SEND);
+        out.busy = true;
+    }
+
+public:
+    /**
+     * @param connections Most connections to open
+     * @param window Requests in flight; results buffers at least this many
+     * @param staticTable Trained table to encode with, or 0
+     * @param alphabet Alphabet hint for the server's encoder
+     * @param uring Drive the connections with io_uring, or with epoll where the kernel does not allow it
+     * @throws std::runtime_error if the epoll instance or the ring cannot be created
+     */
+    AsyncClient(const sockaddr_in& serv_addr, unsigned connections, size_t window, uint32_t staticTable,
+                Shannon::Alphabet alphabet, ReorderBuffer<Batch>& results, bool uring = false)
+        : serv_addr(serv_addr), maxConnections(std::max(connections, 1u)), window(std::max<size_t>(window, 1)),
+          staticTable(staticTable), flags(Protocol::FLAG_TABLE_IDS | Protocol::alphabetFlags(alphabet)),
+          results(results) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            throw std::runtime_error("Error creating event loop");
+        }
+        if (uring && !Uring::supported()) {
+            std::cerr << "[INFO] io_uring is not available; using epoll" << std::endl;
+        } else if (uring) {
+            ring = std::make_unique<Uring>(ClientConfig::URING_ENTRIES);
+        }
+    }
+
+    ~AsyncClient() {
+        ring.reset();   // Closing the ring ends its reads before their buffers go
+        clients.clear();
+        close(epollFd);
     }
-    
-    return nullptr;
-}
+
+    AsyncClient(const AsyncClient&) = delete;
+    AsyncClient& operator=(const AsyncClient&) = delete;
+
+    /**
+     * @brief Batches sent so far
+     */
+    uint64_t sent() const { return nextSeq; }
+
+    /**
+     * @brief Sends every line of input and hands each answered batch to results in order
+     *
+     * An empty batch follows the last result, also when the run fails, so
+     * the printer always stops.
+     * @throws std::runtime_error on connection failures or malformed responses
+     */
+    void run(LineReader& input) {
+        this->input = &input;
+
+        // Regular files cannot be watched, but reading them never blocks either
+        const int inputFlags = fcntl(input.descriptor(), F_GETFL);
+        bool watchInput = input.readsDescriptor() && inputFlags >= 0;
+        if (watchInput && ring) {
+            struct stat status;
+            watchInput = fstat(input.descriptor(), &status) == 0 && !S_ISREG(status.st_mode) &&
+                         !S_ISDIR(status.st_mode);
+        } else if (watchInput) {
+            epoll_event event;
+            event.events = EPOLLIN | EPOLLET;
+            event.data.u64 = INPUT_TAG;
+            watchInput = epoll_ctl(epollFd, EPOLL_CTL_ADD, input.descriptor(), &event) == 0;
+        }
+        if (watchInput) {
+            fcntl(input.descriptor(), F_SETFL, inputFlags | O_NONBLOCK);
+            if (ring) {
+                inputFd = input.descriptor();
+                armInput();
+            }
+        }
+        auto restoreInput = [&] {
+            if (watchInput) fcntl(input.descriptor(), F_SETFL, inputFlags);
+        };
+
+        try {
+            while (true) {
+                while (canSend()) {
+                    Batch batch;
+                    if (!input.nextBatch(batch)) break;
+                    send(std::move(batch));
+                }
+                if (inFlight.empty() && input.finished()) break;
+
+                if (ring) {
+                    waitUring();
+                } else {
+                    waitEpoll();
+                }
+            }
+        } catch (...) {
+            // Everything before the first unanswered batch is already in results
+            restoreInput();
+            results.put(firstUnanswered(), Batch());
+            throw;
+        }
+        restoreInput();
+        results.put(nextSeq, Batch());
+    }
+};
 
 /**
  * @brief Display encoding results
  */
-void displayResults(const std::vector<ThreadData>& threadData) {
-    for (const auto& data : threadData) {
+void displayResults(const std::vector<RequestData>& requests) {
+    for (const auto& data : requests) {
         std::cout << "\nMessage: " << data.line << "\n\nAlphabet:\n";
-        
+
         for (const auto& charCode : data.charCodeVec) {
             std::cout << "Symbol: " << charCode.character
                      << ", Frequency: " << charCode.freq
-                     << ", Shannon code: " << charCode.code << '\n';
+                     << ", Shannon code: " << Shannon::toAscii(charCode) << '\n';
         }
-        
-        std::cout << "\nEncoded message: " << data.encodedLine << "\n\n";
+
+        std::cout << "\nEncoded message: " << Shannon::toAscii(data.encoded) << "\n";
+        std::cout << "\nDecoded message: " << data.decodedLine << "\n\n";
     }
 }
 
+/**
+ * @struct Printer
+ * @brief Arguments of the thread that decodes and prints results in order
+ */
+struct Printer {
+    ReorderBuffer<Batch>* results;
+    const StaticTable* staticTable;
+};
+
+void decodeBatch(Batch& batch, const StaticTable& staticTable) {
+    for (RequestData& data : batch.lines) {
+        if (data.staticSymbols == 0) {
+            data.decodedLine = Shannon::decode(data.encoded, data.charCodeVec);
+            continue;
+        }
+        if (!staticTable.decoder) {
+            throw std::runtime_error("Static result without a static table");
+        }
+        data.decodedLine.resize(data.staticSymbols);
+        staticTable.decoder->decode(data.encoded.bytes.data(), 0, data.encoded.bitCount,
+                                    data.staticSymbols, &data.decodedLine[0]);
+        data.charCodeVec = staticAlphabet(data.line, staticTable.codes);
+    }
+}
+
+/**
+ * @brief Decodes and prints each contiguous run of results as it becomes ready
+ */
+void* printResults(void* void_ptr) {
+    Printer* printer = static_cast<Printer*>(void_ptr);
+    while (true) {
+        for (Batch& batch : printer->results->takeReady()) {
+            if (batch.lines.empty()) {
+                std::cout.flush();
+                return nullptr;
+            }
+            try {
+                decodeBatch(batch, *printer->staticTable);
+            } catch (const std::exception& e) {
+                std::cerr << "Decode error: " << e.what() << std::endl;
+            }
+            displayResults(batch.lines);
+        }
+        std::cout.flush();
+    }
+}
+
+/**
+ * @brief The alphabet named on the command line
+ * @throws std::runtime_error if name is not dna, hex or base64
+ */
+Shannon::Alphabet parseAlphabet(const std::string& name) {
+    if (name == "dna") return Shannon::Alphabet::DNA;
+    if (name == "hex") return Shannon::Alphabet::HEX;
+    if (name == "base64") return Shannon::Alphabet::BASE64;
+    throw std::runtime_error("Unknown alphabet: " + name + " (expected dna, hex or base64)");
+}
+
 int main(int argc, char* argv[]) {
     try {
-        if (argc != 3) {
-            throw std::runtime_error("Usage: " + std::string(argv[0]) + " hostname port");
-        }
-        
-        const std::string hostname = argv[1];
-        const int portno = std::stoi(argv[2]);
-        
-        // Read input lines
-        std::vector<ThreadData> threadData;
-        std::string line;
-        
-        while (std::getline(std::cin, line)) {
-            if (!line.empty()) {
-                threadData.emplace_back(hostname, portno);
-                threadData.back().line = line;
-            }
-        }
-        
-        if (threadData.empty()) {
-            std::cout << "No input provided." << std::endl;
-            return 0;
+        const std::string usage = "Usage: " + std::string(argv[0]) +
+            " hostname port [--file PATH] [--train | --table ID] [--connections N] [--inflight N]"
+            " [--alphabet dna|hex|base64] [--uring] [--stats]";
+        if (argc < 3) {
+            throw std::runtime_error(usage);
         }
-        
-        // Create threads
-        std::vector<pthread_t> threads(threadData.size());
-        
-        for (size_t i = 0; i < threadData.size(); ++i) {
-            if (pthread_create(&threads[i], nullptr, communicateWithServer, &threadData[i])) {
-                throw std::runtime_error("Error creating thread " + std::to_string(i));
+
+        bool train = false;
+        bool stats = false;
+        bool uring = false;
+        std::string inputPath;
+        StaticTable staticTable;
+        unsigned connections = ClientConfig::CONNECTIONS;
+        size_t window = ClientConfig::IN_FLIGHT;
+        Shannon::Alphabet alphabet = Shannon::Alphabet::ANY;
+        for (int i = 3; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--file" && i + 1 < argc) {
+                inputPath = argv[++i];
+            } else if (arg == "--train") {
+                train = true;
+            } else if (arg == "--stats") {
+                stats = true;
+            } else if (arg == "--uring") {
+                uring = true;
+            } else if (arg == "--table" && i + 1 < argc) {
+                staticTable.id = std::stoul(argv[++i]);
+            } else if (arg == "--connections" && i + 1 < argc) {
+                connections = std::stoul(argv[++i]);
+            } else if (arg == "--inflight" && i + 1 < argc) {
+                window = std::stoul(argv[++i]);
+            } else if (arg == "--alphabet" && i + 1 < argc) {
+                alphabet = parseAlphabet(argv[++i]);
+            } else {
+                throw std::runtime_error("Unknown option: " + arg + "\n" + usage);
             }
         }
-        
-        // Join threads
-        for (size_t i = 0; i < threads.size(); ++i) {
-            if (pthread_join(threads[i], nullptr)) {
-                throw std::runtime_error("Error joining thread " + std::to_string(i));
+
+        const sockaddr_in serv_addr = resolveServer(argv[1], std::stoi(argv[2]));
+        if (stats) {
+            const std::vector<char> frame = exchange(serv_addr, Protocol::RequestType::STATS, "");
+            std::cout << Protocol::parseStatsResponse(frame.data(), frame.size()) << std::endl;
+            return 0;
+        }
+        LineReader input(STDIN_FILENO);
+
+        // A mapped file is sent straight from the page cache
+        std::unique_ptr<MappedFile> file;
+        if (!inputPath.empty()) {
+            file = std::make_unique<MappedFile>(inputPath);
+            input.preload(file->data());
+        }
+
+        // Training needs the whole corpus first; otherwise lines stream in as results stream out
+        std::string corpus;
+        if (train) {
+            if (!file) {
+                corpus.assign(std::istreambuf_iterator<char>(std::cin), {});
+                input.preload(corpus);
             }
+            const std::string_view body = file ? file->data() : std::string_view(corpus);
+            staticTable.id = requestTable(serv_addr, Protocol::RequestType::TRAIN, body, staticTable.codes);
+            std::cerr << "[INFO] Trained static table " << staticTable.id << std::endl;
+        } else if (staticTable.id != 0) {
+            std::string body(Protocol::TABLE_ID_SIZE, '\0');
+            std::memcpy(&body[0], &staticTable.id, Protocol::TABLE_ID_SIZE);
+            requestTable(serv_addr, Protocol::RequestType::TABLE, body, staticTable.codes);
+        }
+        if (staticTable.id != 0) {
+            staticTable.decoder = std::make_unique<Shannon::Decoder>(staticTable.codes);
+        }
+
+        // One thread moves requests, another decodes and prints in order
+        ReorderBuffer<Batch> results(std::max<size_t>(window, 1));
+        AsyncClient client(serv_addr, connections, window, staticTable.id, alphabet, results, uring);
+        Printer printer{&results, &staticTable};
+        pthread_t printerThread;
+        if (pthread_create(&printerThread, nullptr, printResults, &printer)) {
+            throw std::runtime_error("Failed to create printer thread");
+        }
+
+        std::string failure;
+        try {
+            client.run(input);
+        } catch (const std::exception& e) {
+            failure = e.what();
+        }
+        pthread_join(printerThread, nullptr);
+
+        if (!failure.empty()) {
+            throw std::runtime_error(failure);
+        }
+        if (client.sent() == 0) {
+            std::cout << "No input provided." << std::endl;
         }
-        
-        // Display results
-        displayResults(threadData);
-        
         return 0;
-        
+
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,499 @@
+/**
+ * @file coordinator.cpp
+ * @brief Front end that shards one large input across several encoding servers
+ *
+ * The input is cut into blocks at line ends, as for a .shn archive, and
+ * encoded in three steps over one pipelined connection per server:
+ * - HISTOGRAM requests count every block on some server, and the counts
+ *   are merged into one global histogram
+ * - every server trains the same static table on the merged counts
+ *   (TRAIN_COUNTS); Shannon codes depend only on the counts, so the
+ *   tables agree across servers
+ * - ENCODE_STATIC requests encode every block with that table, and the
+ *   results go into the archive in input order as they complete
+ *
+ * Each request goes to the server with the fewest block bytes waiting for
+ * an answer, so a slow server gets less work; servers that have failed
+ * are used only when the others are full. A server whose connection
+ * fails, or that leaves a request unanswered past its deadline, has its
+ * unanswered blocks handed to the others and is reconnected up to
+ * NetworkClient::MAX_RETRIES times; a block that fails that many times
+ * ends the run.
+ */
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../codec/shannon.h"
+#include "../codec/container.h"
+#include "../io/mappedFile.h"
+#include "protocol.h"
+#include "networkClient.h"
+
+// Configuration constants
+namespace CoordinatorConfig {
+    constexpr size_t IN_FLIGHT_BYTES = 8 << 20; // Block bytes waiting for answers on one server
+    constexpr size_t WINDOW = 256;              // Blocks encoded ahead of the next one written
+    constexpr int MAX_EVENTS = 64;
+    constexpr std::chrono::seconds REQUEST_TIMEOUT{30}; // Longest wait for an answer before a server counts as failed
+}
+
+/**
+ * @class Coordinator
+ * @brief Drives every server connection from one epoll loop, block by block
+ */
+class Coordinator {
+public:
+    /**
+     * @param blocks Views into the input, which must outlive the coordinator
+     * @param timeout Longest a request may wait for its answer
+     * @throws std::runtime_error if the epoll instance cannot be created
+     */
+    Coordinator(std::vector<std::string_view> blocks, const std::vector<std::string>& servers,
+                std::chrono::milliseconds timeout)
+        : blocks(std::move(blocks)), attempts(this->blocks.size(), 0), timeout(timeout) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            throw std::runtime_error("Error creating event loop");
+        }
+        for (const std::string& server : servers) {
+            const size_t colon = server.rfind(':');
+            if (colon == std::string::npos) {
+                throw std::runtime_error("Expected host:port, got " + server);
+            }
+            shards.emplace_back();
+            shards.back().index = shards.size() - 1;
+            shards.back().name = server;
+            shards.back().address = resolveServer(server.substr(0, colon), std::stoi(server.substr(colon + 1)));
+        }
+    }
+
+    ~Coordinator() {
+        shards.clear();
+        close(epollFd);
+    }
+
+    Coordinator(const Coordinator&) = delete;
+    Coordinator& operator=(const Coordinator&) = delete;
+
+    /**
+     * @brief Merges the counts of every block, each counted by one of the servers
+     * @throws std::runtime_error if a block or every server fails too often
+     */
+    Shannon::Histogram count() {
+        hist.fill(0);
+        run(Phase::COUNT);
+        return hist;
+    }
+
+    /**
+     * @brief Encodes every block with the table trained on hist and writes them to writer in order
+     * @throws std::runtime_error if a block or every server fails too often, or the servers' tables differ
+     */
+    void encode(const Shannon::Histogram& counts, Shannon::ContainerWriter& output) {
+        hist = counts;
+        writer = &output;
+        run(Phase::ENCODE);
+    }
+
+    /**
+     * @brief Blocks each server answered, in the order the servers were given
+     */
+    std::vector<size_t> answered() const {
+        std::vector<size_t> counts;
+        for (const Shard& shard : shards) counts.push_back(shard.answered);
+        return counts;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Phase : uint8_t { COUNT, ENCODE };
+
+    /// Servers disagreeing on a table would do so on any retry
+    struct TableMismatch : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    /**
+     * @struct Request
+     * @brief An unanswered request on one connection
+     */
+    struct Request {
+        enum class Kind : uint8_t { HISTOGRAM, TRAIN, ENCODE };
+        Kind kind;
+        size_t block = 0;
+        Batch batch;        ///< The block as one line; ENCODE only
+        Clock::time_point deadline{};   ///< When the server counts as failed without an answer
+    };
+
+    /**
+     * @struct Shard
+     * @brief One encoding server and its connection, if open
+     */
+    struct Shard {
+        size_t index;                           ///< In shards; the epoll tag
+        std::string name;
+        sockaddr_in address;
+        std::unique_ptr<NetworkClient> client;
+        std::map<uint32_t, Request> pending;    ///< By request id
+        size_t pendingBytes = 0;                ///< Block bytes in pending
+        uint32_t tableId = 0;                   ///< Trained on this connection; 0 before
+        bool training = false;
+        int failures = 0;
+        size_t answered = 0;
+    };
+
+    std::vector<std::string_view> blocks;
+    std::vector<int> attempts;          ///< Failed attempts per block
+    std::deque<Shard> shards;           ///< A deque never moves them
+    std::chrono::milliseconds timeout;
+    int epollFd;
+    uint32_t nextRequestId = 0;
+
+    Shannon::Histogram hist{};
+    std::deque<size_t> todo;            ///< Blocks to send, in input order except for retries
+    size_t outstanding = 0;             ///< Blocks not yet answered
+
+    Shannon::ContainerWriter* writer = nullptr;
+    std::vector<Shannon::CharCode> table;           ///< Trained by the first server to answer
+    std::map<size_t, Request> encoded;              ///< Answered blocks waiting for earlier ones
+    size_t nextWrite = 0;
+
+    bool usable(const Shard& shard) const {
+        return shard.client || shard.failures <= NetworkClient::MAX_RETRIES;
+    }
+
+    /**
+     * @brief The open or reopenable shard with room that failed least, then has the fewest bytes waiting, or nullptr
+     *
+     * Preferring fewer failures sends a retried block to another server rather than back to the one that lost it.
+     */
+    Shard* pickShard(Phase phase) {
+        Shard* best = nullptr;
+        for (Shard& shard : shards) {
+            if (!usable(shard) || shard.pendingBytes >= CoordinatorConfig::IN_FLIGHT_BYTES) continue;
+            if (phase == Phase::ENCODE && shard.training) continue;
+            if (!best || std::make_pair(shard.failures, shard.pendingBytes) <
+                         std::make_pair(best->failures, best->pendingBytes)) {
+                best = &shard;
+            }
+        }
+        return best;
+    }
+
+    /**
+     * @return false if the server could not be reached
+     */
+    bool connect(Shard& shard) {
+        try {
+            shard.client = std::make_unique<NetworkClient>(shard.address);
+        } catch (const std::exception& e) {
+            ++shard.failures;
+            std::cerr << "[WARNING] " << shard.name << ": " << e.what() << std::endl;
+            return false;
+        }
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = shard.index;
+        if (shard.client->descriptor() < 0 ||
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, shard.client->descriptor(), &event) < 0) {
+            throw std::runtime_error("Error registering connection");
+        }
+        return true;
+    }
+
+    /**
+     * @brief Closes a failed connection and puts its unanswered blocks back in front of the queue
+     * @throws std::runtime_error if one of those blocks has now failed MAX_RETRIES times
+     */
+    void fail(Shard& shard, const std::string& error) {
+        std::cerr << "[WARNING] " << shard.name << " failed: " << error << std::endl;
+        ++shard.failures;
+        shard.client.reset();   // Closing the socket also removes it from epoll
+        shard.tableId = 0;      // A new connection may reach a process that never trained it
+        shard.training = false;
+
+        for (auto it = shard.pending.rbegin(); it != shard.pending.rend(); ++it) {
+            if (it->second.kind == Request::Kind::TRAIN) continue;
+            const size_t block = it->second.block;
+            if (++attempts[block] >= NetworkClient::MAX_RETRIES) {
+                throw std::runtime_error("Block " + std::to_string(block) + " failed " +
+                                         std::to_string(attempts[block]) + " times");
+            }
+            todo.push_front(block);
+        }
+        shard.pending.clear();
+        shard.pendingBytes = 0;
+    }
+
+    void send(Shard& shard, Request request, size_t bytes) {
+        const uint32_t requestId = nextRequestId++;
+        switch (request.kind) {
+            case Request::Kind::HISTOGRAM:
+                shard.client->queueFrame(Protocol::serializeRequestHeader(
+                    requestId, bytes, Protocol::RequestType::HISTOGRAM));
+                shard.client->queueFrame(std::string(blocks[request.block]));
+                break;
+            case Request::Kind::TRAIN:
+                shard.client->queueFrame(Protocol::serializeCountsRequest(requestId, hist));
+                shard.training = true;
+                break;
+            case Request::Kind::ENCODE:
+                request.batch.lines.emplace_back();
+                request.batch.lines[0].line = blocks[request.block];
+                request.batch.bytes = bytes;
+                shard.client->queue(requestId, request.batch, shard.tableId, 0);
+                break;
+        }
+        request.deadline = Clock::now() + timeout;
+        shard.pendingBytes += bytes;
+        shard.pending.emplace(requestId, std::move(request));
+        shard.client->flush();
+    }
+
+    /**
+     * @brief Sends queued blocks while some server has room
+     */
+    void dispatch(Phase phase) {
+        while (!todo.empty()) {
+            const size_t block = todo.front();
+            if (phase == Phase::ENCODE && block >= nextWrite + CoordinatorConfig::WINDOW) return;
+
+            Shard* shard = pickShard(phase);
+            if (!shard) return;
+            if (!shard->client && !connect(*shard)) continue;
+
+            try {
+                if (phase == Phase::ENCODE && shard->tableId == 0) {
+                    send(*shard, Request{Request::Kind::TRAIN, 0, Batch()}, 0);     // Encodes wait for the table id
+                    continue;
+                }
+                todo.pop_front();
+                const Request::Kind kind = phase == Phase::COUNT ? Request::Kind::HISTOGRAM : Request::Kind::ENCODE;
+                send(*shard, Request{kind, block, Batch()}, blocks[block].size());
+            } catch (const std::runtime_error& e) {
+                fail(*shard, e.what());
+            }
+        }
+    }
+
+    /**
+     * @brief Handles every complete response that has arrived on shard
+     *
+     * A request leaves pending only once its response checks out, so a
+     * bad response leaves its block for fail() to send again.
+     */
+    void deliver(Shard& shard) {
+        const char* frame;
+        uint64_t length;
+        while (shard.client->nextFrame(frame, length)) {
+            auto it = shard.pending.find(Protocol::responseRequestId(frame, length));
+            if (it == shard.pending.end()) {
+                throw std::runtime_error("Response for unknown request");
+            }
+            Request& request = it->second;
+            const size_t block = request.block;
+
+            switch (request.kind) {
+                case Request::Kind::HISTOGRAM: {
+                    const Shannon::Histogram counts = Protocol::parseHistogramResponse(frame, length);
+                    uint64_t total = 0;
+                    for (uint32_t freq : counts) total += freq;
+                    if (total != blocks[block].size()) {
+                        throw std::runtime_error("Histogram does not match its block");
+                    }
+                    for (int symbol = 0; symbol < 256; ++symbol) hist[symbol] += counts[symbol];
+                    break;
+                }
+                case Request::Kind::TRAIN:
+                    trained(shard, frame, length);
+                    shard.pending.erase(it);
+                    continue;
+                case Request::Kind::ENCODE:
+                    shard.client->parse(frame, length, request.batch);
+                    if (request.batch.lines[0].staticSymbols != blocks[block].size()) {
+                        throw std::runtime_error("Encoded block has the wrong length");
+                    }
+                    encoded.emplace(block, std::move(request));
+                    break;
+            }
+            shard.pending.erase(it);
+            shard.pendingBytes -= blocks[block].size();
+            ++shard.answered;
+            --outstanding;
+        }
+        writeReady();
+    }
+
+    void trained(Shard& shard, const char* frame, uint64_t length) {
+        std::vector<Shannon::CharCode> codes;
+        shard.tableId = Protocol::parseTableResponse(frame, length, codes);
+        shard.training = false;
+        if (table.empty()) {
+            table = std::move(codes);
+            writer->writeTable(table);
+            return;
+        }
+        const bool same = std::equal(table.begin(), table.end(), codes.begin(), codes.end(),
+            [](const Shannon::CharCode& a, const Shannon::CharCode& b) {
+                return a.character == b.character && a.freq == b.freq;
+            });
+        if (!same) {
+            throw TableMismatch("Servers trained different tables on the same counts");
+        }
+    }
+
+    /**
+     * @brief Writes the answered blocks that follow the last one written
+     */
+    void writeReady() {
+        for (auto it = encoded.begin(); it != encoded.end() && it->first == nextWrite; it = encoded.erase(it)) {
+            writer->writeBlock(it->second.batch.lines[0].encoded, blocks[nextWrite].size());
+            ++nextWrite;
+        }
+    }
+
+    /**
+     * @brief The earliest deadline of any unanswered request, or Clock::time_point::max()
+     */
+    Clock::time_point nextDeadline() const {
+        Clock::time_point next = Clock::time_point::max();
+        for (const Shard& shard : shards) {
+            for (const auto& entry : shard.pending) next = std::min(next, entry.second.deadline);
+        }
+        return next;
+    }
+
+    /**
+     * @brief Fails every server holding a request past its deadline
+     */
+    void expire() {
+        const Clock::time_point now = Clock::now();
+        for (Shard& shard : shards) {
+            const bool late = std::any_of(shard.pending.begin(), shard.pending.end(),
+                [&](const auto& entry) { return entry.second.deadline <= now; });
+            if (shard.client && late) {
+                fail(shard, "No answer within " + std::to_string(timeout.count()) + " ms");
+            }
+        }
+    }
+
+    void wait() {
+        // Wake up for the earliest deadline even if no server says anything
+        int waitMs = -1;
+        const Clock::time_point deadline = nextDeadline();
+        if (deadline != Clock::time_point::max()) {
+            const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now());
+            waitMs = static_cast<int>(std::max<std::chrono::milliseconds::rep>(0, left.count()));
+        }
+
+        epoll_event events[CoordinatorConfig::MAX_EVENTS];
+        const int n = epoll_wait(epollFd, events, CoordinatorConfig::MAX_EVENTS, waitMs);
+        if (n < 0) {
+            if (errno == EINTR) return;
+            throw std::runtime_error("Error waiting for events");
+        }
+        for (int i = 0; i < n; ++i) {
+            Shard& shard = shards[events[i].data.u64];
+            if (!shard.client) continue;    // Failed earlier in this batch
+            try {
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    // Edge-triggered: read until the socket has nothing more
+                    bool more = true;
+                    while (more) {
+                        more = shard.client->receive();
+                        deliver(shard);
+                    }
+                }
+                if (events[i].events & EPOLLOUT) {
+                    shard.client->flush();
+                }
+            } catch (const TableMismatch&) {
+                throw;
+            } catch (const std::runtime_error& e) {
+                fail(shard, e.what());
+            }
+        }
+        expire();
+    }
+
+    void run(Phase phase) {
+        todo.clear();
+        for (size_t i = 0; i < blocks.size(); ++i) todo.push_back(i);
+        std::fill(attempts.begin(), attempts.end(), 0);
+        outstanding = blocks.size();
+
+        while (outstanding > 0) {
+            dispatch(phase);
+            if (std::none_of(shards.begin(), shards.end(), [&](const Shard& shard) { return usable(shard); })) {
+                throw std::runtime_error("No encoding server is left");
+            }
+            wait();
+        }
+    }
+};
+
+int main(int argc, char* argv[]) {
+    try {
+        const std::string usage = "Usage: " + std::string(argv[0]) +
+            " [--block-size BYTES] [--timeout SECONDS] input output.shn host:port [host:port ...]";
+
+        size_t blockSize = Shannon::DEFAULT_BLOCK_SIZE;
+        std::chrono::milliseconds timeout = CoordinatorConfig::REQUEST_TIMEOUT;
+        std::vector<std::string> positional;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--block-size" && i + 1 < argc) {
+                blockSize = std::stoul(argv[++i]);
+            } else if (arg == "--timeout" && i + 1 < argc) {
+                timeout = std::chrono::milliseconds(static_cast<long>(std::stod(argv[++i]) * 1000));
+            } else {
+                positional.push_back(arg);
+            }
+        }
+        if (positional.size() < 3 || blockSize == 0 || timeout.count() <= 0) {
+            throw std::runtime_error(usage);
+        }
+
+        const MappedFile input(positional[0]);
+        if (input.data().size() > Shannon::MAX_FREQ) {
+            throw std::runtime_error("Input must be under 2 GiB");  // Counts must fit CharCode::freq
+        }
+        const std::vector<std::string> servers(positional.begin() + 2, positional.end());
+        Coordinator coordinator(Shannon::splitBlocks(input.data(), blockSize), servers, timeout);
+
+        const Shannon::Histogram hist = coordinator.count();
+        std::cerr << "[INFO] Counted " << input.data().size() << " bytes on " << servers.size()
+                  << " servers" << std::endl;
+
+        Shannon::ContainerWriter writer(positional[1]);
+        coordinator.encode(hist, writer);
+        writer.finish();
+
+        const std::vector<size_t> answered = coordinator.answered();
+        std::cerr << "[INFO] Wrote " << writer.blockCount() << " blocks to " << positional[1] << std::endl;
+        for (size_t i = 0; i < servers.size(); ++i) {
+            std::cerr << "[INFO] " << servers[i] << " answered " << answered[i] << " requests" << std::endl;
+        }
+        return 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
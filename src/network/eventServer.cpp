@@ -0,0 +1,1101 @@
+/**
+ * @file eventServer.cpp
+ * @brief Event-driven Shannon encoding server built on epoll or io_uring
+ */
+
+#include "eventServer.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "protocol.h"
+#include "uring.h"
+#include "zeroCopy.h"
+#include "../codec/shannon.h"
+#include "../metrics/metrics.h"
+#include "../sync/mpscQueue.h"
+
+namespace {
+    // Configuration for the event loops
+    constexpr int MAX_EVENTS = 256;
+    constexpr size_t COMPLETION_QUEUE_SIZE = 1 << 14;
+    constexpr size_t INLINE_ENCODE_LIMIT = 4096;    ///< Larger messages go to the pool
+    constexpr size_t READ_CHUNK = 16 * 1024;
+    constexpr size_t TABLE_CACHE_SIZE = 16 * 1024;   ///< Code tables shared by all loops
+    constexpr size_t OUTPUT_HIGH_WATER = 1 << 20;   ///< Unsent bytes before reads pause
+    constexpr int MAX_IOV = 16;                     ///< Output segments gathered per send
+    constexpr unsigned URING_ENTRIES = 256;         ///< Submissions per io_uring_enter before it flushes early
+    constexpr unsigned RECEIVE_BUFFERS = 256;       ///< READ_CHUNK buffers each io_uring loop receives into
+    constexpr uint16_t RECEIVE_GROUP = 0;
+
+    // Reserved epoll tags; connection ids start above them
+    constexpr uint64_t LISTEN_TAG = 0;
+    constexpr uint64_t WAKE_TAG = 1;
+
+    /**
+     * @enum UringOp
+     * @brief What an io_uring completion answers; user_data holds it below the connection id
+     */
+    enum class UringOp : uint8_t { ACCEPT, WAKE, RECEIVE, SEND, CANCEL };
+    constexpr unsigned OP_BITS = 8;
+
+    uint64_t uringTag(uint64_t id, UringOp op) {
+        return (id << OP_BITS) | static_cast<uint64_t>(op);
+    }
+
+    /// Records a request answered now that started at Metrics ticks started, if timed
+    void finishRequest(uint64_t started) {
+        if (started != 0) Metrics::record(Metrics::Stage::REQUEST, Metrics::ticks() - started);
+    }
+
+    int createListenSocket(int port, bool reusePort) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::runtime_error("Error opening socket");
+        }
+
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (reusePort && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+            close(fd);
+            return -1;
+        }
+
+        sockaddr_in serv_addr;
+        std::memset(&serv_addr, 0, sizeof(serv_addr));
+        serv_addr.sin_family = AF_INET;
+        serv_addr.sin_addr.s_addr = INADDR_ANY;
+        serv_addr.sin_port = htons(port);
+
+        if (bind(fd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
+            close(fd);
+            throw std::runtime_error("Error on binding");
+        }
+        if (listen(fd, SOMAXCONN) < 0) {
+            close(fd);
+            throw std::runtime_error("Error on listen");
+        }
+        return fd;
+    }
+
+    /**
+     * @brief Lifts the open file limit to its hard maximum for many connections
+     */
+    void raiseFileLimit() {
+        rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+
+    /**
+     * @struct Response
+     * @brief Response frames built off-loop; a single result's packed bits stay in their own buffer
+     */
+    struct Response {
+        std::string frames;
+        Shannon::PackedBytes payload;   ///< Follows frames on the wire
+    };
+
+    /**
+     * @brief The header of one result's frame, with its packed bits moved out of msg
+     */
+    Response splitResponse(uint32_t requestId, Shannon::EncodedMsg& msg,
+                           const Protocol::TableTag& tag = Protocol::TableTag()) {
+        Response response;
+        response.frames = Protocol::serializeResponseHeader(requestId, msg, tag);
+        response.payload = std::move(msg.encoded.bytes);
+        return response;
+    }
+
+    /**
+     * @struct EncodedBatch
+     * @brief Batch results awaiting serialization on their connection's loop
+     */
+    struct EncodedBatch {
+        uint32_t requestId = 0;
+        bool wantsTableIds = false;
+        Shannon::Alphabet alphabet = Shannon::Alphabet::ANY;    ///< Encoder hint from the request flags
+        std::vector<Shannon::EncodedMsg> msgs;
+        std::vector<uint32_t> tableIds;
+    };
+
+    /**
+     * @brief Encodes messages with a static table and serializes the response
+     *
+     * Static results do not depend on what the connection was sent before,
+     * so any thread may serialize them.
+     */
+    Response encodeStatic(Protocol::RequestType type, uint32_t requestId, const StaticTables::Table& table,
+                          std::vector<Shannon::EncodedMsg>& msgs,
+                          const Shannon::ParallelFor& parallelFor = Shannon::ParallelFor()) {
+        auto encodeOne = [&](size_t i) { StaticTables::encode(table, msgs[i]); };
+        if (parallelFor) {
+            parallelFor(msgs.size(), encodeOne);
+        } else {
+            for (size_t i = 0; i < msgs.size(); ++i) encodeOne(i);
+        }
+
+        std::vector<Protocol::TableTag> tags(msgs.size());
+        for (size_t i = 0; i < msgs.size(); ++i) {
+            tags[i] = Protocol::TableTag{table.id, Protocol::TableKind::STATIC,
+                                         static_cast<uint32_t>(msgs[i].line.size())};
+        }
+        if (type == Protocol::RequestType::ENCODE_STATIC) {
+            return splitResponse(requestId, msgs[0], tags[0]);
+        }
+        return Response{Protocol::serializeBatchResponse(requestId, msgs, tags), {}};
+    }
+}
+
+/**
+ * @class EventServer::Loop
+ * @brief One epoll instance or io_uring with its connections and completion queue
+ */
+class EventServer::Loop {
+public:
+    Loop(int listenFd, bool ownsListenFd, bool sharedListen, bool uring, ThreadPool& pool,
+         TableCache& tableCache, StaticTables& staticTables);
+    ~Loop();
+
+    void run();
+    static void* threadMain(void* void_ptr);
+
+    pthread_t tid = 0;
+
+private:
+    /**
+     * @struct Segment
+     * @brief Queued output: response frames, or one payload sent from its own buffer
+     */
+    struct Segment {
+        std::string frames;
+        Shannon::PackedBytes payload;   ///< Used instead of frames when not empty
+        size_t offset = 0;              ///< Bytes already sent
+        bool pinned = false;            ///< Sent zero-copy at least in part
+
+        const char* data() const {
+            return payload.empty() ? frames.data() : reinterpret_cast<const char*>(payload.data());
+        }
+        size_t size() const { return payload.empty() ? frames.size() : payload.size(); }
+    };
+
+    /**
+     * @struct Connection
+     * @brief Per-client buffers for a stream of pipelined requests
+     */
+    struct Connection {
+        int fd = -1;
+        std::string in;             ///< Header bytes split across reads
+        bool inBody = false;        ///< header is parsed and its body is arriving
+        Protocol::RequestHeader header{};
+        uint64_t started = 0;       ///< Metrics ticks when header arrived; 0 while metrics are off
+        size_t remaining = 0;       ///< Body bytes still to arrive
+        std::shared_ptr<Shannon::StreamEncoder> body;  ///< ENCODE message being received
+        std::string batch;          ///< Body of any other request being received
+        std::unique_ptr<Shannon::Histogram> corpus;  ///< TRAIN or HISTOGRAM message counted so far
+        std::deque<Segment> out;    ///< Responses not yet sent, in order
+        size_t unsent = 0;          ///< Bytes left in out
+        std::unique_ptr<ZeroCopySender> zeroCopy;
+        size_t pending = 0;         ///< Requests still encoding on the pool
+        bool peerClosed = false;    ///< Client finished sending
+        bool readPaused = false;    ///< Waiting for the client to drain responses
+        KnownTables knownTables;    ///< Updated only as responses are appended to out
+
+        // io_uring backend only
+        bool receiving = false;     ///< A multishot receive is armed
+        bool sending = false;       ///< sendMessage is submitted
+        bool closing = false;       ///< Shut down; erased once the kernel has finished with it
+        size_t sendSegments = 0;    ///< Leading segments of out that sendMessage points into
+        msghdr sendMessage{};
+        iovec sendIov[MAX_IOV];
+    };
+
+    /**
+     * @struct Completion
+     * @brief Work finished off-loop for a connection
+     *
+     * Batches come back unserialized: whether a table goes out in full or as
+     * a reference depends on what the connection was sent before them.
+     */
+    struct Completion {
+        uint64_t id = 0;
+        uint64_t started = 0;       ///< Request's Metrics ticks, for the REQUEST stage
+        Response response;
+        std::shared_ptr<EncodedBatch> batch;
+    };
+
+    int listenFd;
+    bool ownsListenFd;
+    bool useUring;
+    int epollFd;
+    int wakeFd;
+    ThreadPool& pool;
+    TableCache& tableCache;
+    StaticTables& staticTables;
+    PayloadPool payloads;           ///< Buffers back from the kernel, for large encodings
+
+    uint64_t nextId = WAKE_TAG + 1;
+    std::unordered_map<uint64_t, Connection> connections;
+
+    MpscQueue<Completion> completions;
+    std::atomic<bool> wakePending{false};
+
+    // Created by runUring() and released before the connections they point into
+    std::unique_ptr<Uring> ring;
+    std::unique_ptr<BufferRing> receiveBuffers;
+
+    void runEpoll();
+    void acceptAll();
+    void onReadable(uint64_t id, Connection& conn);
+    void onWritable(uint64_t id, Connection& conn);
+    bool onNotified(Connection& conn);
+    void parseRequests(uint64_t id, Connection& conn, const char* data, size_t length);
+    void dispatch(uint64_t id, Connection& conn);
+    void dispatchBatch(uint64_t id, Connection& conn);
+    void dispatchStatic(uint64_t id, Connection& conn);
+    void answerTable(Connection& conn, uint32_t tableId);
+    void respond(Completion completion);
+    std::string serializeBatch(Connection& conn, const EncodedBatch& batch);
+    void queue(Connection& conn, std::string&& frames);
+    void queuePayload(Connection& conn, Shannon::PackedBytes&& payload);
+    void consume(Connection& conn, size_t sent);
+    bool flush(uint64_t id, Connection& conn);
+    void closeIfDone(uint64_t id, Connection& conn);
+    void drainCompletions();
+    void closeConnection(uint64_t id);
+
+    void runUring();
+    void armAccept();
+    void armWake();
+    void armReceive(uint64_t id, Connection& conn);
+    void onAccepted(int32_t result, uint32_t flags);
+    void onReceived(uint64_t id, int32_t result, uint32_t flags);
+    void onSent(uint64_t id, int32_t result);
+    void startSend(uint64_t id, Connection& conn);
+    void resumeReceive(uint64_t id, Connection& conn);
+
+    /**
+     * @brief Hands finished work back to the loop; any thread
+     */
+    void complete(Completion completion);
+};
+
+EventServer::Loop::Loop(int listenFd, bool ownsListenFd, bool sharedListen, bool uring, ThreadPool& pool,
+                        TableCache& tableCache, StaticTables& staticTables)
+    : listenFd(listenFd), ownsListenFd(ownsListenFd), useUring(uring), pool(pool), tableCache(tableCache),
+      staticTables(staticTables), completions(COMPLETION_QUEUE_SIZE) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0) {
+        throw std::runtime_error("Error creating event loop");
+    }
+    if (uring) return;     // The ring is set up by the loop's own thread
+
+    // A shared listening socket wakes only one loop per connection
+    epoll_event event;
+    event.events = EPOLLIN | (sharedListen ? static_cast<uint32_t>(EPOLLEXCLUSIVE) : 0u);
+    event.data.u64 = LISTEN_TAG;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) < 0) {
+        throw std::runtime_error("Error registering listening socket");
+    }
+
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_TAG;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) < 0) {
+        throw std::runtime_error("Error registering wake descriptor");
+    }
+}
+
+EventServer::Loop::~Loop() {
+    for (auto& [id, conn] : connections) {
+        close(conn.fd);
+    }
+    close(wakeFd);
+    close(epollFd);
+    if (ownsListenFd) close(listenFd);
+}
+
+void* EventServer::Loop::threadMain(void* void_ptr) {
+    try {
+        static_cast<Loop*>(void_ptr)->run();
+    } catch (const std::exception& e) {
+        std::cerr << "Event loop error: " << e.what() << std::endl;
+    }
+    return nullptr;
+}
+
+void EventServer::Loop::run() {
+    if (useUring) {
+        runUring();
+    } else {
+        runEpoll();
+    }
+}
+
+void EventServer::Loop::runEpoll() {
+    epoll_event events[MAX_EVENTS];
+
+    while (true) {
+        const int n = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Error waiting for events");
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const uint64_t tag = events[i].data.u64;
+            if (tag == LISTEN_TAG) {
+                acceptAll();
+                continue;
+            }
+            if (tag == WAKE_TAG) {
+                drainCompletions();
+                continue;
+            }
+
+            auto it = connections.find(tag);
+            if (it == connections.end()) continue;  // Closed earlier in this batch
+
+            // Zero-copy notifications raise EPOLLERR too
+            if ((events[i].events & EPOLLHUP) || ((events[i].events & EPOLLERR) && !onNotified(it->second))) {
+                closeConnection(tag);
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                onReadable(tag, it->second);
+            }
+
+            it = connections.find(tag);
+            if (it != connections.end() && (events[i].events & EPOLLOUT)) {
+                onWritable(tag, it->second);
+            } else if (it != connections.end() && (events[i].events & EPOLLERR)) {
+                closeIfDone(tag, it->second);  // The last payload may just have been released
+            }
+        }
+    }
+}
+
+void EventServer::Loop::acceptAll() {
+    while (true) {
+        const int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Error on accept: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Metrics::add(Metrics::Counter::ACCEPTS);
+
+        const uint64_t id = nextId++;
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = id;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
+            continue;
+        }
+        Connection& conn = connections[id];
+        conn.fd = fd;
+        conn.zeroCopy = std::make_unique<ZeroCopySender>(fd);
+    }
+}
+
+void EventServer::Loop::onReadable(uint64_t id, Connection& conn) {
+    char buffer[READ_CHUNK];
+    conn.readPaused = false;
+
+    // Edge-triggered: read until the socket is drained
+    while (true) {
+        // Leave requests in the socket while the client is not reading responses
+        if (conn.unsent >= OUTPUT_HIGH_WATER) {
+            if (!flush(id, conn)) return;
+            if (conn.unsent >= OUTPUT_HIGH_WATER) {
+                conn.readPaused = true;
+                return;
+            }
+        }
+
+        const ssize_t n = read(conn.fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            Metrics::add(Metrics::Counter::BYTES_IN, n);
+            try {
+                parseRequests(id, conn, buffer, n);
+            } catch (const std::exception& e) {
+                std::cerr << "Bad request: " << e.what() << std::endl;
+                Metrics::add(Metrics::Counter::ERRORS);
+                closeConnection(id);
+                return;
+            }
+            continue;
+        }
+        if (n == 0) {
+            conn.peerClosed = true;
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        closeConnection(id);
+        return;
+    }
+
+    // Responses to everything read so far go out together
+    if (!flush(id, conn)) return;
+    closeIfDone(id, conn);
+}
+
+void EventServer::Loop::parseRequests(uint64_t id, Connection& conn, const char* data, size_t length) {
+    while (true) {
+        if (!conn.inBody) {
+            // Headers may straddle reads; bodies never wait in conn.in
+            const size_t take = std::min(Protocol::REQUEST_HEADER_SIZE - conn.in.size(), length);
+            conn.in.append(data, take);
+            data += take;
+            length -= take;
+            if (conn.in.size() < Protocol::REQUEST_HEADER_SIZE) return;
+
+            conn.header = Protocol::parseRequestHeader(conn.in.data());
+            conn.started = Metrics::enabled() ? Metrics::ticks() : 0;
+            Metrics::add(Metrics::Counter::REQUESTS);
+            conn.in.clear();
+            conn.inBody = true;
+            conn.remaining = conn.header.length;
+            if (conn.header.type == Protocol::RequestType::ENCODE) {
+                conn.body = std::make_shared<Shannon::StreamEncoder>();
+                conn.body->reserve(std::min<size_t>(conn.header.length, Protocol::RESERVE_LIMIT));
+            } else if (conn.header.type == Protocol::RequestType::TRAIN ||
+                       conn.header.type == Protocol::RequestType::HISTOGRAM) {
+                conn.corpus = std::make_unique<Shannon::Histogram>();
+                conn.corpus->fill(0);
+            } else {
+                conn.batch.reserve(std::min<size_t>(conn.header.length, Protocol::RESERVE_LIMIT));
+            }
+        }
+
+        // Messages and corpora are counted as they arrive
+        const size_t take = std::min(conn.remaining, length);
+        if (conn.body) {
+            conn.body->append(data, take);
+        } else if (conn.corpus) {
+            Shannon::countFrequencies(data, take, *conn.corpus);
+        } else {
+            conn.batch.append(data, take);
+        }
+        data += take;
+        length -= take;
+        conn.remaining -= take;
+        if (conn.remaining > 0) return;
+
+        conn.inBody = false;
+        const size_t pendingBefore = conn.pending;
+        switch (conn.header.type) {
+            case Protocol::RequestType::ENCODE:
+                dispatch(id, conn);
+                break;
+            case Protocol::RequestType::BATCH:
+                dispatchBatch(id, conn);
+                break;
+            case Protocol::RequestType::TRAIN: {
+                const std::unique_ptr<Shannon::Histogram> corpus = std::move(conn.corpus);
+                answerTable(conn, staticTables.train(*corpus));
+                break;
+            }
+            case Protocol::RequestType::TABLE:
+                answerTable(conn, Protocol::parseTableId(conn.batch.data(), conn.batch.size()));
+                std::string().swap(conn.batch);
+                break;
+            case Protocol::RequestType::ENCODE_STATIC:
+            case Protocol::RequestType::BATCH_STATIC:
+                dispatchStatic(id, conn);
+                break;
+            case Protocol::RequestType::STATS:
+                std::string().swap(conn.batch);
+                queue(conn, Protocol::serializeStatsResponse(conn.header.requestId, Metrics::toJson()));
+                break;
+            case Protocol::RequestType::HISTOGRAM: {
+                const std::unique_ptr<Shannon::Histogram> counts = std::move(conn.corpus);
+                queue(conn, Protocol::serializeHistogramResponse(conn.header.requestId, *counts));
+                break;
+            }
+            case Protocol::RequestType::TRAIN_COUNTS:
+                answerTable(conn, staticTables.train(Protocol::parseCounts(conn.batch.data(), conn.batch.size())));
+                std::string().swap(conn.batch);
+                break;
+        }
+        if (conn.pending == pendingBefore) {
+            finishRequest(conn.started);   // Answered inline
+        }
+    }
+}
+
+void EventServer::Loop::dispatch(uint64_t id, Connection& conn) {
+    std::shared_ptr<Shannon::StreamEncoder> body = std::move(conn.body);
+    const uint32_t requestId = conn.header.requestId;
+    const Shannon::Alphabet alphabet = Protocol::alphabetOf(conn.header.flags);
+    const uint64_t started = conn.started;
+    Metrics::add(Metrics::Counter::MESSAGES);
+
+    if (body->size() <= INLINE_ENCODE_LIMIT) {
+        // Cheaper to encode here than to cross threads twice
+        Shannon::EncodedMsg msg;
+        const Shannon::Histogram hist = body->take(msg.line);
+        const uint32_t tableId = tableCache.encode(msg, hist, alphabet);
+        const bool wantsTableIds = conn.header.flags & Protocol::FLAG_TABLE_IDS;
+        queue(conn, Protocol::serializeResponse(requestId, msg, conn.knownTables.tag(tableId, wantsTableIds)));
+        return;
+    }
+
+    // Off-loop results always carry their table in full, which is never out of order
+    ++conn.pending;
+    pool.submit([this, id, requestId, alphabet, body, started, buffer = payloads.take()]() mutable {
+        Completion completion;
+        completion.id = id;
+        completion.started = started;
+        Shannon::EncodedMsg msg;
+        msg.encoded.bytes = std::move(buffer);  // A recycled buffer is already faulted in
+        Protocol::TableTag tag;
+        if (body->size() <= TableCache::MAX_MESSAGE_SIZE) {
+            const Shannon::Histogram hist = body->take(msg.line);
+            tag.id = tableCache.encode(msg, hist, alphabet);
+        } else if (body->size() < Shannon::PARALLEL_THRESHOLD) {
+            body->finish(msg);
+        } else {
+            body->finish(msg, [this](size_t count, const std::function<void(size_t)>& task) {
+                pool.parallelFor(count, task);
+            });
+        }
+        completion.response = splitResponse(requestId, msg, tag);
+        complete(std::move(completion));
+    });
+}
+
+void EventServer::Loop::dispatchBatch(uint64_t id, Connection& conn) {
+    // Parsed here so a malformed batch closes the connection like a bad header
+    std::vector<std::string> messages = Protocol::parseBatchRequest(conn.batch.data(), conn.batch.size());
+    const size_t batchSize = conn.batch.size();
+    std::string().swap(conn.batch);
+    Metrics::add(Metrics::Counter::MESSAGES, messages.size());
+
+    auto batch = std::make_shared<EncodedBatch>();
+    batch->requestId = conn.header.requestId;
+    batch->wantsTableIds = conn.header.flags & Protocol::FLAG_TABLE_IDS;
+    batch->alphabet = Protocol::alphabetOf(conn.header.flags);
+    batch->msgs.resize(messages.size());
+    batch->tableIds.resize(messages.size());
+    for (size_t i = 0; i < messages.size(); ++i) {
+        batch->msgs[i].line = std::move(messages[i]);
+    }
+
+    if (batchSize <= INLINE_ENCODE_LIMIT) {
+        for (size_t i = 0; i < batch->msgs.size(); ++i) {
+            batch->tableIds[i] = tableCache.encode(batch->msgs[i], batch->alphabet);
+        }
+        queue(conn, serializeBatch(conn, *batch));
+        return;
+    }
+
+    // The whole pool encodes the batch; the loop serializes it in wire order
+    ++conn.pending;
+    pool.submit([this, id, batch, started = conn.started] {
+        pool.parallelFor(batch->msgs.size(), [&](size_t i) {
+            batch->tableIds[i] = tableCache.encode(batch->msgs[i], batch->alphabet);
+        });
+        Completion completion;
+        completion.id = id;
+        completion.started = started;
+        completion.batch = batch;
+        complete(std::move(completion));
+    });
+}
+
+void EventServer::Loop::answerTable(Connection& conn, uint32_t tableId) {
+    const std::shared_ptr<const StaticTables::Table> table = staticTables.find(tableId);
+    if (!table) {
+        throw std::runtime_error("Unknown static table " + std::to_string(tableId));
+    }
+    queue(conn, Protocol::serializeTableResponse(conn.header.requestId, tableId, table->charCodeVec));
+}
+
+void EventServer::Loop::dispatchStatic(uint64_t id, Connection& conn) {
+    const uint32_t tableId = Protocol::parseTableId(conn.batch.data(), conn.batch.size());
+    std::shared_ptr<const StaticTables::Table> table = staticTables.find(tableId);
+    if (!table) {
+        throw std::runtime_error("Unknown static table " + std::to_string(tableId));
+    }
+
+    const Protocol::RequestType type = conn.header.type;
+    const uint32_t requestId = conn.header.requestId;
+    const size_t bodySize = conn.batch.size();
+    auto msgs = std::make_shared<std::vector<Shannon::EncodedMsg>>();
+    if (type == Protocol::RequestType::ENCODE_STATIC) {
+        msgs->resize(1);
+        msgs->front().line = conn.batch.substr(Protocol::TABLE_ID_SIZE);
+    } else {
+        std::vector<std::string> messages = Protocol::parseBatchRequest(
+            conn.batch.data() + Protocol::TABLE_ID_SIZE, bodySize - Protocol::TABLE_ID_SIZE);
+        msgs->resize(messages.size());
+        for (size_t i = 0; i < messages.size(); ++i) {
+            (*msgs)[i].line = std::move(messages[i]);
+        }
+    }
+    std::string().swap(conn.batch);
+    Metrics::add(Metrics::Counter::MESSAGES, msgs->size());
+
+    if (bodySize <= INLINE_ENCODE_LIMIT) {
+        Response response = encodeStatic(type, requestId, *table, *msgs);
+        queue(conn, std::move(response.frames));
+        queuePayload(conn, std::move(response.payload));
+        return;
+    }
+
+    ++conn.pending;
+    pool.submit([this, id, type, requestId, table, msgs, started = conn.started] {
+        Completion completion;
+        completion.id = id;
+        completion.started = started;
+        completion.response = encodeStatic(type, requestId, *table, *msgs,
+            [this](size_t count, const std::function<void(size_t)>& task) {
+                pool.parallelFor(count, task);
+            });
+        complete(std::move(completion));
+    });
+}
+
+std::string EventServer::Loop::serializeBatch(Connection& conn, const EncodedBatch& batch) {
+    std::vector<Protocol::TableTag> tags(batch.msgs.size());
+    for (size_t i = 0; i < tags.size(); ++i) {
+        tags[i] = conn.knownTables.tag(batch.tableIds[i], batch.wantsTableIds);
+    }
+    return Protocol::serializeBatchResponse(batch.requestId, batch.msgs, tags);
+}
+
+void EventServer::Loop::complete(Completion completion) {
+    while (!completions.tryPush(completion)) {
+        sched_yield();
+    }
+
+    // One eventfd write per batch of completions
+    if (!wakePending.exchange(true)) {
+        const uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            // Counter saturation only; the loop is awake anyway
+        }
+    }
+}
+
+void EventServer::Loop::drainCompletions() {
+    uint64_t counter;
+    while (read(wakeFd, &counter, sizeof(counter)) > 0) {}
+    wakePending = false;
+
+    Completion completion;
+    while (completions.tryPop(completion)) {
+        respond(std::move(completion));
+    }
+}
+
+void EventServer::Loop::respond(Completion completion) {
+    const uint64_t id = completion.id;
+    auto it = connections.find(id);
+    if (it == connections.end()) return;  // Client went away meanwhile
+
+    Connection& conn = it->second;
+    --conn.pending;
+    finishRequest(completion.started);
+    if (conn.closing) return;
+    if (completion.batch) {
+        queue(conn, serializeBatch(conn, *completion.batch));
+    } else {
+        queue(conn, std::move(completion.response.frames));
+        queuePayload(conn, std::move(completion.response.payload));
+    }
+    if (ring) {
+        startSend(id, conn);
+    } else {
+        onWritable(id, conn);
+    }
+}
+
+void EventServer::Loop::onWritable(uint64_t id, Connection& conn) {
+    if (!flush(id, conn)) return;
+
+    if (conn.readPaused && conn.unsent < OUTPUT_HIGH_WATER) {
+        onReadable(id, conn);
+        return;
+    }
+    closeIfDone(id, conn);
+}
+
+bool EventServer::Loop::onNotified(Connection& conn) {
+    if (!conn.zeroCopy->reap(payloads)) return false;
+
+    int error = 0;
+    socklen_t length = sizeof(error);
+    return getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+}
+
+void EventServer::Loop::queue(Connection& conn, std::string&& frames) {
+    if (frames.empty()) return;
+    conn.unsent += frames.size();
+    // Segments an io_uring send points into must not move
+    if (conn.out.empty() || !conn.out.back().payload.empty() || conn.out.size() <= conn.sendSegments) {
+        conn.out.emplace_back();
+        conn.out.back().frames = std::move(frames);
+        return;
+    }
+
+    Segment& last = conn.out.back();
+    if (last.frames.empty() && last.frames.capacity() < frames.size()) {
+        last.frames = std::move(frames);   // Large frames are not copied again
+    } else {
+        last.frames += frames;
+    }
+}
+
+void EventServer::Loop::queuePayload(Connection& conn, Shannon::PackedBytes&& payload) {
+    if (payload.empty()) return;
+    conn.unsent += payload.size();
+    conn.out.emplace_back();
+    conn.out.back().payload = std::move(payload);
+}
+
+void EventServer::Loop::consume(Connection& conn, size_t sent) {
+    conn.unsent -= sent;
+    while (sent > 0) {
+        Segment& front = conn.out.front();
+        const size_t take = std::min(sent, front.size() - front.offset);
+        front.offset += take;
+        sent -= take;
+        if (front.offset < front.size()) return;
+
+        if (!front.payload.empty()) {
+            // The kernel may still read a zero-copy payload; it returns once notified
+            if (front.pinned) {
+                conn.zeroCopy->hold(std::move(front.payload), payloads);
+            } else {
+                payloads.give(std::move(front.payload));
+            }
+        } else if (conn.out.size() == 1) {
+            front.frames.clear();   // Keeps its capacity for the next responses
+            front.offset = 0;
+            return;
+        }
+        conn.out.pop_front();
+    }
+}
+
+bool EventServer::Loop::flush(uint64_t id, Connection& conn) {
+    if (conn.unsent == 0) return true;
+
+    Metrics::StageTimer timer(Metrics::Stage::SEND);
+    while (conn.unsent > 0) {
+        // A large payload goes alone and zero-copy; anything else is gathered into one copying send
+        Segment& front = conn.out.front();
+        const bool zeroCopy = !front.payload.empty() && conn.zeroCopy->accepts(front.payload.size());
+        iovec iov[MAX_IOV];
+        int count = 0;
+        for (auto it = conn.out.begin(); it != conn.out.end() && count < MAX_IOV; ++it) {
+            if (count > 0 && (zeroCopy || (!it->payload.empty() && conn.zeroCopy->accepts(it->payload.size())))) {
+                break;
+            }
+            iov[count].iov_base = const_cast<char*>(it->data() + it->offset);
+            iov[count].iov_len = it->size() - it->offset;
+            ++count;
+        }
+
+        ssize_t n;
+        if (zeroCopy) {
+            front.pinned = true;
+            n = conn.zeroCopy->send(iov, count);
+        } else {
+            msghdr message{};
+            message.msg_iov = iov;
+            message.msg_iovlen = count;
+            n = sendmsg(conn.fd, &message, MSG_NOSIGNAL);
+        }
+        if (n > 0) {
+            Metrics::add(Metrics::Counter::BYTES_OUT, n);
+            consume(conn, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;  // Wait for EPOLLOUT
+        closeConnection(id);
+        return false;
+    }
+    return true;
+}
+
+void EventServer::Loop::closeIfDone(uint64_t id, Connection& conn) {
+    // Connections persist until the client hangs up, every answer is out
+    // and the kernel has let go of every zero-copy payload
+    if (conn.peerClosed && conn.pending == 0 && conn.unsent == 0 && !conn.sending &&
+        (!conn.zeroCopy || conn.zeroCopy->idle())) {
+        closeConnection(id);
+    }
+}
+
+void EventServer::Loop::closeConnection(uint64_t id) {
+    auto it = connections.find(id);
+    if (it == connections.end()) return;
+
+    Connection& conn = it->second;
+    if (conn.receiving || conn.sending) {
+        // io_uring still reads or fills its buffers; shutting the socket down ends those requests
+        if (!conn.closing) {
+            conn.closing = true;
+            shutdown(conn.fd, SHUT_RDWR);
+        }
+        return;
+    }
+    close(conn.fd);  // Also removes it from the epoll set
+    connections.erase(it);
+}
+
+void EventServer::Loop::runUring() {
+    // Only the thread that creates a single-issuer ring may submit to it
+    ring = std::make_unique<Uring>(URING_ENTRIES);
+    receiveBuffers = std::make_unique<BufferRing>(*ring, RECEIVE_GROUP, RECEIVE_BUFFERS, READ_CHUNK);
+    armAccept();
+    armWake();
+
+    while (true) {
+        // Everything the last batch of completions queued goes out in this one call
+        ring->submitAndWait(1);
+        while (const io_uring_cqe* cqe = ring->peek()) {
+            const uint64_t tag = cqe->user_data;
+            const int32_t result = cqe->res;
+            const uint32_t flags = cqe->flags;
+            ring->advance();
+
+            const uint64_t id = tag >> OP_BITS;
+            switch (static_cast<UringOp>(tag & ((1u << OP_BITS) - 1))) {
+                case UringOp::ACCEPT:
+                    onAccepted(result, flags);
+                    break;
+                case UringOp::WAKE:
+                    if (!(flags & IORING_CQE_F_MORE)) armWake();
+                    drainCompletions();
+                    break;
+                case UringOp::RECEIVE:
+                    onReceived(id, result, flags);
+                    break;
+                case UringOp::SEND:
+                    onSent(id, result);
+                    break;
+                case UringOp::CANCEL:
+                    break;
+            }
+        }
+    }
+}
+
+void EventServer::Loop::armAccept() {
+    io_uring_sqe* sqe = ring->next();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = uringTag(0, UringOp::ACCEPT);
+}
+
+void EventServer::Loop::armWake() {
+    io_uring_sqe* sqe = ring->next();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wakeFd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = uringTag(0, UringOp::WAKE);
+}
+
+void EventServer::Loop::armReceive(uint64_t id, Connection& conn) {
+    // Completes once per arrival, each time into a buffer the kernel picks from the ring
+    io_uring_sqe* sqe = ring->next();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn.fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECEIVE_GROUP;
+    sqe->user_data = uringTag(id, UringOp::RECEIVE);
+    conn.receiving = true;
+}
+
+void EventServer::Loop::onAccepted(int32_t result, uint32_t flags) {
+    if (!(flags & IORING_CQE_F_MORE)) armAccept();
+    if (result < 0) {
+        if (result != -ECONNABORTED && result != -EINTR) {
+            std::cerr << "Error on accept: " << std::strerror(-result) << std::endl;
+        }
+        return;
+    }
+
+    const int fd = result;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    Metrics::add(Metrics::Counter::ACCEPTS);
+
+    const uint64_t id = nextId++;
+    Connection& conn = connections[id];
+    conn.fd = fd;
+    armReceive(id, conn);
+}
+
+void EventServer::Loop::onReceived(uint64_t id, int32_t result, uint32_t flags) {
+    auto it = connections.find(id);
+    if (it == connections.end()) return;
+    Connection& conn = it->second;
+    if (!(flags & IORING_CQE_F_MORE)) conn.receiving = false;
+
+    bool failed = false;
+    if (result > 0) {
+        const uint16_t buffer = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (!conn.closing) {
+            Metrics::add(Metrics::Counter::BYTES_IN, result);
+            try {
+                parseRequests(id, conn, receiveBuffers->buffer(buffer), result);
+            } catch (const std::exception& e) {
+                std::cerr << "Bad request: " << e.what() << std::endl;
+                Metrics::add(Metrics::Counter::ERRORS);
+                failed = true;
+            }
+        }
+        receiveBuffers->recycle(buffer);
+    } else if (result == 0) {
+        conn.peerClosed = true;
+    } else if (result != -ENOBUFS && result != -ECANCELED) {
+        failed = true;     // Out of buffers only pauses a multishot receive; it is armed again below
+    }
+    if (failed || conn.closing) {
+        closeConnection(id);
+        return;
+    }
+
+    // Leave requests in the socket while the client is not reading responses
+    if (conn.unsent >= OUTPUT_HIGH_WATER && conn.receiving && !conn.readPaused) {
+        conn.readPaused = true;
+        io_uring_sqe* sqe = ring->next();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = uringTag(id, UringOp::RECEIVE);
+        sqe->user_data = uringTag(id, UringOp::CANCEL);
+    }
+
+    // Responses to everything received so far go out together
+    startSend(id, conn);
+    resumeReceive(id, conn);
+    closeIfDone(id, conn);
+}
+
+void EventServer::Loop::onSent(uint64_t id, int32_t result) {
+    auto it = connections.find(id);
+    if (it == connections.end()) return;
+    Connection& conn = it->second;
+    conn.sending = false;
+    conn.sendSegments = 0;
+    if (result < 0 || conn.closing) {
+        closeConnection(id);
+        return;
+    }
+
+    Metrics::add(Metrics::Counter::BYTES_OUT, result);
+    consume(conn, result);
+    startSend(id, conn);
+    resumeReceive(id, conn);
+    closeIfDone(id, conn);
+}
+
+void EventServer::Loop::startSend(uint64_t id, Connection& conn) {
+    if (conn.sending || conn.unsent == 0 || conn.closing) return;
+
+    // One send at a time keeps responses in order; it gathers what was queued meanwhile
+    int count = 0;
+    for (auto it = conn.out.begin(); it != conn.out.end() && count < MAX_IOV; ++it) {
+        conn.sendIov[count].iov_base = const_cast<char*>(it->data() + it->offset);
+        conn.sendIov[count].iov_len = it->size() - it->offset;
+        ++count;
+    }
+    conn.sendMessage = msghdr{};
+    conn.sendMessage.msg_iov = conn.sendIov;
+    conn.sendMessage.msg_iovlen = count;
+
+    io_uring_sqe* sqe = ring->next();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&conn.sendMessage);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = uringTag(id, UringOp::SEND);
+    conn.sending = true;
+    conn.sendSegments = count;
+}
+
+void EventServer::Loop::resumeReceive(uint64_t id, Connection& conn) {
+    if (conn.receiving || conn.peerClosed || conn.closing || conn.unsent >= OUTPUT_HIGH_WATER) return;
+    conn.readPaused = false;
+    armReceive(id, conn);
+}
+
+EventServer::EventServer(int port, unsigned loopCount, ThreadPool& pool, const std::string& tableDirectory,
+                         Backend backend)
+    : tableCache(TABLE_CACHE_SIZE), staticTables(tableDirectory) {
+    if (loopCount == 0) loopCount = ThreadPool::defaultThreadCount();
+    raiseFileLimit();
+    if (backend == Backend::URING && !Uring::supported()) {
+        std::cerr << "io_uring is not available; using epoll" << std::endl;
+        backend = Backend::EPOLL;
+    }
+    const bool uring = (backend == Backend::URING);
+
+    // Prefer one listening socket per loop so the kernel spreads accepts
+    int firstFd = createListenSocket(port, true);
+    const bool reusePort = (firstFd >= 0);
+    if (!reusePort) {
+        firstFd = createListenSocket(port, false);
+    }
+
+    loops.push_back(std::make_unique<Loop>(firstFd, true, !reusePort, uring, pool, tableCache, staticTables));
+    for (unsigned i = 1; i < loopCount; ++i) {
+        if (reusePort) {
+            const int fd = createListenSocket(port, true);
+            loops.push_back(std::make_unique<Loop>(fd, true, false, uring, pool, tableCache, staticTables));
+        } else {
+            loops.push_back(std::make_unique<Loop>(firstFd, false, true, uring, pool, tableCache, staticTables));
+        }
+    }
+}
+
+EventServer::~EventServer() = default;
+
+void EventServer::run() {
+    for (size_t i = 1; i < loops.size(); ++i) {
+        if (pthread_create(&loops[i]->tid, nullptr, Loop::threadMain, loops[i].get())) {
+            throw std::runtime_error("Failed to create event loop thread");
+        }
+    }
+    loops[0]->run();
+}
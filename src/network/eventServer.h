@@ -0,0 +1,68 @@
+/**
+ * @file eventServer.h
+ * @brief Event-driven Shannon encoding server built on epoll or io_uring
+ *
+ * One event loop per core multiplexes non-blocking connections instead of
+ * forking a process per client. Loops accept from their own SO_REUSEPORT
+ * listening socket, or share one socket where the kernel lacks it, and hand
+ * large encodings to the shared worker pool. Code tables are cached across
+ * all of them, and static tables are shared by all of them.
+ *
+ * With the io_uring backend a loop does not wait for readiness: accepts and
+ * receives are multishot requests into registered buffers, sends are
+ * submitted as responses are queued, and one io_uring_enter() per iteration
+ * submits them all and collects their completions.
+ */
+
+#ifndef EVENT_SERVER_H
+#define EVENT_SERVER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../threading/threadPool.h"
+#include "staticTables.h"
+#include "tableCache.h"
+
+/**
+ * @class EventServer
+ * @brief Runs a set of event loops on one port
+ */
+class EventServer {
+public:
+    /**
+     * @enum Backend
+     * @brief How the loops learn about socket activity
+     */
+    enum class Backend : uint8_t {
+        EPOLL,      ///< Readiness events, then non-blocking system calls
+        URING,      ///< Completions of operations submitted in batches
+    };
+
+    /**
+     * @param port TCP port to listen on
+     * @param loopCount Event loops to run; 0 selects one per CPU
+     * @param pool Workers that run encodings too large for a loop thread
+     * @param tableDirectory Where static tables persist; empty keeps them in memory
+     * @param backend URING falls back to EPOLL where the kernel does not allow it
+     * @throws std::runtime_error if a socket or epoll instance cannot be set up
+     */
+    EventServer(int port, unsigned loopCount, ThreadPool& pool, const std::string& tableDirectory = "",
+                Backend backend = Backend::EPOLL);
+    ~EventServer();
+
+    /**
+     * @brief Runs every loop; the calling thread drives the first one
+     */
+    void run();
+
+private:
+    class Loop;
+    TableCache tableCache;      ///< Shared by every loop and the pool; outlives the loops
+    StaticTables staticTables;  ///< Likewise
+    std::vector<std::unique_ptr<Loop>> loops;
+};
+
+#endif // EVENT_SERVER_H
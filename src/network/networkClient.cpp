@@ -0,0 +1,257 @@
+/**
+ * @file networkClient.cpp
+ * @brief Persistent pipelined connection to the Shannon server
+ */
+
+#include "networkClient.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "tableCache.h"
+
+sockaddr_in resolveServer(const std::string& hostname, int portno) {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* result = nullptr;
+    if (getaddrinfo(hostname.c_str(), nullptr, &hints, &result) != 0 || !result) {
+        throw std::runtime_error("Error: no such host");
+    }
+
+    sockaddr_in serv_addr;
+    std::memcpy(&serv_addr, result->ai_addr, sizeof(serv_addr));
+    serv_addr.sin_port = htons(portno);
+    freeaddrinfo(result);
+    return serv_addr;
+}
+
+int connectToServer(const sockaddr_in& serv_addr) {
+    const int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+        throw std::runtime_error("Error opening socket");
+    }
+
+    if (connect(sockfd, (const struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
+        close(sockfd);
+        throw std::runtime_error("Error connecting to server");
+    }
+
+    // Short request frames should not wait on Nagle
+    int one = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sockfd;
+}
+
+NetworkClient::NetworkClient(const sockaddr_in& serv_addr) : sockfd(connectToServer(serv_addr)) {
+    fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) | O_NONBLOCK);
+}
+
+NetworkClient::~NetworkClient() {
+    close(sockfd);
+}
+
+std::vector<Shannon::CharCode> NetworkClient::resolveTable(Protocol::Result& result) {
+    if (result.tag.kind == Protocol::TableKind::STATIC) {
+        return {};
+    }
+    if (result.tag.kind == Protocol::TableKind::REFERENCE) {
+        auto it = tables.find(result.tag.id);
+        if (it == tables.end()) {
+            throw std::runtime_error("Reference to unknown table " + std::to_string(result.tag.id));
+        }
+        return it->second;
+    }
+    // The server stops remembering ids at KnownTables::LIMIT and never references later ones
+    if (result.tag.id != 0 && tables.size() < KnownTables::LIMIT) {
+        tables[result.tag.id] = result.table;
+    }
+    return std::move(result.table);
+}
+
+void NetworkClient::queue(uint32_t requestId, const Batch& batch, uint32_t staticTable, uint16_t flags) {
+    if (batch.lines.size() == 1) {
+        const std::string_view message = batch.lines[0].line;
+        out += (staticTable != 0)
+            ? Protocol::serializeStaticRequestHeader(requestId, staticTable, message.size())
+            : Protocol::serializeRequestHeader(requestId, message.size(), Protocol::RequestType::ENCODE, flags);
+        out += message;
+        if (message.size() >= DIRECT_RECEIVE_SIZE) {
+            directIds.insert(requestId);
+        }
+    } else {
+        std::vector<std::string_view> messages;
+        messages.reserve(batch.lines.size());
+        for (const auto& data : batch.lines) {
+            messages.emplace_back(data.line);
+        }
+        out += Protocol::serializeBatchRequest(requestId, messages, flags, staticTable);
+    }
+    ++inFlight;
+}
+
+void NetworkClient::flush() {
+    while (outOffset < out.size()) {
+        const ssize_t n = send(sockfd, out.data() + outOffset, out.size() - outOffset, MSG_NOSIGNAL);
+        if (n > 0) {
+            outOffset += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;  // Wait for EPOLLOUT
+        throw std::runtime_error("Error writing to socket");
+    }
+    out.clear();
+    outOffset = 0;
+}
+
+bool NetworkClient::takeOutput(std::string& sending) {
+    if (outOffset > 0) {
+        out.erase(0, outOffset);
+        outOffset = 0;
+    }
+    if (out.empty()) return false;
+    sending.clear();
+    out.swap(sending);     // The two buffers trade places and keep their capacity
+    return true;
+}
+
+void NetworkClient::receiveSpace(char*& data, size_t& length) {
+    if (direct.state == DirectFrame::State::RECEIVING) {
+        Shannon::PackedBytes& payload = direct.result.encoded.bytes;
+        data = reinterpret_cast<char*>(payload.data()) + direct.received;
+        length = payload.size() - direct.received;
+        return;
+    }
+
+    // Move the partial frame to the front before reading more
+    if (inboxBegin > 0) {
+        std::memmove(inbox.data(), inbox.data() + inboxBegin, inboxEnd - inboxBegin);
+        inboxEnd -= inboxBegin;
+        inboxBegin = 0;
+    }
+    if (inbox.size() - inboxEnd < RECEIVE_SIZE / 2) {
+        inbox.resize(std::max(2 * inbox.size(), RECEIVE_SIZE));
+    }
+    data = inbox.data() + inboxEnd;
+    length = inbox.size() - inboxEnd;
+}
+
+void NetworkClient::received(size_t n) {
+    if (n == 0) {
+        throw std::runtime_error("Server closed the connection");
+    }
+    if (direct.state == DirectFrame::State::RECEIVING) {
+        direct.received += n;
+        if (direct.received == direct.result.encoded.bytes.size()) {
+            direct.state = DirectFrame::State::READY;
+        }
+        return;
+    }
+    inboxEnd += n;
+}
+
+bool NetworkClient::receive() {
+    while (true) {
+        char* space;
+        size_t length;
+        receiveSpace(space, length);
+        const ssize_t n = read(sockfd, space, length);
+        if (n >= 0) {
+            received(n);
+            return static_cast<size_t>(n) == length;  // Parsed before reading on, so the inbox stays small
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+        throw std::runtime_error("Error reading from socket");
+    }
+}
+
+bool NetworkClient::startDirect(uint64_t length) {
+    const char* frame = inbox.data() + inboxBegin + Protocol::RESPONSE_LENGTH_SIZE;
+    const size_t available = inboxEnd - inboxBegin - Protocol::RESPONSE_LENGTH_SIZE;
+    if (available < sizeof(uint32_t) || !directIds.count(Protocol::responseRequestId(frame, available))) {
+        return false;
+    }
+    const size_t headSize = Protocol::responseHeaderSize(frame, available);
+    if (headSize == 0 || available < headSize) return false;
+
+    direct.head.assign(frame, frame + headSize);
+    const size_t payloadSize = Protocol::parseResponseHeader(frame, headSize, direct.result);
+    if (headSize + payloadSize != length) {
+        throw std::runtime_error("Response frame length does not match its bit count");
+    }
+    directIds.erase(Protocol::responseRequestId(frame, available));
+
+    // Sized once and not cleared; only what has arrived so far is copied
+    Shannon::PackedBytes& payload = direct.result.encoded.bytes;
+    payload.resize(payloadSize);
+    direct.received = available - headSize;
+    std::memcpy(payload.data(), frame + headSize, direct.received);
+    direct.state = DirectFrame::State::RECEIVING;
+    inboxBegin = inboxEnd = 0;
+    return true;
+}
+
+bool NetworkClient::nextFrame(const char*& frame, uint64_t& length) {
+    if (direct.state == DirectFrame::State::READY) {
+        frame = direct.head.data();
+        length = direct.head.size();
+        direct.state = DirectFrame::State::DELIVERED;
+        return true;
+    }
+    if (direct.state != DirectFrame::State::IDLE) return false;
+
+    if (inboxEnd - inboxBegin < Protocol::RESPONSE_LENGTH_SIZE) return false;
+    std::memcpy(&length, inbox.data() + inboxBegin, sizeof(length));
+    if (length > Protocol::MAX_RESPONSE_SIZE) {
+        throw std::runtime_error("Response announces " + std::to_string(length) + " bytes");
+    }
+    if (inboxEnd - inboxBegin - Protocol::RESPONSE_LENGTH_SIZE < length) {
+        if (!directIds.empty() && startDirect(length)) return false;
+
+        // A large frame is read in place, growing at most as fast as it arrives
+        const size_t needed = inboxBegin + Protocol::RESPONSE_LENGTH_SIZE + length;
+        if (inbox.size() < needed) {
+            const size_t arrived = inboxEnd - inboxBegin;
+            inbox.resize(std::min(needed, inboxEnd + std::max(arrived, Protocol::RESERVE_LIMIT)));
+        }
+        return false;
+    }
+    frame = inbox.data() + inboxBegin + Protocol::RESPONSE_LENGTH_SIZE;
+    inboxBegin += Protocol::RESPONSE_LENGTH_SIZE + length;
+    return true;
+}
+
+void NetworkClient::parse(const char* frame, uint64_t length, Batch& batch) {
+    std::vector<Protocol::Result> results(1);
+    if (direct.state == DirectFrame::State::DELIVERED) {
+        results[0] = std::move(direct.result);
+        direct.state = DirectFrame::State::IDLE;
+    } else if (batch.lines.size() == 1) {
+        Protocol::parseResponse(frame, length, results[0]);
+        if (!directIds.empty()) directIds.erase(Protocol::responseRequestId(frame, length));
+    } else {
+        Protocol::parseBatchResponse(frame, length, results);
+        if (results.size() != batch.lines.size()) {
+            throw std::runtime_error("Batch response has the wrong number of results");
+        }
+    }
+
+    for (size_t i = 0; i < batch.lines.size(); ++i) {
+        RequestData& data = batch.lines[i];
+        data.charCodeVec = resolveTable(results[i]);
+        data.staticSymbols = results[i].tag.symbolCount;
+        data.encoded = std::move(results[i].encoded);
+    }
+    --inFlight;
+}
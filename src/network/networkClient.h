@@ -0,0 +1,186 @@
+/**
+ * @file networkClient.h
+ * @brief Persistent pipelined connection to the Shannon server
+ *
+ * Shared by the client and the benchmark's load generator: a connection
+ * queues request frames, sends them without blocking and parses the
+ * responses from one receive buffer. The packed bits of a large single
+ * result skip that buffer: once its header is in, they are read straight
+ * into a buffer of their exact size, which the result then keeps.
+ */
+
+#ifndef NETWORK_CLIENT_H
+#define NETWORK_CLIENT_H
+
+#include <netinet/in.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../codec/shannon.h"
+#include "protocol.h"
+
+/**
+ * @struct RequestData
+ * @brief One line sent to the server and the response it produced
+ */
+struct RequestData {
+    std::string_view line;          ///< Into the batch's storage or the preloaded input
+    Shannon::BitStream encoded;
+    std::string decodedLine;
+    std::vector<Shannon::CharCode> charCodeVec;
+    uint32_t staticSymbols = 0;     ///< Message length, when encoded with a static table
+};
+
+/**
+ * @struct Batch
+ * @brief Consecutive lines sent as one request; a single line goes as ENCODE
+ *
+ * An empty batch marks the end of the output.
+ */
+struct Batch {
+    std::vector<RequestData> lines;
+    size_t bytes = 0;
+    std::vector<char> storage;      ///< Lines read from a stream; moving the batch keeps it in place
+};
+
+/**
+ * @brief Resolves the server address once for every connection
+ * @throws std::runtime_error if the host is unknown
+ */
+sockaddr_in resolveServer(const std::string& hostname, int portno);
+
+/**
+ * @brief Opens a blocking connection to the server
+ * @throws std::runtime_error if the server cannot be reached
+ */
+int connectToServer(const sockaddr_in& serv_addr);
+
+/**
+ * @class NetworkClient
+ * @brief One non-blocking persistent connection carrying pipelined requests
+ */
+class NetworkClient {
+public:
+    static constexpr size_t RECEIVE_SIZE = 64 * 1024;   ///< Bytes requested per read
+    static constexpr size_t DIRECT_RECEIVE_SIZE = 256 * 1024;  ///< Single messages this long are received directly
+    static constexpr int MAX_RETRIES = 3;   ///< Reconnects per server, and attempts per request, before giving up
+
+    size_t inFlight = 0;        ///< Requests sent and not yet answered
+
+    /**
+     * @throws std::runtime_error if the server cannot be reached
+     */
+    explicit NetworkClient(const sockaddr_in& serv_addr);
+    ~NetworkClient();
+
+    NetworkClient(const NetworkClient&) = delete;
+    NetworkClient& operator=(const NetworkClient&) = delete;
+
+    int descriptor() const { return sockfd; }
+
+    /**
+     * @param staticTable Encode with this trained table, or 0 for per-message tables
+     * @param flags Request flags, such as the alphabet hint
+     */
+    void queue(uint32_t requestId, const Batch& batch, uint32_t staticTable, uint16_t flags);
+
+    /**
+     * @brief Queues a request frame built by the caller, such as HISTOGRAM or TRAIN_COUNTS
+     *
+     * Its response comes back through nextFrame() for the caller to parse;
+     * it is not counted in inFlight.
+     */
+    void queueFrame(const std::string& frame) { out += frame; }
+
+    /**
+     * @brief Sends queued frames until the socket would block
+     * @throws std::runtime_error on write failure
+     */
+    void flush();
+
+    /**
+     * @brief Reads what has arrived into the inbox
+     * @return true if the read filled the inbox, so the socket may hold more
+     * @throws std::runtime_error on read failure or if the server hung up
+     */
+    bool receive();
+
+    /**
+     * @brief Moves the queued frames into sending, for callers that submit sends themselves
+     * @return false if nothing is queued
+     */
+    bool takeOutput(std::string& sending);
+
+    /**
+     * @brief Where the next read should go: the inbox, or the payload being received directly
+     *
+     * For callers that submit reads themselves; the space stays valid until
+     * received() or nextFrame() is called.
+     */
+    void receiveSpace(char*& data, size_t& length);
+
+    /**
+     * @brief Accounts for n bytes read into the space from receiveSpace()
+     * @throws std::runtime_error if n is 0, since the server hung up
+     */
+    void received(size_t n);
+
+    /**
+     * @brief Takes the next complete response frame from the inbox
+     *
+     * A directly received frame is given without its packed bits, which
+     * parse() takes from their own buffer.
+     * @return false if no whole frame has arrived; frame stays valid until the next receive()
+     * @throws std::runtime_error on a malformed directly received frame
+     */
+    bool nextFrame(const char*& frame, uint64_t& length);
+
+    /**
+     * @brief Parses a response frame into the lines of the batch it answers
+     * @throws std::runtime_error on malformed responses or unknown table references
+     */
+    void parse(const char* frame, uint64_t length, Batch& batch);
+
+private:
+    int sockfd;
+    std::string out;            ///< Request frames not yet sent
+    size_t outOffset = 0;
+    std::vector<char> inbox;    ///< Received bytes; several responses per read
+    size_t inboxBegin = 0;      ///< First unparsed byte
+    size_t inboxEnd = 0;
+    std::unordered_map<uint32_t, std::vector<Shannon::CharCode>> tables;  ///< Received by id
+
+    /**
+     * @struct DirectFrame
+     * @brief A response whose packed bits are read into result's buffer rather than the inbox
+     */
+    struct DirectFrame {
+        enum class State : uint8_t { IDLE, RECEIVING, READY, DELIVERED };
+        State state = State::IDLE;
+        std::vector<char> head;         ///< The frame up to its packed bits
+        Protocol::Result result;        ///< Parsed from head; encoded.bytes sized to the payload
+        size_t received = 0;            ///< Payload bytes in result so far
+    };
+    DirectFrame direct;
+    std::unordered_set<uint32_t> directIds;    ///< Requests whose responses may be received directly
+
+    /**
+     * @brief Switches to reading the frame at the inbox front directly, once its header is in
+     * @return false if the frame does not qualify yet
+     */
+    bool startDirect(uint64_t length);
+
+    /**
+     * @brief The codes of a result, from this connection's earlier tables for references
+     *
+     * Static results return no codes; the caller holds the static table.
+     */
+    std::vector<Shannon::CharCode> resolveTable(Protocol::Result& result);
+};
+
+#endif // NETWORK_CLIENT_H
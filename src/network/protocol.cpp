@@ -0,0 +1,550 @@
+/**
+ * @file protocol.cpp
+ * @brief Wire format shared by the Shannon encoding client and server
+ */
+
+#include "protocol.h"
+#include "../metrics/metrics.h"
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace Protocol {
+
+namespace {
+    template <typename T>
+    void append(std::string& out, const T& value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    /**
+     * @class Reader
+     * @brief Bounds-checked cursor over a frame held in memory
+     */
+    class Reader {
+    public:
+        Reader(const char* data, size_t length) : cursor(data), end(data + length) {}
+
+        template <typename T>
+        T take() {
+            T value;
+            std::memcpy(&value, bytes(sizeof(value)), sizeof(value));
+            return value;
+        }
+
+        const char* bytes(size_t length) {
+            if (static_cast<size_t>(end - cursor) < length) {
+                throw std::runtime_error("Truncated frame");
+            }
+            const char* data = cursor;
+            cursor += length;
+            return data;
+        }
+
+        size_t remaining() const { return end - cursor; }
+
+    private:
+        const char* cursor;
+        const char* end;
+    };
+
+    size_t symbolsSize(const std::vector<Shannon::CharCode>& table) {
+        return sizeof(uint16_t) + table.size() * (sizeof(uint8_t) + sizeof(uint32_t));
+    }
+
+    void appendSymbols(std::string& out, const std::vector<Shannon::CharCode>& table) {
+        append(out, static_cast<uint16_t>(table.size()));
+        for (const auto& charCode : table) {
+            append(out, static_cast<uint8_t>(charCode.character));
+            append(out, static_cast<uint32_t>(charCode.freq));
+        }
+    }
+
+    /**
+     * @brief Reads symbolCount symbol and frequency pairs
+     *
+     * A count above Shannon::MAX_FREQ would overflow CharCode::freq, so it is rejected.
+     */
+    Shannon::Histogram readCounts(Reader& reader, uint16_t symbolCount) {
+        if (symbolCount > 256) {
+            throw std::runtime_error("Frame lists " + std::to_string(symbolCount) + " symbols");
+        }
+
+        Shannon::Histogram hist{};
+        for (uint16_t i = 0; i < symbolCount; ++i) {
+            const uint8_t symbol = reader.take<uint8_t>();
+            hist[symbol] = reader.take<uint32_t>();
+            if (hist[symbol] > Shannon::MAX_FREQ) {
+                throw std::runtime_error("Frame counts symbol " + std::to_string(symbol) + " " +
+                                         std::to_string(hist[symbol]) + " times");
+            }
+        }
+        return hist;
+    }
+
+    /**
+     * @brief Rebuilds a table from symbolCount symbol and frequency pairs
+     */
+    std::vector<Shannon::CharCode> readSymbols(Reader& reader, uint16_t symbolCount) {
+        return Shannon::buildCodeTable(readCounts(reader, symbolCount));
+    }
+
+    /// Counts of every byte value: uint16_t symbol count, then uint8_t symbol and uint32_t count each
+    constexpr size_t MAX_COUNTS_SIZE = sizeof(uint16_t) + 256 * (sizeof(uint8_t) + sizeof(uint32_t));
+
+    uint16_t countedSymbols(const Shannon::Histogram& hist) {
+        return static_cast<uint16_t>(256 - std::count(hist.begin(), hist.end(), 0u));
+    }
+
+    size_t countsSize(const Shannon::Histogram& hist) {
+        return sizeof(uint16_t) + countedSymbols(hist) * (sizeof(uint8_t) + sizeof(uint32_t));
+    }
+
+    /**
+     * @brief Appends the counted symbols of hist as symbol and frequency pairs
+     */
+    void appendCounts(std::string& out, const Shannon::Histogram& hist) {
+        append(out, countedSymbols(hist));
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            if (hist[symbol] == 0) continue;
+            append(out, static_cast<uint8_t>(symbol));
+            append(out, hist[symbol]);
+        }
+    }
+
+    size_t tableSize(const Shannon::EncodedMsg& msg, const TableTag& tag) {
+        size_t size = sizeof(uint32_t) + sizeof(uint64_t);
+        switch (tag.kind) {
+            case TableKind::FULL: size += symbolsSize(msg.charCodeVec); break;
+            case TableKind::REFERENCE: size += sizeof(uint16_t); break;
+            case TableKind::STATIC: size += sizeof(uint16_t) + sizeof(uint32_t); break;
+        }
+        return size;
+    }
+
+    /**
+     * @brief Appends a result's table, or how to find it, and bit count, but not its packed bits
+     */
+    void appendTable(std::string& out, const Shannon::EncodedMsg& msg, const TableTag& tag) {
+        append(out, tag.id);
+        switch (tag.kind) {
+            case TableKind::FULL:
+                appendSymbols(out, msg.charCodeVec);
+                break;
+            case TableKind::REFERENCE:
+                append(out, TABLE_REFERENCE);
+                break;
+            case TableKind::STATIC:
+                append(out, TABLE_STATIC);
+                append(out, tag.symbolCount);
+                break;
+        }
+        append(out, static_cast<uint64_t>(msg.encoded.bitCount));
+    }
+
+    void appendPayload(std::string& out, const Shannon::EncodedMsg& msg) {
+        out.append(reinterpret_cast<const char*>(msg.encoded.bytes.data()), msg.encoded.bytes.size());
+    }
+
+    /**
+     * @brief Reads a result up to its packed bits
+     * @return The size of the packed bits that follow
+     */
+    size_t readResultHeader(Reader& reader, Result& result) {
+        result.tag.id = reader.take<uint32_t>();
+        const uint16_t symbolCount = reader.take<uint16_t>();
+        result.table.clear();
+        result.tag.symbolCount = 0;
+
+        if (symbolCount == TABLE_REFERENCE || symbolCount == TABLE_STATIC) {
+            if (result.tag.id == 0) {
+                throw std::runtime_error("Result names no table");
+            }
+            if (symbolCount == TABLE_REFERENCE) {
+                result.tag.kind = TableKind::REFERENCE;
+            } else {
+                result.tag.kind = TableKind::STATIC;
+                result.tag.symbolCount = reader.take<uint32_t>();
+            }
+        } else {
+            result.tag.kind = TableKind::FULL;
+            result.table = readSymbols(reader, symbolCount);
+        }
+
+        // Bounded before packedSize, which would wrap, sizes any buffer
+        result.encoded.bitCount = reader.take<uint64_t>();
+        if (result.encoded.bitCount > 8 * MAX_RESPONSE_SIZE) {
+            throw std::runtime_error("Result announces " + std::to_string(result.encoded.bitCount) + " bits");
+        }
+        return Shannon::packedSize(result.encoded.bitCount);
+    }
+
+    void readResult(Reader& reader, Result& result) {
+        const size_t payload = readResultHeader(reader, result);
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(reader.bytes(payload));
+        result.encoded.bytes.assign(bytes, bytes + payload);
+    }
+}
+
+Shannon::Alphabet alphabetOf(uint16_t flags) {
+    return static_cast<Shannon::Alphabet>((flags & FLAG_ALPHABET_MASK) >> FLAG_ALPHABET_SHIFT);
+}
+
+uint16_t alphabetFlags(Shannon::Alphabet alphabet) {
+    return static_cast<uint16_t>(static_cast<uint16_t>(alphabet) << FLAG_ALPHABET_SHIFT);
+}
+
+std::string serializeRequestHeader(uint32_t requestId, size_t length, RequestType type, uint16_t flags) {
+    if (length > MAX_MESSAGE_SIZE) {
+        throw std::invalid_argument("Message exceeds " + std::to_string(MAX_MESSAGE_SIZE) + " bytes");
+    }
+
+    std::string header;
+    header.reserve(REQUEST_HEADER_SIZE);
+    append(header, requestId);
+    append(header, static_cast<uint16_t>(type));
+    append(header, flags);
+    append(header, static_cast<uint32_t>(length));
+    return header;
+}
+
+RequestHeader parseRequestHeader(const char* bytes) {
+    Reader reader(bytes, REQUEST_HEADER_SIZE);
+    RequestHeader header;
+    header.requestId = reader.take<uint32_t>();
+    const uint16_t type = reader.take<uint16_t>();
+    header.flags = reader.take<uint16_t>();
+    header.length = reader.take<uint32_t>();
+
+    if (type > static_cast<uint16_t>(RequestType::TRAIN_COUNTS)) {
+        throw std::runtime_error("Unknown request type " + std::to_string(type));
+    }
+    header.type = static_cast<RequestType>(type);
+    if (header.length > MAX_MESSAGE_SIZE) {
+        throw std::runtime_error("Request announces " + std::to_string(header.length) + " bytes");
+    }
+
+    // Bodies read whole have a known size, so a header cannot make the receiver wait for more
+    bool fits = true;
+    switch (header.type) {
+        case RequestType::STATS:
+            fits = header.length == 0;
+            break;
+        case RequestType::TABLE:
+            fits = header.length == TABLE_ID_SIZE;
+            break;
+        case RequestType::ENCODE_STATIC:
+        case RequestType::BATCH_STATIC:
+            fits = header.length >= TABLE_ID_SIZE;
+            break;
+        case RequestType::TRAIN_COUNTS:
+            fits = header.length <= MAX_COUNTS_SIZE;
+            break;
+        default:
+            break;
+    }
+    if (!fits) {
+        throw std::runtime_error("Request type " + std::to_string(type) + " cannot have " +
+                                 std::to_string(header.length) + " body bytes");
+    }
+    return header;
+}
+
+std::string serializeStaticRequestHeader(uint32_t requestId, uint32_t tableId, size_t length) {
+    std::string header = serializeRequestHeader(requestId, TABLE_ID_SIZE + length, RequestType::ENCODE_STATIC);
+    append(header, tableId);
+    return header;
+}
+
+std::string serializeBatchRequest(uint32_t requestId, const std::vector<std::string_view>& messages,
+                                  uint16_t flags, uint32_t staticTable) {
+    size_t length = sizeof(uint32_t) + (staticTable != 0 ? TABLE_ID_SIZE : 0);
+    for (std::string_view message : messages) {
+        length += sizeof(uint32_t) + message.size();
+    }
+
+    const RequestType type = (staticTable != 0) ? RequestType::BATCH_STATIC : RequestType::BATCH;
+    std::string frame = serializeRequestHeader(requestId, length, type, flags);
+    frame.reserve(REQUEST_HEADER_SIZE + length);
+    if (staticTable != 0) {
+        append(frame, staticTable);
+    }
+    append(frame, static_cast<uint32_t>(messages.size()));
+    for (std::string_view message : messages) {
+        append(frame, static_cast<uint32_t>(message.size()));
+        frame.append(message.data(), message.size());
+    }
+    return frame;
+}
+
+std::vector<std::string> parseBatchRequest(const char* body, size_t length) {
+    Reader reader(body, length);
+    const uint32_t count = reader.take<uint32_t>();
+    if (count > reader.remaining() / sizeof(uint32_t)) {
+        throw std::runtime_error("Batch announces " + std::to_string(count) + " messages");
+    }
+
+    std::vector<std::string> messages;
+    messages.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint32_t messageLength = reader.take<uint32_t>();
+        messages.emplace_back(reader.bytes(messageLength), messageLength);
+    }
+    if (reader.remaining() != 0) {
+        throw std::runtime_error("Trailing bytes after batch");
+    }
+    return messages;
+}
+
+uint32_t parseTableId(const char* body, size_t length) {
+    return Reader(body, length).take<uint32_t>();
+}
+
+std::string serializeResponseHeader(uint32_t requestId, const Shannon::EncodedMsg& msg,
+                                    const TableTag& tag) {
+    const uint64_t frameLength = sizeof(requestId) + tableSize(msg, tag) + msg.encoded.bytes.size();
+
+    std::string out;
+    out.reserve(RESPONSE_LENGTH_SIZE + sizeof(requestId) + tableSize(msg, tag));
+    append(out, frameLength);
+    append(out, requestId);
+    appendTable(out, msg, tag);
+    return out;
+}
+
+std::string serializeResponse(uint32_t requestId, const Shannon::EncodedMsg& msg,
+                              const TableTag& tag) {
+    std::string out = serializeResponseHeader(requestId, msg, tag);
+    appendPayload(out, msg);
+    return out;
+}
+
+std::string serializeBatchResponse(uint32_t requestId, const std::vector<Shannon::EncodedMsg>& msgs,
+                                   const std::vector<TableTag>& tags) {
+    if (!tags.empty() && tags.size() != msgs.size()) {
+        throw std::invalid_argument("Batch response needs one table tag per message");
+    }
+    const TableTag untagged;
+    auto tagOf = [&](size_t i) -> const TableTag& { return tags.empty() ? untagged : tags[i]; };
+
+    uint64_t frameLength = sizeof(requestId) + sizeof(uint32_t);
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        frameLength += tableSize(msgs[i], tagOf(i)) + msgs[i].encoded.bytes.size();
+    }
+
+    std::string out;
+    out.reserve(RESPONSE_LENGTH_SIZE + frameLength);
+    append(out, frameLength);
+    append(out, requestId);
+    append(out, static_cast<uint32_t>(msgs.size()));
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        appendTable(out, msgs[i], tagOf(i));
+        appendPayload(out, msgs[i]);
+    }
+    return out;
+}
+
+std::string serializeTableResponse(uint32_t requestId, uint32_t tableId,
+                                   const std::vector<Shannon::CharCode>& table) {
+    const uint64_t frameLength = sizeof(requestId) + sizeof(tableId) + symbolsSize(table);
+
+    std::string out;
+    out.reserve(RESPONSE_LENGTH_SIZE + frameLength);
+    append(out, frameLength);
+    append(out, requestId);
+    append(out, tableId);
+    appendSymbols(out, table);
+    return out;
+}
+
+uint32_t parseTableResponse(const char* frame, size_t length, std::vector<Shannon::CharCode>& table) {
+    Reader reader(frame, length);
+    reader.take<uint32_t>();
+    const uint32_t tableId = reader.take<uint32_t>();
+    table = readSymbols(reader, reader.take<uint16_t>());
+    if (reader.remaining() != 0) {
+        throw std::runtime_error("Trailing bytes after table");
+    }
+    return tableId;
+}
+
+std::string serializeStatsResponse(uint32_t requestId, const std::string& stats) {
+    const uint64_t frameLength = sizeof(requestId) + stats.size();
+
+    std::string out;
+    out.reserve(RESPONSE_LENGTH_SIZE + frameLength);
+    append(out, frameLength);
+    append(out, requestId);
+    out += stats;
+    return out;
+}
+
+std::string parseStatsResponse(const char* frame, size_t length) {
+    Reader reader(frame, length);
+    reader.take<uint32_t>();
+    const size_t textLength = reader.remaining();
+    return std::string(reader.bytes(textLength), textLength);
+}
+
+std::string serializeCountsRequest(uint32_t requestId, const Shannon::Histogram& hist) {
+    std::string out = serializeRequestHeader(requestId, countsSize(hist), RequestType::TRAIN_COUNTS);
+    appendCounts(out, hist);
+    return out;
+}
+
+Shannon::Histogram parseCounts(const char* body, size_t length) {
+    Reader reader(body, length);
+    const Shannon::Histogram hist = readCounts(reader, reader.take<uint16_t>());
+    if (reader.remaining() != 0) {
+        throw std::runtime_error("Trailing bytes after counts");
+    }
+    return hist;
+}
+
+std::string serializeHistogramResponse(uint32_t requestId, const Shannon::Histogram& hist) {
+    const uint64_t frameLength = sizeof(requestId) + countsSize(hist);
+
+    std::string out;
+    out.reserve(RESPONSE_LENGTH_SIZE + frameLength);
+    append(out, frameLength);
+    append(out, requestId);
+    appendCounts(out, hist);
+    return out;
+}
+
+Shannon::Histogram parseHistogramResponse(const char* frame, size_t length) {
+    Reader reader(frame, length);
+    reader.take<uint32_t>();
+    const size_t countsLength = reader.remaining();
+    return parseCounts(reader.bytes(countsLength), countsLength);
+}
+
+uint32_t responseRequestId(const char* frame, size_t length) {
+    return Reader(frame, length).take<uint32_t>();
+}
+
+void parseResponse(const char* frame, size_t length, Result& result) {
+    Reader reader(frame, length);
+    reader.take<uint32_t>();
+    readResult(reader, result);
+    if (reader.remaining() != 0) {
+        throw std::runtime_error("Trailing bytes after response");
+    }
+}
+
+size_t responseHeaderSize(const char* frame, size_t available) {
+    constexpr size_t SYMBOL_COUNT_END = 2 * sizeof(uint32_t) + sizeof(uint16_t);
+    if (available < SYMBOL_COUNT_END) return 0;
+
+    uint16_t symbolCount;
+    std::memcpy(&symbolCount, frame + 2 * sizeof(uint32_t), sizeof(symbolCount));
+    size_t size = SYMBOL_COUNT_END + sizeof(uint64_t);
+    if (symbolCount == TABLE_STATIC) {
+        size += sizeof(uint32_t);
+    } else if (symbolCount != TABLE_REFERENCE) {
+        size += symbolCount * (sizeof(uint8_t) + sizeof(uint32_t));
+    }
+    return size;
+}
+
+size_t parseResponseHeader(const char* frame, size_t length, Result& result) {
+    Reader reader(frame, length);
+    reader.take<uint32_t>();
+    const size_t payload = readResultHeader(reader, result);
+    if (reader.remaining() != 0) {
+        throw std::runtime_error("Trailing bytes after response header");
+    }
+    return payload;
+}
+
+void parseBatchResponse(const char* frame, size_t length, std::vector<Result>& results) {
+    Reader reader(frame, length);
+    reader.take<uint32_t>();
+    const uint32_t count = reader.take<uint32_t>();
+    if (count > reader.remaining()) {
+        throw std::runtime_error("Batch response announces " + std::to_string(count) + " results");
+    }
+
+    results.resize(count);
+    for (Result& result : results) {
+        readResult(reader, result);
+    }
+    if (reader.remaining() != 0) {
+        throw std::runtime_error("Trailing bytes after batch response");
+    }
+}
+
+void writeAll(int fd, const void* data, size_t length) {
+    Metrics::StageTimer timer(Metrics::Stage::SEND);
+    Metrics::add(Metrics::Counter::BYTES_OUT, length);
+    const char* bytes = static_cast<const char*>(data);
+    while (length > 0) {
+        const ssize_t n = send(fd, bytes, length, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Error writing to socket");
+        }
+        bytes += n;
+        length -= n;
+    }
+}
+
+void writeAll(int fd, const std::string& head, const void* body, size_t bodyLength) {
+    Metrics::StageTimer timer(Metrics::Stage::SEND);
+    Metrics::add(Metrics::Counter::BYTES_OUT, head.size() + bodyLength);
+    iovec iov[2] = {
+        {const_cast<char*>(head.data()), head.size()},
+        {const_cast<void*>(body), bodyLength},
+    };
+    iovec* next = iov;
+    int remaining = 2;
+
+    while (remaining > 0) {
+        msghdr message{};
+        message.msg_iov = next;
+        message.msg_iovlen = remaining;
+        ssize_t n = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Error writing to socket");
+        }
+
+        // Skip what went out, possibly ending inside the first buffer
+        while (remaining > 0 && static_cast<size_t>(n) >= next->iov_len) {
+            n -= next->iov_len;
+            ++next;
+            --remaining;
+        }
+        if (remaining > 0) {
+            next->iov_base = static_cast<char*>(next->iov_base) + n;
+            next->iov_len -= n;
+        }
+    }
+}
+
+bool readAll(int fd, void* data, size_t length) {
+    char* bytes = static_cast<char*>(data);
+    size_t received = 0;
+    while (received < length) {
+        const ssize_t n = read(fd, bytes + received, length - received);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Error reading from socket");
+        }
+        if (n == 0) {
+            if (received == 0) return false;
+            throw std::runtime_error("Connection closed mid-frame");
+        }
+        received += n;
+    }
+    Metrics::add(Metrics::Counter::BYTES_IN, length);
+    return true;
+}
+
+} // namespace Protocol
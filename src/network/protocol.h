@@ -0,0 +1,293 @@
+/**
+ * @file protocol.h
+ * @brief Wire format shared by the Shannon encoding client and server
+ *
+ * Connections are persistent: a client sends any number of length-prefixed
+ * request frames on one connection without waiting, and the server answers each with a
+ * response frame carrying the same request id. Responses may come back in a
+ * different order than the requests; the id matches them up.
+ */
+
+#ifndef SHANNON_PROTOCOL_H
+#define SHANNON_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../codec/shannon.h"
+#include "../codec/fixedAlphabet.h"
+
+namespace Protocol {
+
+/// Largest message a request may carry; symbol counts must fit an int
+constexpr uint32_t MAX_MESSAGE_SIZE = uint32_t(1) << 30;
+
+/// Most body bytes a receiver sets aside before they arrive; longer bodies grow as they come in
+constexpr size_t RESERVE_LIMIT = size_t(1) << 20;
+
+/**
+ * @enum RequestType
+ * @brief What the body of a request frame holds
+ */
+enum class RequestType : uint16_t {
+    ENCODE = 0,         ///< One message; answered with one result
+    BATCH = 1,          ///< uint32_t count, then per message uint32_t length and bytes
+    TRAIN = 2,          ///< A corpus; answered with the static table built from it
+    TABLE = 3,          ///< uint32_t static table id; answered with that table
+    ENCODE_STATIC = 4,  ///< uint32_t static table id, then one message
+    BATCH_STATIC = 5,   ///< uint32_t static table id, then a BATCH body
+    STATS = 6,          ///< Empty; answered with the server's metrics as JSON
+    HISTOGRAM = 7,      ///< One message; answered with its symbol counts
+    TRAIN_COUNTS = 8,   ///< Symbol counts; answered like TRAIN with the static table built from them
+};
+
+/// Request flag: the client keeps tables by id, so repeats may be sent as references
+constexpr uint16_t FLAG_TABLE_IDS = 1;
+
+/// Request flag bits 1-2: the Shannon::Alphabet the messages are expected to use
+constexpr uint16_t FLAG_ALPHABET_SHIFT = 1;
+constexpr uint16_t FLAG_ALPHABET_MASK = 0x3 << FLAG_ALPHABET_SHIFT;
+
+/**
+ * @brief The alphabet hint carried by request flags; ANY if none
+ */
+Shannon::Alphabet alphabetOf(uint16_t flags);
+
+/**
+ * @brief Request flags carrying alphabet as the hint
+ */
+uint16_t alphabetFlags(Shannon::Alphabet alphabet);
+
+/**
+ * @struct RequestHeader
+ * @brief Start of a request frame; length body bytes follow it
+ */
+struct RequestHeader {
+    uint32_t requestId;
+    RequestType type;
+    uint16_t flags;
+    uint32_t length;
+};
+
+/// Request header on the wire: uint32_t request id, uint16_t type, uint16_t flags, uint32_t body length
+constexpr size_t REQUEST_HEADER_SIZE = 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t);
+
+/**
+ * @brief Builds the header of a request frame with a body of length bytes
+ * @throws std::invalid_argument if length exceeds MAX_MESSAGE_SIZE
+ */
+std::string serializeRequestHeader(uint32_t requestId, size_t length,
+                                   RequestType type = RequestType::ENCODE, uint16_t flags = 0);
+
+/**
+ * @brief Reads a REQUEST_HEADER_SIZE header
+ * @throws std::runtime_error on an unknown type, a length over MAX_MESSAGE_SIZE,
+ *         or a length the type's fixed-size body cannot have
+ */
+RequestHeader parseRequestHeader(const char* bytes);
+
+/**
+ * @brief Builds the header and table id of an ENCODE_STATIC frame; the message follows
+ * @throws std::invalid_argument if the body would exceed MAX_MESSAGE_SIZE
+ */
+std::string serializeStaticRequestHeader(uint32_t requestId, uint32_t tableId, size_t length);
+
+/**
+ * @brief Builds a whole BATCH request frame, or BATCH_STATIC if staticTable is not 0
+ * @throws std::invalid_argument if the body would exceed MAX_MESSAGE_SIZE
+ */
+std::string serializeBatchRequest(uint32_t requestId, const std::vector<std::string_view>& messages,
+                                  uint16_t flags = 0, uint32_t staticTable = 0);
+
+/// Static table id at the start of TABLE, ENCODE_STATIC and BATCH_STATIC bodies
+constexpr size_t TABLE_ID_SIZE = sizeof(uint32_t);
+
+/**
+ * @brief Reads the static table id at the start of a body
+ * @throws std::runtime_error if the body is too short
+ */
+uint32_t parseTableId(const char* body, size_t length);
+
+/**
+ * @brief Splits the body of a BATCH request into its messages
+ * @throws std::runtime_error if the body is malformed
+ */
+std::vector<std::string> parseBatchRequest(const char* body, size_t length);
+
+/// Response frames start with a uint64_t count of the bytes that follow it
+constexpr size_t RESPONSE_LENGTH_SIZE = sizeof(uint64_t);
+
+/// Longest response frame a client accepts; a batch of tiny messages answers with about six times its size
+constexpr uint64_t MAX_RESPONSE_SIZE = uint64_t(8) * MAX_MESSAGE_SIZE;
+
+/// Symbol count of a result whose table was sent earlier on the same connection
+constexpr uint16_t TABLE_REFERENCE = 0xFFFF;
+
+/// Symbol count of a result encoded with a static table; uint32_t message length follows
+constexpr uint16_t TABLE_STATIC = 0xFFFE;
+
+/**
+ * @enum TableKind
+ * @brief How a result carries its table
+ */
+enum class TableKind : uint8_t {
+    FULL,           ///< Symbols and frequencies follow
+    REFERENCE,      ///< Sent in full earlier on the same connection
+    STATIC,         ///< A trained table the client fetches once by id
+};
+
+/**
+ * @struct TableTag
+ * @brief How a result identifies its table
+ */
+struct TableTag {
+    uint32_t id = 0;            ///< Table id; 0 for tables the server does not cache
+    TableKind kind = TableKind::FULL;
+    uint32_t symbolCount = 0;   ///< Message length; STATIC only, since the table does not give it
+};
+
+/**
+ * @struct Result
+ * @brief One encoded message as received by a client
+ */
+struct Result {
+    TableTag tag;
+    std::vector<Shannon::CharCode> table;   ///< Codes rebuilt from the sent frequencies; FULL only
+    Shannon::BitStream encoded;
+};
+
+/**
+ * @brief Serializes everything of an ENCODE response frame except the packed bits
+ *
+ * Layout after the frame length: uint32_t request id, then the result:
+ * uint32_t table id; uint16_t symbol count, TABLE_REFERENCE, or TABLE_STATIC
+ * and a uint32_t message length; per symbol uint8_t symbol and uint32_t
+ * frequency; uint64_t bit count; the packed bits.
+ * Shannon codes are a pure function of the frequencies, so the receiver
+ * rebuilds the codes instead of reading them.
+ */
+std::string serializeResponseHeader(uint32_t requestId, const Shannon::EncodedMsg& msg,
+                                    const TableTag& tag = TableTag());
+
+/**
+ * @brief serializeResponseHeader followed by the packed bits, in one buffer
+ */
+std::string serializeResponse(uint32_t requestId, const Shannon::EncodedMsg& msg,
+                              const TableTag& tag = TableTag());
+
+/**
+ * @brief Serializes a BATCH response: request id, uint32_t count, then the results in order
+ * @param tags One per message, or empty to send every table in full
+ */
+std::string serializeBatchResponse(uint32_t requestId, const std::vector<Shannon::EncodedMsg>& msgs,
+                                   const std::vector<TableTag>& tags = {});
+
+/**
+ * @brief Serializes a TRAIN or TABLE response: request id, table id, then the table
+ */
+std::string serializeTableResponse(uint32_t requestId, uint32_t tableId,
+                                   const std::vector<Shannon::CharCode>& table);
+
+/**
+ * @brief Parses a TRAIN or TABLE response frame, without its length field
+ * @param table Receives the codes rebuilt from the sent frequencies
+ * @return The static table id
+ * @throws std::runtime_error if the frame is malformed
+ */
+uint32_t parseTableResponse(const char* frame, size_t length, std::vector<Shannon::CharCode>& table);
+
+/**
+ * @brief Serializes a STATS response: request id, then the metrics JSON text
+ */
+std::string serializeStatsResponse(uint32_t requestId, const std::string& stats);
+
+/**
+ * @brief Parses a STATS response frame, without its length field
+ * @return The metrics JSON text
+ * @throws std::runtime_error if the frame is too short
+ */
+std::string parseStatsResponse(const char* frame, size_t length);
+
+/**
+ * @brief Builds a whole TRAIN_COUNTS request frame
+ *
+ * Counts are sent as uint16_t count of symbols, then per counted symbol
+ * uint8_t symbol and uint32_t count, both here and in HISTOGRAM responses.
+ */
+std::string serializeCountsRequest(uint32_t requestId, const Shannon::Histogram& hist);
+
+/**
+ * @brief Reads the counts of a TRAIN_COUNTS body
+ * @throws std::runtime_error if the body is malformed
+ */
+Shannon::Histogram parseCounts(const char* body, size_t length);
+
+/**
+ * @brief Serializes a HISTOGRAM response: request id, then the counts
+ */
+std::string serializeHistogramResponse(uint32_t requestId, const Shannon::Histogram& hist);
+
+/**
+ * @brief Parses a HISTOGRAM response frame, without its length field
+ * @throws std::runtime_error if the frame is malformed
+ */
+Shannon::Histogram parseHistogramResponse(const char* frame, size_t length);
+
+/**
+ * @brief Reads the request id of a response frame given without its length field
+ * @throws std::runtime_error if the frame is too short
+ */
+uint32_t responseRequestId(const char* frame, size_t length);
+
+/**
+ * @brief Parses an ENCODE response frame, without its length field, from memory
+ * @throws std::runtime_error if the frame is malformed
+ */
+void parseResponse(const char* frame, size_t length, Result& result);
+
+/**
+ * @brief Size of the part of an ENCODE response frame before its packed bits
+ * @param available Frame bytes at hand, without the length field
+ * @return 0 until available reaches the symbol count
+ */
+size_t responseHeaderSize(const char* frame, size_t available);
+
+/**
+ * @brief Parses the first responseHeaderSize() bytes of an ENCODE response frame
+ * @param result Receives everything but encoded.bytes
+ * @return The size of the packed bits that follow
+ * @throws std::runtime_error if the header is malformed
+ */
+size_t parseResponseHeader(const char* frame, size_t length, Result& result);
+
+/**
+ * @brief Parses a BATCH response frame, without its length field, from memory
+ * @throws std::runtime_error if the frame is malformed
+ */
+void parseBatchResponse(const char* frame, size_t length, std::vector<Result>& results);
+
+/**
+ * @brief Writes all of data to a blocking socket
+ * @throws std::runtime_error on write failure
+ */
+void writeAll(int fd, const void* data, size_t length);
+
+/**
+ * @brief Writes head and then body to a blocking socket in one vectored write
+ * @throws std::runtime_error on write failure
+ */
+void writeAll(int fd, const std::string& head, const void* body, size_t bodyLength);
+
+/**
+ * @brief Reads exactly length bytes from a blocking socket
+ * @return false if the peer closed the connection before the first byte
+ * @throws std::runtime_error on read failure or a connection closed mid-frame
+ */
+bool readAll(int fd, void* data, size_t length);
+
+} // namespace Protocol
+
+#endif // SHANNON_PROTOCOL_H
@@ -4,8 +4,11 @@
  * 
  * This server demonstrates:
  * - Socket programming
- * - Concurrent client handling through forking
+ * - Concurrent client handling through forking, or through event loops
+ *   on epoll with --epoll or on io_uring with --uring (see eventServer.h)
  * - Shannon encoding algorithm
+ * - Counters and stage latency histograms with --metrics, reported by a STATS request
+ * - MSG_ZEROCOPY sends of large encoded payloads, whose buffers are reused once sent
  * - Resource management and cleanup
  */
 
@@ -18,111 +21,28 @@
 #include <signal.h>
 #include <vector>
 #include <string>
-#include <map>
-#include <algorithm>
-#include <cmath>
 #include <sys/wait.h>
 #include <stdexcept>
+#include <algorithm>
+#include <memory>
+#include <filesystem>
+#include <cerrno>
+#include <cstdlib>
+
+#include "../codec/shannon.h"
+#include "../threading/threadPool.h"
+#include "../metrics/metrics.h"
+#include "eventServer.h"
+#include "protocol.h"
+#include "staticTables.h"
+#include "tableCache.h"
+#include "zeroCopy.h"
 
 // Constants for server configuration
 namespace ServerConfig {
-    constexpr int MAX_CONNECTIONS = 5;
-    constexpr int BUFFER_SIZE = 32;
-}
-
-/**
- * @struct CharCode
- * @brief Character encoding information
- */
-struct CharCode {
-    char character;
-    int freq;
-    std::string code;
-};
-
-/**
- * @struct EncodedMsg
- * @brief Message encoding container
- */
-struct EncodedMsg {
-    std::string line;
-    std::vector<CharCode> charCodeVec;
-    std::string encodedLine;
-};
-
-/**
- * @brief Compare function for sorting CharCodes
- */
-bool compareFreqChar(const CharCode& a, const CharCode& b) {
-    if (a.freq != b.freq)
-        return a.freq > b.freq;
-    return a.character > b.character;
-}
-
-/**
- * @brief Convert decimal to binary with specified precision
- */
-std::string decimalToBinary(float decimal, int precision) {
-    if (precision < 0) throw std::invalid_argument("Negative precision");
-    
-    std::string binary;
-    binary.reserve(precision);
-    
-    while (decimal > 0 && precision > 0) {
-        double temp = decimal * 2;
-        binary += (temp >= 1) ? '1' : '0';
-        decimal = (temp >= 1) ? (temp - 1) : temp;
-        --precision;
-    }
-    
-    binary.append(precision, '0');
-    return binary;
-}
-
-/**
- * @brief Shannon encoding implementation
- */
-void shannonCode(EncodedMsg& msg) {
-    try {
-        int lineSize = msg.line.length();
-        std::map<char, int> charCountMap;
-        
-        // Count frequencies
-        for (char c : msg.line) {
-            ++charCountMap[c];
-        }
-        
-        // Prepare character codes
-        msg.charCodeVec.reserve(charCountMap.size());
-        for (const auto& [character, freq] : charCountMap) {
-            msg.charCodeVec.push_back({character, freq, ""});
-        }
-        
-        std::sort(msg.charCodeVec.begin(), msg.charCodeVec.end(), compareFreqChar);
-        
-        // Calculate Shannon codes
-        float cumulativeProbability = 0;
-        std::map<char, std::string> charCodeMap;
-        
-        for (auto& charCode : msg.charCodeVec) {
-            float probability = static_cast<float>(charCode.freq) / lineSize;
-            int precision = std::ceil(std::log2(1.0f/probability));
-            
-            charCode.code = decimalToBinary(cumulativeProbability, precision);
-            charCodeMap[charCode.character] = charCode.code;
-            cumulativeProbability += probability;
-        }
-        
-        // Generate encoded message
-        msg.encodedLine.reserve(lineSize * 8);
-        for (char c : msg.line) {
-            msg.encodedLine += charCodeMap[c];
-        }
-        
-    } catch (const std::exception& e) {
-        std::cerr << "Error in Shannon encoding: " << e.what() << std::endl;
-        throw;
-    }
+    constexpr int MAX_CONNECTIONS = SOMAXCONN;   // Listen backlog
+    constexpr size_t BUFFER_SIZE = 64 * 1024;     // Message bytes read per call
+    constexpr size_t TABLE_CACHE_SIZE = 4096;     // Code tables kept per process
 }
 
 /**
@@ -132,6 +52,13 @@ void fireman(int) {
     while (waitpid(-1, NULL, WNOHANG) > 0);
 }
 
+/// Set by SIGINT or SIGTERM; the accept loop returns so main can clean up
+volatile sig_atomic_t stopping = 0;
+
+void stopServer(int) {
+    stopping = 1;
+}
+
 /**
  * @class Server
  * @brief Encapsulates server functionality
@@ -142,6 +69,17 @@ private:
     int portno;
     sockaddr_in serv_addr;
     
+    // Each forked child starts with its own empty copies
+    TableCache tableCache{ServerConfig::TABLE_CACHE_SIZE};
+    KnownTables knownTables;
+    
+    // Shared through a directory, so a table trained on one connection serves all of them
+    StaticTables staticTables;
+    
+    // The child's connection: zero-copy sends and the payload buffers they give back
+    std::unique_ptr<ZeroCopySender> zeroCopy;
+    PayloadPool payloads;
+    
     void setupSocket() {
         sockfd = socket(AF_INET, SOCK_STREAM, 0);
         if (sockfd < 0) {
@@ -158,38 +96,257 @@ private:
         }
     }
     
-    void handleClient(int newsockfd) {
-        char message[ServerConfig::BUFFER_SIZE];
-        int n = read(newsockfd, message, sizeof(message));
-        if (n < 0) throw std::runtime_error("Error reading from socket");
-        
-        EncodedMsg msg;
-        msg.line = message;
-        shannonCode(msg);
-        
-        // Send character vector size
-        int charCodeVecSize = msg.charCodeVec.size();
-        n = write(newsockfd, &charCodeVecSize, sizeof(int));
-        if (n < 0) throw std::runtime_error("Error writing to socket");
-        
-        // Send character data
-        for (const auto& charCode : msg.charCodeVec) {
-            write(newsockfd, &charCode.character, sizeof(char));
-            write(newsockfd, &charCode.freq, sizeof(int));
-            
-            int codeLength = charCode.code.size();
-            write(newsockfd, &codeLength, sizeof(int));
-            write(newsockfd, charCode.code.c_str(), codeLength);
+    /**
+     * @brief Encodes one message, counting it as it streams in
+     *
+     * Only the code table and the encoding are left once the last byte
+     * arrives.
+     */
+    void handleEncode(int newsockfd, const Protocol::RequestHeader& request, std::vector<char>& buffer) {
+        Metrics::add(Metrics::Counter::MESSAGES);
+        Shannon::StreamEncoder body;
+        body.reserve(std::min<size_t>(request.length, Protocol::RESERVE_LIMIT));
+        size_t remaining = request.length;
+        while (remaining > 0) {
+            const size_t chunk = std::min(remaining, buffer.size());
+            if (!Protocol::readAll(newsockfd, buffer.data(), chunk)) {
+                throw std::runtime_error("Connection closed mid-frame");
+            }
+            body.append(buffer.data(), chunk);
+            remaining -= chunk;
+        }
+        
+        Shannon::EncodedMsg msg;
+        msg.encoded.bytes = payloads.take();
+        Protocol::TableTag tag;
+        if (request.length <= TableCache::MAX_MESSAGE_SIZE) {
+            const Shannon::Histogram hist = body.take(msg.line);
+            tag = knownTables.tag(tableCache.encode(msg, hist, Protocol::alphabetOf(request.flags)),
+                                  request.flags & Protocol::FLAG_TABLE_IDS);
+        } else if (request.length >= Shannon::PARALLEL_THRESHOLD) {
+            body.finish(msg, Shannon::threadParallelFor(ThreadPool::defaultThreadCount()));
+        } else {
+            body.finish(msg);
         }
         
-        // Send encoded message
-        int encodedSize = msg.encodedLine.size();
-        write(newsockfd, &encodedSize, sizeof(int));
-        write(newsockfd, msg.encodedLine.c_str(), encodedSize);
+        sendEncoded(newsockfd, Protocol::serializeResponseHeader(request.requestId, msg, tag), msg);
+    }
+    
+    /**
+     * @brief Sends a response header and the packed bits it announces
+     *
+     * Small payloads go with the header in one vectored write; large ones
+     * are sent zero-copy from their own pages.
+     */
+    void sendEncoded(int newsockfd, const std::string& header, Shannon::EncodedMsg& msg) {
+        if (!zeroCopy->accepts(msg.encoded.bytes.size())) {
+            Protocol::writeAll(newsockfd, header, msg.encoded.bytes.data(), msg.encoded.bytes.size());
+            payloads.give(std::move(msg.encoded.bytes));
+            return;
+        }
+        Protocol::writeAll(newsockfd, header.data(), header.size());
+        zeroCopy->sendAll(std::move(msg.encoded.bytes), payloads);
+    }
+    
+    /**
+     * @brief Encodes every message of a batch and answers with one frame
+     */
+    void handleBatch(int newsockfd, const Protocol::RequestHeader& request) {
+        const std::string body = readBody(newsockfd, request);
+        std::vector<std::string> messages = Protocol::parseBatchRequest(body.data(), body.size());
+        Metrics::add(Metrics::Counter::MESSAGES, messages.size());
+        std::vector<Shannon::EncodedMsg> msgs(messages.size());
+        std::vector<Protocol::TableTag> tags(messages.size());
+        const bool tableIds = request.flags & Protocol::FLAG_TABLE_IDS;
+        const Shannon::Alphabet alphabet = Protocol::alphabetOf(request.flags);
+        for (size_t i = 0; i < messages.size(); ++i) {
+            msgs[i].line = std::move(messages[i]);
+            tags[i] = knownTables.tag(tableCache.encode(msgs[i], alphabet), tableIds);
+        }
+        
+        const std::string response = Protocol::serializeBatchResponse(request.requestId, msgs, tags);
+        Protocol::writeAll(newsockfd, response.data(), response.size());
+    }
+    
+    /**
+     * @brief Reads the body of a request that must arrive whole
+     *
+     * The body grows at most RESERVE_LIMIT bytes ahead of what has arrived.
+     */
+    std::string readBody(int newsockfd, const Protocol::RequestHeader& request) {
+        std::string body;
+        while (body.size() < request.length) {
+            const size_t chunk = std::min<size_t>(request.length - body.size(), Protocol::RESERVE_LIMIT);
+            const size_t old = body.size();
+            body.resize(old + chunk);
+            if (!Protocol::readAll(newsockfd, &body[old], chunk)) {
+                throw std::runtime_error("Connection closed mid-frame");
+            }
+        }
+        return body;
+    }
+    
+    std::shared_ptr<const StaticTables::Table> findStaticTable(uint32_t id) {
+        std::shared_ptr<const StaticTables::Table> table = staticTables.find(id);
+        if (!table) {
+            throw std::runtime_error("Unknown static table " + std::to_string(id));
+        }
+        return table;
+    }
+    
+    /**
+     * @brief Counts the symbols of a body as it streams in
+     */
+    Shannon::Histogram countBody(int newsockfd, const Protocol::RequestHeader& request, std::vector<char>& buffer) {
+        Shannon::Histogram counts{};
+        size_t remaining = request.length;
+        while (remaining > 0) {
+            const size_t chunk = std::min(remaining, buffer.size());
+            if (!Protocol::readAll(newsockfd, buffer.data(), chunk)) {
+                throw std::runtime_error("Connection closed mid-frame");
+            }
+            Shannon::countFrequencies(buffer.data(), chunk, counts);
+            remaining -= chunk;
+        }
+        return counts;
+    }
+    
+    /**
+     * @brief Answers with the table trained on corpus
+     */
+    void answerTrain(int newsockfd, const Protocol::RequestHeader& request, const Shannon::Histogram& corpus) {
+        const uint32_t id = staticTables.train(corpus);
+        const std::string response = Protocol::serializeTableResponse(
+            request.requestId, id, findStaticTable(id)->charCodeVec);
+        Protocol::writeAll(newsockfd, response.data(), response.size());
+    }
+    
+    /**
+     * @brief Answers with the symbol counts of one message, for coordinators building a global table
+     */
+    void handleHistogram(int newsockfd, const Protocol::RequestHeader& request, std::vector<char>& buffer) {
+        const std::string response = Protocol::serializeHistogramResponse(
+            request.requestId, countBody(newsockfd, request, buffer));
+        Protocol::writeAll(newsockfd, response.data(), response.size());
+    }
+    
+    void handleTable(int newsockfd, const Protocol::RequestHeader& request) {
+        const std::string body = readBody(newsockfd, request);
+        const uint32_t id = Protocol::parseTableId(body.data(), body.size());
+        const std::string response = Protocol::serializeTableResponse(
+            request.requestId, id, findStaticTable(id)->charCodeVec);
+        Protocol::writeAll(newsockfd, response.data(), response.size());
+    }
+    
+    /**
+     * @brief Encodes one message with a static table as it streams in
+     *
+     * The table is fixed, so every chunk is encoded on arrival and nothing
+     * of the message is kept.
+     */
+    void handleEncodeStatic(int newsockfd, const Protocol::RequestHeader& request, std::vector<char>& buffer) {
+        char idBytes[Protocol::TABLE_ID_SIZE];
+        if (request.length < sizeof(idBytes) || !Protocol::readAll(newsockfd, idBytes, sizeof(idBytes))) {
+            throw std::runtime_error("Static request without a table id");
+        }
+        const uint32_t id = Protocol::parseTableId(idBytes, sizeof(idBytes));
+        const std::shared_ptr<const StaticTables::Table> table = findStaticTable(id);
+        
+        Metrics::add(Metrics::Counter::MESSAGES);
+        Shannon::TableEncoder encoder(table->codes);
+        size_t remaining = request.length - sizeof(idBytes);
+        while (remaining > 0) {
+            const size_t chunk = std::min(remaining, buffer.size());
+            if (!Protocol::readAll(newsockfd, buffer.data(), chunk)) {
+                throw std::runtime_error("Connection closed mid-frame");
+            }
+            encoder.append(buffer.data(), chunk);
+            remaining -= chunk;
+        }
+        
+        Shannon::EncodedMsg msg;
+        const Protocol::TableTag tag{id, Protocol::TableKind::STATIC, static_cast<uint32_t>(encoder.symbolCount())};
+        msg.encoded = encoder.finish();
+        sendEncoded(newsockfd, Protocol::serializeResponseHeader(request.requestId, msg, tag), msg);
+    }
+    
+    void handleBatchStatic(int newsockfd, const Protocol::RequestHeader& request) {
+        const std::string body = readBody(newsockfd, request);
+        const uint32_t id = Protocol::parseTableId(body.data(), body.size());
+        const std::shared_ptr<const StaticTables::Table> table = findStaticTable(id);
+        
+        std::vector<std::string> messages = Protocol::parseBatchRequest(
+            body.data() + Protocol::TABLE_ID_SIZE, body.size() - Protocol::TABLE_ID_SIZE);
+        Metrics::add(Metrics::Counter::MESSAGES, messages.size());
+        std::vector<Shannon::EncodedMsg> msgs(messages.size());
+        std::vector<Protocol::TableTag> tags(messages.size());
+        for (size_t i = 0; i < messages.size(); ++i) {
+            msgs[i].line = std::move(messages[i]);
+            StaticTables::encode(*table, msgs[i]);
+            tags[i] = Protocol::TableTag{id, Protocol::TableKind::STATIC, static_cast<uint32_t>(msgs[i].line.size())};
+        }
+        
+        const std::string response = Protocol::serializeBatchResponse(request.requestId, msgs, tags);
+        Protocol::writeAll(newsockfd, response.data(), response.size());
+    }
+    
+    /**
+     * @brief Answers with the metrics of the parent and every child
+     */
+    void handleStats(int newsockfd, const Protocol::RequestHeader& request) {
+        readBody(newsockfd, request);
+        const std::string response = Protocol::serializeStatsResponse(request.requestId, Metrics::toJson());
+        Protocol::writeAll(newsockfd, response.data(), response.size());
+    }
+    
+    /**
+     * @brief Answers request frames on one connection until the client closes it
+     */
+    void handleClient(int newsockfd) {
+        char header[Protocol::REQUEST_HEADER_SIZE];
+        std::vector<char> buffer(ServerConfig::BUFFER_SIZE);
+        zeroCopy = std::make_unique<ZeroCopySender>(newsockfd);
+        
+        while (Protocol::readAll(newsockfd, header, sizeof(header))) {
+            const Protocol::RequestHeader request = Protocol::parseRequestHeader(header);
+            Metrics::add(Metrics::Counter::REQUESTS);
+            Metrics::StageTimer timer(Metrics::Stage::REQUEST);
+            switch (request.type) {
+                case Protocol::RequestType::ENCODE:
+                    handleEncode(newsockfd, request, buffer);
+                    break;
+                case Protocol::RequestType::BATCH:
+                    handleBatch(newsockfd, request);
+                    break;
+                case Protocol::RequestType::TRAIN:
+                    answerTrain(newsockfd, request, countBody(newsockfd, request, buffer));
+                    break;
+                case Protocol::RequestType::TRAIN_COUNTS: {
+                    const std::string body = readBody(newsockfd, request);
+                    answerTrain(newsockfd, request, Protocol::parseCounts(body.data(), body.size()));
+                    break;
+                }
+                case Protocol::RequestType::HISTOGRAM:
+                    handleHistogram(newsockfd, request, buffer);
+                    break;
+                case Protocol::RequestType::TABLE:
+                    handleTable(newsockfd, request);
+                    break;
+                case Protocol::RequestType::ENCODE_STATIC:
+                    handleEncodeStatic(newsockfd, request, buffer);
+                    break;
+                case Protocol::RequestType::BATCH_STATIC:
+                    handleBatchStatic(newsockfd, request);
+                    break;
+                case Protocol::RequestType::STATS:
+                    handleStats(newsockfd, request);
+                    break;
+            }
+        }
     }
     
 public:
-    Server(int port) : portno(port) {
+    Server(int port, const std::string& tableDirectory) : portno(port), staticTables(tableDirectory) {
         setupSocket();
     }
     
@@ -201,30 +358,51 @@ public:
         listen(sockfd, ServerConfig::MAX_CONNECTIONS);
         signal(SIGCHLD, fireman);
         
+        // Without SA_RESTART, so a stop signal interrupts accept()
+        struct sigaction stop;
+        std::memset(&stop, 0, sizeof(stop));
+        stop.sa_handler = stopServer;
+        sigaction(SIGINT, &stop, nullptr);
+        sigaction(SIGTERM, &stop, nullptr);
+        
         std::cout << "Server running on port " << portno << std::endl;
         
-        while (true) {
+        while (!stopping) {
             sockaddr_in cli_addr;
             socklen_t clilen = sizeof(cli_addr);
             
             int newsockfd = accept(sockfd, (struct sockaddr*)&cli_addr, &clilen);
             if (newsockfd < 0) {
-                std::cerr << "Error on accept" << std::endl;
+                if (errno != EINTR) std::cerr << "Error on accept" << std::endl;
                 continue;
             }
+            Metrics::add(Metrics::Counter::ACCEPTS);
             
-            if (fork() == 0) {
+            const uint64_t forkStart = Metrics::enabled() ? Metrics::ticks() : 0;
+            const pid_t pid = fork();
+            if (pid == 0) {
+                // _exit() skips destructors, so the child hands its metrics over itself
                 try {
+                    signal(SIGINT, SIG_DFL);
+                    signal(SIGTERM, SIG_DFL);
                     close(sockfd);  // Child doesn't need the listening socket
                     handleClient(newsockfd);
+                    // Payloads still in flight stay pinned by the kernel after the exit
                     close(newsockfd);
+                    Metrics::release();
                     _exit(0);
                 } catch (const std::exception& e) {
                     std::cerr << "Client handling error: " << e.what() << std::endl;
                     close(newsockfd);
+                    Metrics::add(Metrics::Counter::ERRORS);
+                    Metrics::release();
                     _exit(1);
                 }
             }
+            if (pid > 0) {
+                Metrics::add(Metrics::Counter::FORKS);
+                if (forkStart != 0) Metrics::record(Metrics::Stage::FORK, Metrics::ticks() - forkStart);
+            }
             
             close(newsockfd);  // Parent doesn't need the connected socket
         }
@@ -234,11 +412,60 @@ public:
 int main(int argc, char* argv[]) {
     try {
         if (argc < 2) {
-            throw std::runtime_error("Usage: " + std::string(argv[0]) + " <port>");
+            throw std::runtime_error("Usage: " + std::string(argv[0]) + " <port> [--epoll | --uring] [--loops N] [--tables DIR] [--metrics]");
         }
         
-        Server server(std::stoi(argv[1]));
-        server.run();
+        const int port = std::stoi(argv[1]);
+        bool eventMode = false;
+        EventServer::Backend backend = EventServer::Backend::EPOLL;
+        unsigned loops = 0;
+        std::string tableDirectory;
+        
+        for (int i = 2; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--epoll") {
+                eventMode = true;
+                backend = EventServer::Backend::EPOLL;
+            } else if (arg == "--uring") {
+                eventMode = true;
+                backend = EventServer::Backend::URING;
+            } else if (arg == "--loops" && i + 1 < argc) {
+                loops = std::stoul(argv[++i]);
+            } else if (arg == "--tables" && i + 1 < argc) {
+                tableDirectory = argv[++i];
+            } else if (arg == "--metrics") {
+                Metrics::enable();
+            } else {
+                throw std::runtime_error("Unknown option: " + arg);
+            }
+        }
+        
+        if (eventMode) {
+            signal(SIGPIPE, SIG_IGN);
+            ThreadPool pool;
+            EventServer server(port, loops, pool, tableDirectory, backend);
+            std::cout << "Event server running on port " << port << std::endl;
+            server.run();
+        } else {
+            // Each connection is its own process, so trained tables must be shared through files
+            bool temporaryTables = false;
+            if (tableDirectory.empty()) {
+                char pattern[] = "/tmp/shannon_tables.XXXXXX";
+                if (!mkdtemp(pattern)) {
+                    throw std::runtime_error("Error creating a table directory");
+                }
+                tableDirectory = pattern;
+                temporaryTables = true;
+            }
+            try {
+                Server server(port, tableDirectory);
+                server.run();
+            } catch (...) {
+                if (temporaryTables) std::filesystem::remove_all(tableDirectory);
+                throw;
+            }
+            if (temporaryTables) std::filesystem::remove_all(tableDirectory);
+        }
         
     } catch (const std::exception& e) {
         std::cerr << "Fatal error: " << e.what() << std::endl;
@@ -246,4 +473,4 @@ int main(int argc, char* argv[]) {
     }
     
     return 0;
-}
\ No newline at end of file
+}
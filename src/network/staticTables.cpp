@@ -0,0 +1,131 @@
+/**
+ * @file staticTables.cpp
+ * @brief Pre-trained code tables that messages are encoded against by id
+ */
+
+#include "staticTables.h"
+
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+    constexpr char FILE_MAGIC[4] = {'S', 'H', 'T', 'B'};
+    constexpr uint32_t FILE_VERSION = 1;
+
+    uint32_t hashHistogram(const Shannon::Histogram& hist) {
+        uint32_t hash = 0x811c9dc5u;
+        for (uint32_t freq : hist) {
+            hash = (hash ^ freq) * 0x01000193u;
+        }
+        return hash;
+    }
+
+    std::shared_ptr<const StaticTables::Table> makeTable(uint32_t id, const Shannon::Histogram& hist) {
+        auto table = std::make_shared<StaticTables::Table>();
+        table->id = id;
+        table->hist = hist;
+        table->charCodeVec = Shannon::buildCodeTable(hist, table->codes);
+        return table;
+    }
+}
+
+StaticTables::StaticTables(std::string directory) : directory(std::move(directory)) {
+    pthread_mutex_init(&mutex, nullptr);
+}
+
+StaticTables::~StaticTables() {
+    pthread_mutex_destroy(&mutex);
+}
+
+uint32_t StaticTables::train(const Shannon::Histogram& corpus) {
+    // Bytes the corpus never used still need a code
+    Shannon::Histogram hist = corpus;
+    for (uint32_t& freq : hist) {
+        if (freq == 0) freq = 1;
+    }
+
+    uint32_t id = hashHistogram(hist);
+    while (true) {
+        if (id == 0) id = 1;
+        const std::shared_ptr<const Table> existing = find(id);
+        if (!existing) break;
+        if (existing->hist == hist) return id;
+        ++id;  // A different table already has this id
+    }
+
+    const std::shared_ptr<const Table> table = makeTable(id, hist);
+    if (!directory.empty()) {
+        store(*table);
+    }
+
+    pthread_mutex_lock(&mutex);
+    tables.emplace(id, table);
+    pthread_mutex_unlock(&mutex);
+    return id;
+}
+
+std::shared_ptr<const StaticTables::Table> StaticTables::find(uint32_t id) {
+    pthread_mutex_lock(&mutex);
+    auto it = tables.find(id);
+    std::shared_ptr<const Table> table = (it != tables.end()) ? it->second : nullptr;
+    pthread_mutex_unlock(&mutex);
+    if (table || directory.empty()) return table;
+
+    // Another process sharing the directory may have trained it
+    table = load(id);
+    if (table) {
+        pthread_mutex_lock(&mutex);
+        tables.emplace(id, table);
+        pthread_mutex_unlock(&mutex);
+    }
+    return table;
+}
+
+void StaticTables::encode(const Table& table, Shannon::EncodedMsg& msg) {
+    Shannon::TableEncoder encoder(table.codes);
+    encoder.append(msg.line.data(), msg.line.size());
+    msg.charCodeVec.clear();
+    msg.encoded = encoder.finish();
+}
+
+std::string StaticTables::pathOf(uint32_t id) const {
+    return directory + "/" + std::to_string(id) + ".table";
+}
+
+std::shared_ptr<const StaticTables::Table> StaticTables::load(uint32_t id) const {
+    std::ifstream file(pathOf(id), std::ios::binary);
+    if (!file) return nullptr;
+
+    char magic[sizeof(FILE_MAGIC)];
+    uint32_t version = 0;
+    Shannon::Histogram hist{};
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(hist.data()), sizeof(hist));
+    if (!file || std::memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0 || version != FILE_VERSION) {
+        throw std::runtime_error("Corrupt table file " + pathOf(id));
+    }
+    return makeTable(id, hist);
+}
+
+void StaticTables::store(const Table& table) const {
+    // Written aside and renamed so readers never see half a table
+    const std::string path = pathOf(table.id);
+    const std::string temporary = path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+        file.write(reinterpret_cast<const char*>(&FILE_VERSION), sizeof(FILE_VERSION));
+        file.write(reinterpret_cast<const char*>(table.hist.data()), sizeof(table.hist));
+        if (!file) {
+            throw std::runtime_error("Error writing table file " + temporary);
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("Error storing table file " + path);
+    }
+}
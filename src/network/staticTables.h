@@ -0,0 +1,74 @@
+/**
+ * @file staticTables.h
+ * @brief Pre-trained code tables that messages are encoded against by id
+ *
+ * A static table is built once from the aggregate symbol counts of a corpus.
+ * Messages encoded with it skip counting and sorting entirely, and their
+ * responses name the table instead of shipping an alphabet. Every byte value
+ * gets a code, so any message can use any table.
+ */
+
+#ifndef STATIC_TABLES_H
+#define STATIC_TABLES_H
+
+#include <pthread.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "../codec/shannon.h"
+#include "tableCache.h"
+
+/**
+ * @class StaticTables
+ * @brief Trained tables by id, optionally persisted to a directory
+ *
+ * Ids are derived from the table contents, so training the same corpus twice
+ * yields the same id, and processes sharing a directory agree on ids
+ * without coordinating.
+ */
+class StaticTables {
+public:
+    using Table = TableCache::Table;
+
+    /**
+     * @param directory Where tables are stored as <id>.table; empty keeps them in memory only
+     */
+    explicit StaticTables(std::string directory = "");
+    ~StaticTables();
+
+    StaticTables(const StaticTables&) = delete;
+    StaticTables& operator=(const StaticTables&) = delete;
+
+    /**
+     * @brief Builds, stores and persists the table for a corpus histogram
+     * @return The table's id
+     * @throws std::runtime_error if the table cannot be written to the directory
+     */
+    uint32_t train(const Shannon::Histogram& corpus);
+
+    /**
+     * @brief Looks a table up in memory, then in the directory
+     * @return nullptr if no table has that id
+     */
+    std::shared_ptr<const Table> find(uint32_t id);
+
+    /**
+     * @brief Encodes msg.line with table in one pass
+     *
+     * msg.charCodeVec stays empty: the table travels by id.
+     */
+    static void encode(const Table& table, Shannon::EncodedMsg& msg);
+
+private:
+    std::string directory;
+    std::unordered_map<uint32_t, std::shared_ptr<const Table>> tables;
+    pthread_mutex_t mutex;
+
+    std::string pathOf(uint32_t id) const;
+    std::shared_ptr<const Table> load(uint32_t id) const;
+    void store(const Table& table) const;
+};
+
+#endif // STATIC_TABLES_H
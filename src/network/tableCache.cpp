@@ -0,0 +1,112 @@
+/**
+ * @file tableCache.cpp
+ * @brief Bounded LRU cache of finished Shannon code tables
+ */
+
+#include "tableCache.h"
+#include "../metrics/metrics.h"
+
+#include <stdexcept>
+
+namespace {
+    uint64_t hashHistogram(const Shannon::Histogram& hist) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (uint32_t freq : hist) {
+            hash = (hash ^ freq) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+}
+
+TableCache::TableCache(size_t capacity) : capacity(capacity) {
+    if (capacity == 0) {
+        throw std::invalid_argument("Table cache capacity must be positive");
+    }
+    pthread_mutex_init(&mutex, nullptr);
+}
+
+TableCache::~TableCache() {
+    pthread_mutex_destroy(&mutex);
+}
+
+std::shared_ptr<const TableCache::Table> TableCache::lookup(const Shannon::Histogram& hist) {
+    const uint64_t hash = hashHistogram(hist);
+
+    pthread_mutex_lock(&mutex);
+    auto it = index.find(hash);
+    if (it != index.end() && (*it->second)->hist == hist) {
+        recent.splice(recent.begin(), recent, it->second);
+        ++hitCount;
+        Entry table = recent.front();
+        pthread_mutex_unlock(&mutex);
+        Metrics::add(Metrics::Counter::TABLE_HITS);
+        return table;
+    }
+    ++missCount;
+    const uint32_t id = nextId++;
+    pthread_mutex_unlock(&mutex);
+    Metrics::add(Metrics::Counter::TABLE_MISSES);
+
+    // Built outside the lock; concurrent misses on one histogram are harmless
+    auto table = std::make_shared<Table>();
+    table->id = id;
+    table->hist = hist;
+    table->charCodeVec = Shannon::buildCodeTable(hist, table->codes);
+
+    pthread_mutex_lock(&mutex);
+    it = index.find(hash);
+    if (it != index.end()) {
+        // Same histogram raced in, or a hash collision: the newest wins
+        recent.erase(it->second);
+        index.erase(it);
+    }
+    recent.push_front(table);
+    index[hash] = recent.begin();
+    if (recent.size() > capacity) {
+        index.erase(hashHistogram(recent.back()->hist));
+        recent.pop_back();
+    }
+    pthread_mutex_unlock(&mutex);
+    return table;
+}
+
+uint32_t TableCache::encode(Shannon::EncodedMsg& msg, Shannon::Alphabet alphabet) {
+    Shannon::Histogram hist{};
+    Shannon::countFrequencies(msg.line.data(), msg.line.length(), hist);
+    return encode(msg, hist, alphabet);
+}
+
+uint32_t TableCache::encode(Shannon::EncodedMsg& msg, const Shannon::Histogram& hist,
+                            Shannon::Alphabet alphabet) {
+    const Entry table = lookup(hist);
+    msg.charCodeVec = table->charCodeVec;
+    Shannon::encode(alphabet, msg.line, hist, table->codes, msg.encoded);
+    return table->id;
+}
+
+size_t TableCache::hits() const {
+    pthread_mutex_lock(&mutex);
+    const size_t count = hitCount;
+    pthread_mutex_unlock(&mutex);
+    return count;
+}
+
+size_t TableCache::misses() const {
+    pthread_mutex_lock(&mutex);
+    const size_t count = missCount;
+    pthread_mutex_unlock(&mutex);
+    return count;
+}
+
+Protocol::TableTag KnownTables::tag(uint32_t id, bool enabled) {
+    Protocol::TableTag tag;
+    tag.id = id;
+    if (!enabled || id == 0) return tag;
+
+    if (ids.count(id)) {
+        tag.kind = Protocol::TableKind::REFERENCE;
+    } else if (ids.size() < LIMIT) {
+        ids.insert(id);
+    }
+    return tag;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file tableCache.h
+ * @brief Bounded LRU cache of finished Shannon code tables
+ *
+ * A code table is a pure function of the symbol counts, so messages with the
+ * same histogram, such as repeated log lines and templates, can reuse one
+ * table instead of sorting and deriving codes again. Every table gets an id
+ * that clients can cache in turn, so a table only needs to cross the wire
+ * once per connection.
+ */
+
+#ifndef TABLE_CACHE_H
+#define TABLE_CACHE_H
+
+#include <pthread.h>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../codec/shannon.h"
+#include "protocol.h"
+
+/**
+ * @class TableCache
+ * @brief Histogram-keyed code tables shared by every thread of a server
+ */
+class TableCache {
+public:
+    /// Longer messages rarely repeat; their tables would only evict useful ones
+    static constexpr size_t MAX_MESSAGE_SIZE = 64 * 1024;
+
+    /**
+     * @struct Table
+     * @brief A cached table; entries are immutable once published
+     */
+    struct Table {
+        uint32_t id;                                ///< Never 0 and never reused
+        Shannon::Histogram hist;
+        Shannon::CodeTable codes;
+        std::vector<Shannon::CharCode> charCodeVec;
+    };
+
+    /**
+     * @param capacity Tables kept before the least recently used is dropped
+     * @throws std::invalid_argument if capacity is 0
+     */
+    explicit TableCache(size_t capacity = 4096);
+    ~TableCache();
+
+    TableCache(const TableCache&) = delete;
+    TableCache& operator=(const TableCache&) = delete;
+
+    /**
+     * @brief Returns the table for hist, building and caching it on a miss
+     */
+    std::shared_ptr<const Table> lookup(const Shannon::Histogram& hist);
+
+    /**
+     * @brief Counts msg.line and fills msg from the cached table for its histogram
+     * @param alphabet Hint selecting a specialized encoder (see fixedAlphabet.h)
+     * @return The id of the table used
+     */
+    uint32_t encode(Shannon::EncodedMsg& msg, Shannon::Alphabet alphabet = Shannon::Alphabet::ANY);
+
+    /**
+     * @brief encode for a message whose symbols are already counted in hist
+     */
+    uint32_t encode(Shannon::EncodedMsg& msg, const Shannon::Histogram& hist,
+                    Shannon::Alphabet alphabet = Shannon::Alphabet::ANY);
+
+    size_t hits() const;
+    size_t misses() const;
+
+private:
+    using Entry = std::shared_ptr<const Table>;
+
+    size_t capacity;
+    std::list<Entry> recent;        ///< Most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;   ///< By histogram hash
+    uint32_t nextId = 1;
+    size_t hitCount = 0;
+    size_t missCount = 0;
+    mutable pthread_mutex_t mutex;
+};
+
+/**
+ * @class KnownTables
+ * @brief Table ids one connection has already received in full
+ *
+ * Only whoever appends responses to the connection in wire order may use
+ * it, since a reference must never overtake the table it names.
+ */
+class KnownTables {
+public:
+    /// Ids remembered per connection; later tables are always sent in full
+    static constexpr size_t LIMIT = size_t(1) << 16;
+
+    /**
+     * @brief Decides how to send table id and remembers it once sent in full
+     * @param enabled Whether the request asked for FLAG_TABLE_IDS
+     */
+    Protocol::TableTag tag(uint32_t id, bool enabled);
+
+private:
+    std::unordered_set<uint32_t> ids;
+};
+
+#endif // TABLE_CACHE_H
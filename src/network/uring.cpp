@@ -0,0 +1,189 @@
+/**
+ * @file uring.cpp
+ * @brief Minimal io_uring submission/completion rings over the raw system calls
+ */
+
+#include "uring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    void* mapRing(int fd, size_t size, off_t offset) {
+        void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Error mapping io_uring queues");
+        }
+        return mapping;
+    }
+
+    template <typename T>
+    T* at(void* ring, uint32_t offset) {
+        return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+    }
+}
+
+Uring::Uring(unsigned entries) {
+    io_uring_params params{};
+    // One thread submits and reaps, so the kernel can defer completion work to io_uring_enter
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = entries * COMPLETION_FACTOR;
+    fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Error creating io_uring: ") + std::strerror(errno));
+    }
+
+    try {
+        sqEntries = params.sq_entries;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = mapRing(fd, sqRingSize, IORING_OFF_SQ_RING);
+        cqRing = single ? sqRing : mapRing(fd, cqRingSize, IORING_OFF_CQ_RING);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mapRing(fd, sqesSize, IORING_OFF_SQES));
+    } catch (...) {
+        teardown();
+        throw;
+    }
+
+    sqHead = at<unsigned>(sqRing, params.sq_off.head);
+    sqTail = at<unsigned>(sqRing, params.sq_off.tail);
+    sqMask = *at<unsigned>(sqRing, params.sq_off.ring_mask);
+    cqHead = at<unsigned>(cqRing, params.cq_off.head);
+    cqTail = at<unsigned>(cqRing, params.cq_off.tail);
+    cqMask = *at<unsigned>(cqRing, params.cq_off.ring_mask);
+    cqes = at<io_uring_cqe>(cqRing, params.cq_off.cqes);
+
+    // SQE slot i is always array entry i, so only the tail moves
+    unsigned* array = at<unsigned>(sqRing, params.sq_off.array);
+    for (unsigned i = 0; i < sqEntries; ++i) array[i] = i;
+    localTail = *sqTail;
+}
+
+Uring::~Uring() {
+    teardown();
+}
+
+void Uring::teardown() {
+    if (sqes) munmap(sqes, sqesSize);
+    if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing) munmap(sqRing, sqRingSize);
+    if (fd >= 0) close(fd);
+    sqes = nullptr;
+    sqRing = cqRing = nullptr;
+    fd = -1;
+}
+
+bool Uring::supported() {
+    try {
+        Uring probe(2);
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+int Uring::enter(unsigned submit, unsigned wait) {
+    const unsigned flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0));
+}
+
+io_uring_sqe* Uring::next() {
+    if (localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) == sqEntries) {
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+        const int submitted = enter(unsubmitted, 0);
+        if (submitted < 0) {
+            throw std::runtime_error(std::string("Error submitting to io_uring: ") + std::strerror(errno));
+        }
+        unsubmitted -= submitted;
+    }
+
+    io_uring_sqe* sqe = &sqes[localTail & sqMask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ++localTail;
+    ++unsubmitted;
+    return sqe;
+}
+
+void Uring::submitAndWait(unsigned count) {
+    __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+    while (true) {
+        const int submitted = enter(unsubmitted, count);
+        if (submitted >= 0) {
+            unsubmitted -= submitted;
+            return;
+        }
+        if (errno != EINTR) {
+            throw std::runtime_error(std::string("Error waiting on io_uring: ") + std::strerror(errno));
+        }
+    }
+}
+
+const io_uring_cqe* Uring::peek() const {
+    const unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) return nullptr;
+    return &cqes[head & cqMask];
+}
+
+void Uring::advance() {
+    __atomic_store_n(cqHead, *cqHead + 1, __ATOMIC_RELEASE);
+}
+
+BufferRing::BufferRing(Uring& ring, uint16_t group, unsigned count, size_t size)
+    : ring(ring), groupId(group), count(count), size(size) {
+    entriesSize = count * sizeof(io_uring_buf);
+    void* mapping = mmap(nullptr, entriesSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Error mapping the io_uring buffer ring");
+    }
+    // Not io_uring_buf_ring: in C++ its flexible array does not start at offset 0
+    entries = static_cast<io_uring_buf*>(mapping);
+
+    mapping = mmap(nullptr, count * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        munmap(entries, entriesSize);
+        throw std::runtime_error("Error mapping io_uring receive buffers");
+    }
+    storage = static_cast<char*>(mapping);
+
+    io_uring_buf_reg registration{};
+    registration.ring_addr = reinterpret_cast<uint64_t>(entries);
+    registration.ring_entries = count;
+    registration.bgid = group;
+    if (syscall(__NR_io_uring_register, ring.descriptor(), IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        const int error = errno;
+        munmap(storage, count * size);
+        munmap(entries, entriesSize);
+        throw std::runtime_error(std::string("Error registering io_uring buffers: ") + std::strerror(error));
+    }
+
+    for (unsigned id = 0; id < count; ++id) recycle(static_cast<uint16_t>(id));
+}
+
+BufferRing::~BufferRing() {
+    io_uring_buf_reg registration{};
+    registration.bgid = groupId;
+    syscall(__NR_io_uring_register, ring.descriptor(), IORING_UNREGISTER_PBUF_RING, &registration, 1);
+    munmap(storage, count * size);
+    munmap(entries, entriesSize);
+}
+
+void BufferRing::recycle(uint16_t id) {
+    io_uring_buf& entry = entries[tail & (count - 1)];
+    entry.addr = reinterpret_cast<uint64_t>(buffer(id));
+    entry.len = static_cast<uint32_t>(size);
+    entry.bid = id;
+    ++tail;
+    __atomic_store_n(&entries[0].resv, tail, __ATOMIC_RELEASE);
+}
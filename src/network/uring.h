@@ -0,0 +1,134 @@
+/**
+ * @file uring.h
+ * @brief Minimal io_uring submission/completion rings over the raw system calls
+ *
+ * Only what the network loops use: one ring per thread, SQEs prepared in
+ * place and submitted together with the wait for completions, so one
+ * io_uring_enter() carries every socket operation of a loop iteration, and
+ * a provided buffer ring for multishot receives.
+ *
+ * Rings are created with IORING_SETUP_DEFER_TASKRUN (Linux 6.1), which is
+ * newer than every operation used here (multishot accept and recv,
+ * provided buffer rings), so a kernel that accepts the setup supports them
+ * all; callers fall back to epoll when supported() is false.
+ */
+
+#ifndef SHANNON_URING_H
+#define SHANNON_URING_H
+
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class Uring
+ * @brief One io_uring instance, used only by the thread that created it
+ */
+class Uring {
+public:
+    /**
+     * @param entries Submission queue size; the completion queue is COMPLETION_FACTOR times larger
+     * @throws std::runtime_error if the kernel refuses the ring
+     */
+    explicit Uring(unsigned entries);
+    ~Uring();
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    static constexpr unsigned COMPLETION_FACTOR = 8;   ///< Multishot requests complete many times each
+
+    /**
+     * @brief Whether this kernel and its settings allow the rings these loops use
+     */
+    static bool supported();
+
+    int descriptor() const { return fd; }
+
+    /**
+     * @brief A cleared SQE to fill in; submits queued ones first when the queue is full
+     * @throws std::runtime_error if submitting fails
+     */
+    io_uring_sqe* next();
+
+    /**
+     * @brief Submits every prepared SQE and waits until at least count completions are ready
+     * @throws std::runtime_error if io_uring_enter fails other than by interruption
+     */
+    void submitAndWait(unsigned count);
+
+    /**
+     * @brief The oldest unseen completion, or nullptr
+     */
+    const io_uring_cqe* peek() const;
+
+    /**
+     * @brief Marks the completion from peek() as consumed
+     */
+    void advance();
+
+private:
+    int fd = -1;
+    unsigned sqEntries = 0;
+
+    void* sqRing = nullptr;
+    size_t sqRingSize = 0;
+    void* cqRing = nullptr;         ///< Same as sqRing with IORING_FEAT_SINGLE_MMAP
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    unsigned localTail = 0;         ///< SQEs prepared; published to the kernel on submit
+    unsigned unsubmitted = 0;       ///< Published or prepared but not yet taken by the kernel
+
+    int enter(unsigned submit, unsigned wait);
+    void teardown();
+};
+
+/**
+ * @class BufferRing
+ * @brief Fixed receive buffers the kernel picks from for IOSQE_BUFFER_SELECT requests
+ *
+ * Registered once; a completion names the buffer it filled, and the
+ * buffer goes back to the kernel with recycle() once parsed.
+ */
+class BufferRing {
+public:
+    /**
+     * @param count Buffers, a power of two
+     * @throws std::runtime_error if registration fails
+     */
+    BufferRing(Uring& ring, uint16_t group, unsigned count, size_t size);
+    ~BufferRing();
+
+    BufferRing(const BufferRing&) = delete;
+    BufferRing& operator=(const BufferRing&) = delete;
+
+    uint16_t group() const { return groupId; }
+    const char* buffer(uint16_t id) const { return storage + static_cast<size_t>(id) * size; }
+
+    /**
+     * @brief Hands buffer id back to the kernel
+     */
+    void recycle(uint16_t id);
+
+private:
+    Uring& ring;
+    uint16_t groupId;
+    unsigned count;
+    size_t size;
+    io_uring_buf* entries = nullptr;    ///< The kernel's io_uring_buf_ring; its tail is entries[0].resv
+    size_t entriesSize = 0;
+    char* storage = nullptr;
+    uint16_t tail = 0;
+};
+
+#endif // SHANNON_URING_H
@@ -0,0 +1,122 @@
+/**
+ * @file zeroCopy.cpp
+ * @brief MSG_ZEROCOPY sends of large encoded payloads and recycling of their buffers
+ */
+
+#include "zeroCopy.h"
+#include "../metrics/metrics.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <cerrno>
+#include <stdexcept>
+#include <utility>
+
+Shannon::PackedBytes PayloadPool::take() {
+    if (spare.empty()) return {};
+    Shannon::PackedBytes bytes = std::move(spare.back());
+    spare.pop_back();
+    return bytes;
+}
+
+void PayloadPool::give(Shannon::PackedBytes&& bytes) {
+    if (spare.size() < MAX_BUFFERS && bytes.capacity() >= ZeroCopySender::MIN_PAYLOAD) {
+        bytes.clear();
+        spare.push_back(std::move(bytes));
+    }
+}
+
+ZeroCopySender::ZeroCopySender(int fd) : fd(fd) {
+    int one = 1;
+    enabled = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+}
+
+ssize_t ZeroCopySender::send(const iovec* iov, int count) {
+    msghdr message{};
+    message.msg_iov = const_cast<iovec*>(iov);
+    message.msg_iovlen = count;
+
+    if (enabled) {
+        const ssize_t n = sendmsg(fd, &message, MSG_NOSIGNAL | MSG_ZEROCOPY);
+        if (n >= 0) {
+            ++sends;
+            return n;
+        }
+        if (errno != ENOBUFS) return n;
+        // Out of memory for pinning pages; this one is copied
+    }
+    return sendmsg(fd, &message, MSG_NOSIGNAL);
+}
+
+void ZeroCopySender::hold(Shannon::PackedBytes&& payload, PayloadPool& pool) {
+    if (sends == completedBelow) {
+        pool.give(std::move(payload));     // Copied, or already complete
+        return;
+    }
+    held.push_back(Held{sends - 1, std::move(payload)});
+}
+
+void ZeroCopySender::complete(uint32_t first, uint32_t last) {
+    if (first != completedBelow) {
+        early[first] = last;
+        return;
+    }
+    completedBelow = last + 1;
+    for (auto it = early.find(completedBelow); it != early.end(); it = early.find(completedBelow)) {
+        completedBelow = it->second + 1;
+        early.erase(it);
+    }
+}
+
+bool ZeroCopySender::reap(PayloadPool& pool) {
+    bool notified = false;
+    while (true) {
+        char control[CMSG_SPACE(sizeof(sock_extended_err))];
+        msghdr message{};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) continue;
+            break;  // EAGAIN once the queue is empty
+        }
+
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            const bool recvErr = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                                 (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+            if (!recvErr) continue;
+            const auto* err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+
+            // The kernel copied instead; ordinary sends are cheaper than pinning for nothing
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                enabled = false;
+            }
+            complete(err->ee_info, err->ee_data);
+            notified = true;
+        }
+    }
+
+    while (!held.empty() && static_cast<int32_t>(held.front().lastSend - completedBelow) < 0) {
+        pool.give(std::move(held.front().payload));
+        held.pop_front();
+    }
+    return notified;
+}
+
+void ZeroCopySender::sendAll(Shannon::PackedBytes&& payload, PayloadPool& pool) {
+    Metrics::StageTimer timer(Metrics::Stage::SEND);
+    Metrics::add(Metrics::Counter::BYTES_OUT, payload.size());
+    iovec iov{payload.data(), payload.size()};
+    while (iov.iov_len > 0) {
+        const ssize_t n = send(&iov, 1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Error writing to socket");
+        }
+        iov.iov_base = static_cast<char*>(iov.iov_base) + n;
+        iov.iov_len -= n;
+    }
+    hold(std::move(payload), pool);
+    reap(pool);
+}
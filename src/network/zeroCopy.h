@@ -0,0 +1,124 @@
+/**
+ * @file zeroCopy.h
+ * @brief MSG_ZEROCOPY sends of large encoded payloads and recycling of their buffers
+ *
+ * A zero-copy send pins the pages of the payload and lets the NIC read them
+ * in place, so the payload must stay untouched until the kernel reports on
+ * the socket's error queue that it is done with it. The sender keeps each
+ * payload until then and passes it to a PayloadPool for the next encoding.
+ *
+ * Where the kernel copies anyway, as on loopback, its notifications say so
+ * and the sender goes back to ordinary sends, which are cheaper then.
+ */
+
+#ifndef ZERO_COPY_H
+#define ZERO_COPY_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "../codec/bitstream.h"
+
+/**
+ * @class PayloadPool
+ * @brief Payload buffers the kernel has finished with, kept for reuse
+ *
+ * A recycled buffer keeps its capacity and its pages, so encoding into it
+ * neither allocates nor faults. Owned by one thread.
+ */
+class PayloadPool {
+public:
+    static constexpr size_t MAX_BUFFERS = 4;    ///< Beyond this, buffers are freed
+
+    /**
+     * @brief A spare buffer, or an empty one if there is none
+     */
+    Shannon::PackedBytes take();
+
+    /**
+     * @brief Keeps bytes for a later take(), unless the pool is full
+     */
+    void give(Shannon::PackedBytes&& bytes);
+
+private:
+    std::vector<Shannon::PackedBytes> spare;
+};
+
+/**
+ * @class ZeroCopySender
+ * @brief Zero-copy sends on one socket and the payloads they still reference
+ */
+class ZeroCopySender {
+public:
+    static constexpr size_t MIN_PAYLOAD = 64 * 1024;   ///< Smaller payloads cost more to pin than to copy
+
+    /**
+     * @brief Enables SO_ZEROCOPY on fd; without kernel support every send is ordinary
+     */
+    explicit ZeroCopySender(int fd);
+
+    ZeroCopySender(const ZeroCopySender&) = delete;
+    ZeroCopySender& operator=(const ZeroCopySender&) = delete;
+
+    /**
+     * @brief Whether a payload of length bytes should go out with send()
+     */
+    bool accepts(size_t length) const { return enabled && length >= MIN_PAYLOAD; }
+
+    /**
+     * @brief One sendmsg() of iov with MSG_ZEROCOPY, falling back to a copy if the kernel is short of memory
+     * @return As sendmsg(); the buffers must outlive the send until hold() releases them
+     */
+    ssize_t send(const iovec* iov, int count);
+
+    /**
+     * @brief Keeps payload until the kernel has finished every send made so far
+     *
+     * A payload no pending send references goes straight to pool.
+     */
+    void hold(Shannon::PackedBytes&& payload, PayloadPool& pool);
+
+    /**
+     * @brief Takes the notifications that have arrived and returns released payloads to pool
+     * @return true if the error queue held notifications, false if it held nothing or a real error
+     */
+    bool reap(PayloadPool& pool);
+
+    /**
+     * @brief Writes all of data to a blocking socket with zero-copy sends, then holds payload
+     * @param payload Owns data; released to pool once the kernel is done with it
+     * @throws std::runtime_error on write failure
+     */
+    void sendAll(Shannon::PackedBytes&& payload, PayloadPool& pool);
+
+    /**
+     * @brief Whether no payload is waiting for the kernel
+     */
+    bool idle() const { return held.empty(); }
+
+private:
+    /**
+     * @struct Held
+     * @brief A sent payload and the last send that referenced it
+     */
+    struct Held {
+        uint32_t lastSend;
+        Shannon::PackedBytes payload;
+    };
+
+    int fd;
+    bool enabled = false;
+    uint32_t sends = 0;                     ///< Zero-copy sends so far; the kernel numbers them from 0
+    uint32_t completedBelow = 0;            ///< Every send numbered below this is complete
+    std::map<uint32_t, uint32_t> early;     ///< Completed ranges past a gap, first to last
+    std::deque<Held> held;
+
+    void complete(uint32_t first, uint32_t last);
+};
+
+#endif // ZERO_COPY_H
@@ -0,0 +1,132 @@
+/**
+ * @file asyncWriter.cpp
+ * @brief Dedicated output thread implementation
+ */
+
+#include "asyncWriter.h"
+
+#include <unistd.h>
+#include <sched.h>
+#include <cerrno>
+#include <stdexcept>
+
+namespace {
+    // Buffered bytes that trigger a write() before the queue runs dry
+    constexpr size_t FLUSH_BYTES = 64 * 1024;
+
+    void writeAll(int fd, std::string& buffer) {
+        size_t offset = 0;
+        while (offset < buffer.size()) {
+            const ssize_t n = ::write(fd, buffer.data() + offset, buffer.size() - offset);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;  // Nowhere left to report the failure
+            }
+            offset += n;
+        }
+        buffer.clear();
+    }
+}
+
+AsyncWriter::AsyncWriter(size_t capacity) : queue(capacity) {
+    pthread_mutex_init(&mutex, nullptr);
+    pthread_cond_init(&wake, nullptr);
+    pthread_cond_init(&drained, nullptr);
+
+    if (pthread_create(&tid, nullptr, writerMain, this)) {
+        pthread_cond_destroy(&drained);
+        pthread_cond_destroy(&wake);
+        pthread_mutex_destroy(&mutex);
+        throw std::runtime_error("Failed to create writer thread");
+    }
+}
+
+AsyncWriter::~AsyncWriter() {
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&mutex);
+
+    pthread_join(tid, nullptr);
+
+    pthread_cond_destroy(&drained);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&mutex);
+}
+
+void AsyncWriter::write(Stream stream, std::string text) {
+    Record record{stream, std::move(text)};
+    while (!queue.tryPush(record)) {
+        sched_yield();  // Writer is behind; let it run
+    }
+    ++queued;
+
+    // Only a sleeping writer needs the lock; the check pairs with the
+    // writer setting sleeping before its last look at queued
+    if (sleeping) {
+        pthread_mutex_lock(&mutex);
+        pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&mutex);
+    }
+}
+
+void AsyncWriter::flush() {
+    const size_t target = queued;
+    pthread_mutex_lock(&mutex);
+    while (written < target) {
+        pthread_cond_wait(&drained, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void* AsyncWriter::writerMain(void* void_ptr) {
+    static_cast<AsyncWriter*>(void_ptr)->writerLoop();
+    return nullptr;
+}
+
+void AsyncWriter::writerLoop() {
+    // One pending buffer; switching streams writes it out first, which
+    // keeps stdout and stderr records in queue order relative to each other
+    std::string pending;
+    Stream pendingStream = Stream::OUT;
+    size_t popped = 0;
+    Record record;
+
+    auto writePending = [&] {
+        writeAll(pendingStream == Stream::OUT ? STDOUT_FILENO : STDERR_FILENO, pending);
+    };
+
+    while (true) {
+        size_t batch = 0;
+        while (queue.tryPop(record)) {
+            if (record.stream != pendingStream || pending.size() >= FLUSH_BYTES) {
+                writePending();
+                pendingStream = record.stream;
+            }
+            pending += record.text;
+            ++batch;
+        }
+        writePending();
+        popped += batch;
+
+        if (batch > 0) {
+            pthread_mutex_lock(&mutex);
+            written = popped;
+            pthread_cond_broadcast(&drained);
+            pthread_mutex_unlock(&mutex);
+        }
+
+        pthread_mutex_lock(&mutex);
+        sleeping = true;
+        if (queued == popped) {
+            if (stopping) {
+                sleeping = false;
+                pthread_mutex_unlock(&mutex);
+                break;
+            }
+            pthread_cond_wait(&wake, &mutex);
+        }
+        sleeping = false;
+        pthread_mutex_unlock(&mutex);
+    }
+}
@@ -0,0 +1,79 @@
+/**
+ * @file asyncWriter.h
+ * @brief Dedicated output thread for log records and encoded results
+ *
+ * Producers hand complete records to a lock-free MPSC queue and return
+ * immediately. One writer thread drains the queue and issues large buffered
+ * write() calls, so output never serializes the encoding workers.
+ */
+
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <pthread.h>
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+#include "mpscQueue.h"
+
+/**
+ * @class AsyncWriter
+ * @brief Batches records for stdout and stderr on a background thread
+ *
+ * Records reach each stream in the order they were queued. Producers only
+ * touch the mutex when the writer is asleep or when they wait in flush().
+ */
+class AsyncWriter {
+public:
+    enum class Stream {
+        OUT,
+        ERR
+    };
+
+    /**
+     * @param capacity Records the queue holds before producers back off
+     * @throws std::runtime_error if the writer thread cannot be created
+     */
+    explicit AsyncWriter(size_t capacity = 4096);
+
+    /**
+     * @brief Writes out everything queued, then stops the writer thread
+     */
+    ~AsyncWriter();
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    /**
+     * @brief Queues text for stream; spins politely while the queue is full
+     */
+    void write(Stream stream, std::string text);
+
+    /**
+     * @brief Blocks until every record queued before the call is written
+     */
+    void flush();
+
+private:
+    struct Record {
+        Stream stream = Stream::OUT;
+        std::string text;
+    };
+
+    MpscQueue<Record> queue;
+    std::atomic<size_t> queued{0};      ///< Records pushed so far
+    std::atomic<size_t> written{0};     ///< Records handed to the kernel so far
+    std::atomic<bool> sleeping{false};
+    std::atomic<bool> stopping{false};
+
+    pthread_t tid;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;                ///< Wakes the sleeping writer
+    pthread_cond_t drained;             ///< Wakes flush() callers
+
+    static void* writerMain(void* void_ptr);
+    void writerLoop();
+};
+
+#endif // ASYNC_WRITER_H
@@ -0,0 +1,94 @@
+/**
+ * @file mpscQueue.h
+ * @brief Bounded lock-free multi-producer/single-consumer ring buffer
+ *
+ * Each cell carries a sequence number that tells producers and the consumer
+ * whose turn it is, so producers only contend on one atomic counter and
+ * never take a lock.
+ */
+
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+/**
+ * @class MpscQueue
+ * @brief Fixed-capacity ring; any thread may push, one thread pops
+ */
+template <typename T>
+class MpscQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;   ///< pos when free for push, pos + 1 when full
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    const size_t mask;
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) size_t dequeuePos = 0;  ///< Consumer-only
+
+public:
+    /**
+     * @param capacity Power of two, at least 2
+     */
+    explicit MpscQueue(size_t capacity) : cells(new Cell[capacity]), mask(capacity - 1) {
+        if (capacity < 2 || (capacity & mask) != 0) {
+            throw std::invalid_argument("Queue capacity must be a power of two");
+        }
+        for (size_t i = 0; i < capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /**
+     * @brief Appends value unless the ring is full; safe from any thread
+     */
+    bool tryPush(T& value) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Consumer has not freed this cell yet
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Removes the oldest value if one is ready; consumer thread only
+     */
+    bool tryPop(T& value) {
+        Cell& cell = cells[dequeuePos & mask];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeuePos + 1) < 0) {
+            return false;
+        }
+
+        value = std::move(cell.value);
+        cell.sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+        ++dequeuePos;
+        return true;
+    }
+};
+
+#endif // MPSC_QUEUE_H
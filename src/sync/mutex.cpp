@@ -7,271 +7,226 @@
  * - Critical section management
  * - Condition variables
  * - Thread-safe data structures
- * - Shannon encoding algorithm with synchronized output
+ * - Shannon encoding algorithm with ordered output through a reorder buffer
+ * - Streaming input: lines are read only as the output window frees up
+ * - Memory-mapped input: given a file path, lines are encoded straight from the mapping
+ * - Stage timings and counters with --stats, written to stderr as JSON at exit
  */
 
 #include <iostream>
 #include <vector>
 #include <pthread.h>
 #include <string>
-#include <map>
+#include <string_view>
 #include <algorithm>
-#include <cmath>
 #include <stdexcept>
 #include <memory>
+#include <sstream>
+
+#include "../codec/shannon.h"
+#include "../threading/threadPool.h"
+#include "reorderBuffer.h"
+#include "asyncWriter.h"
+#include "../io/mappedFile.h"
+#include "../metrics/metrics.h"
 
 // Configuration namespace
 namespace Config {
     constexpr int MAX_THREADS = 1000;
     constexpr bool ENABLE_LOGGING = true;
+    constexpr size_t PIPELINE_DEPTH = 1024;    // Lines read ahead of the writer
 }
 
-// Thread-safe logging
+// Log records and results are written by a dedicated output thread
 namespace Logger {
-    static pthread_mutex_t logMutex = PTHREAD_MUTEX_INITIALIZER;
+    AsyncWriter output;
     
     void log(const std::string& message) {
         if (Config::ENABLE_LOGGING) {
-            pthread_mutex_lock(&logMutex);
-            std::cout << "[LOG] " << message << std::endl;
-            pthread_mutex_unlock(&logMutex);
+            output.write(AsyncWriter::Stream::OUT, "[LOG] " + message + "\n");
         }
     }
 }
 
-/**
- * @struct CharCode
- * @brief Character encoding information
- */
-struct CharCode {
-    char character;
-    int freq;
-    std::string code;
-};
-
-/**
- * @struct SharedData
- * @brief Thread-shared data with synchronization primitives
- */
-struct SharedData {
-    std::string line;            // Input line to process
-    int id;                      // Thread ID
-    int* counter;                // Shared counter for synchronization
-    pthread_mutex_t* mutex1;     // First mutex for critical section
-    pthread_mutex_t* mutex2;     // Second mutex for output synchronization
-    pthread_cond_t* condition;   // Condition variable for thread coordination
-    
-    SharedData() : id(0), counter(nullptr), mutex1(nullptr), mutex2(nullptr), condition(nullptr) {}
-};
-
-/**
- * @brief Comparison function for CharCode sorting
- */
-bool compareFreqChar(const CharCode& a, const CharCode& b) {
-    return (a.freq != b.freq) ? (a.freq > b.freq) : (a.character > b.character);
-}
-
-/**
- * @brief Convert decimal to binary with specified precision
- */
-std::string decimalToBinary(float decimal, int precision) {
-    if (precision < 0) {
-        throw std::invalid_argument("Precision cannot be negative");
-    }
-    
-    std::string binary;
-    binary.reserve(precision);
-    
-    while (decimal > 0 && precision > 0) {
-        double temp = decimal * 2;
-        binary += (temp >= 1) ? '1' : '0';
-        decimal = (temp >= 1) ? (temp - 1) : temp;
-        --precision;
-    }
-    
-    binary.append(precision, '0');
-    return binary;
-}
-
 /**
  * @class ShannonEncoder
  * @brief Handles Shannon encoding with thread synchronization
  */
 class ShannonEncoder {
 private:
-    std::vector<CharCode> charCodeVec;
-    std::map<char, std::string> charCodeMap;
-    std::string encodedLine;
-    const std::string& input;
-    
-    void calculateFrequencies() {
-        std::map<char, int> charCountMap;
-        for (char c : input) {
-            ++charCountMap[c];
-        }
-        
-        charCodeVec.reserve(charCountMap.size());
-        for (const auto& [character, freq] : charCountMap) {
-            charCodeVec.push_back({character, freq, ""});
-        }
-        
-        std::sort(charCodeVec.begin(), charCodeVec.end(), compareFreqChar);
-    }
+    Shannon::EncodedMsg msg;
+    std::string_view line;       // msg.line, or a line of the mapped input file
+    std::string error;           // Set when encoding failed
     
-    void generateCodes() {
-        float cumulativeProbability = 0;
-        const int lineSize = input.length();
-        
-        for (auto& charCode : charCodeVec) {
-            float probability = static_cast<float>(charCode.freq) / lineSize;
-            int precision = std::ceil(std::log2(1.0f/probability));
-            
-            charCode.code = decimalToBinary(cumulativeProbability, precision);
-            charCodeMap[charCode.character] = charCode.code;
-            cumulativeProbability += probability;
-        }
+public:
+    explicit ShannonEncoder(std::string inputLine) {
+        msg.line = std::move(inputLine);
+        line = msg.line;
     }
     
-    void encodeMessage() {
-        encodedLine.reserve(input.length() * 8);
-        for (char c : input) {
-            encodedLine += charCodeMap[c];
-        }
-    }
+    explicit ShannonEncoder(std::string_view mappedLine) : line(mappedLine) {}
     
-public:
-    explicit ShannonEncoder(const std::string& inputLine) : input(inputLine) {}
+    // line may point into msg
+    ShannonEncoder(const ShannonEncoder&) = delete;
+    ShannonEncoder& operator=(const ShannonEncoder&) = delete;
     
-    void encode() {
-        calculateFrequencies();
-        generateCodes();
-        encodeMessage();
+    void encode(ThreadPool& pool) {
+        try {
+            if (line.length() >= Shannon::PARALLEL_THRESHOLD) {
+                Shannon::shannonCodeParallel(line, msg, [&pool](size_t count, const std::function<void(size_t)>& task) {
+                    pool.parallelFor(count, task);
+                });
+            } else {
+                Shannon::shannonCode(line, msg);
+            }
+        } catch (const std::exception& e) {
+            error = e.what();
+            throw;
+        }
     }
     
     void displayResults() const {
-        std::cout << "Message: " << input << std::endl << std::endl;
-        std::cout << "Alphabet:" << std::endl;
-        
-        for (const auto& charCode : charCodeVec) {
-            std::cout << "Symbol: " << charCode.character
+        std::ostringstream text;
+        text << "Message: " << line << "\n\n";
+        if (!error.empty()) {
+            text << "Encoding failed: " << error << "\n\n";
+        } else {
+            text << "Alphabet:\n";
+            
+            for (const auto& charCode : msg.charCodeVec) {
+                text << "Symbol: " << charCode.character
                      << ", Frequency: " << charCode.freq
-                     << ", Shannon code: " << charCode.code << std::endl;
+                     << ", Shannon code: " << Shannon::toAscii(charCode) << '\n';
+            }
+            
+            text << "\nEncoded message: " << Shannon::toAscii(msg.encoded) << "\n\n";
         }
-        
-        std::cout << std::endl;
-        std::cout << "Encoded message: " << encodedLine << std::endl << std::endl;
+        Logger::output.write(AsyncWriter::Stream::OUT, text.str());
     }
 };
 
+using Results = ReorderBuffer<std::unique_ptr<ShannonEncoder>>;
+
+/**
+ * @struct TaskData
+ * @brief Per-line task input and the stages it reports to
+ */
+struct TaskData {
+    std::string line;                         // Input line read from stdin
+    std::string_view mapped;                  // Or the line in the mapped input file
+    size_t id;                                // Sequence number of the line
+    ThreadPool* pool;                         // Pool running the task, also used for chunk tasks
+    Results* results;                         // Ordered-output stage
+};
+
 /**
- * @brief Thread function for Shannon encoding
+ * @brief Pool task for Shannon encoding of one line
+ *
+ * Encodes without waiting for earlier lines and hands the result to the
+ * reorder buffer, which restores input order for the writer.
  */
-void* shannonCode(void* void_ptr) {
+void shannonCode(TaskData data) {
+    Logger::log("Thread " + std::to_string(data.id) + " starting processing");
+    Metrics::add(Metrics::Counter::MESSAGES);
+    
+    auto encoder = data.line.empty() ? std::make_unique<ShannonEncoder>(data.mapped)
+                                     : std::make_unique<ShannonEncoder>(std::move(data.line));
     try {
-        SharedData* data = static_cast<SharedData*>(void_ptr);
-        if (!data) throw std::runtime_error("Invalid thread data");
-        
-        // Store local copies of shared data
-        std::string localLine = data->line;
-        int localId = data->id;
-        
-        // Unlock first mutex to allow other threads to start
-        Logger::log("Thread " + std::to_string(localId) + " starting processing");
-        pthread_mutex_unlock(data->mutex1);
-        
-        // Process the line
-        ShannonEncoder encoder(localLine);
-        encoder.encode();
-        
-        // Synchronize output using second mutex and condition variable
-        pthread_mutex_lock(data->mutex2);
-        while (localId != *(data->counter)) {
-            pthread_cond_wait(data->condition, data->mutex2);
-        }
-        pthread_mutex_unlock(data->mutex2);
-        
-        // Display results in synchronized manner
-        encoder.displayResults();
-        
-        // Update counter and signal next thread
-        pthread_mutex_lock(data->mutex2);
-        (*(data->counter))++;
-        pthread_cond_broadcast(data->condition);
-        pthread_mutex_unlock(data->mutex2);
-        
-        Logger::log("Thread " + std::to_string(localId) + " completed");
-        return nullptr;
-        
+        encoder->encode(*data.pool);
     } catch (const std::exception& e) {
         Logger::log("Thread error: " + std::string(e.what()));
-        return nullptr;
     }
+    
+    // Always deliver, even on failure, so the writer never waits on a gap
+    data.results->put(data.id, std::move(encoder));
+    Logger::log("Thread " + std::to_string(data.id) + " completed");
 }
 
-int main() {
+/**
+ * @brief Single writer: flushes each contiguous run of finished lines in order
+ *
+ * Runs until the null end marker, which follows the last line.
+ */
+void* writeResults(void* void_ptr) {
+    Results* results = static_cast<Results*>(void_ptr);
+    while (true) {
+        for (const auto& encoder : results->takeReady()) {
+            if (!encoder) return nullptr;
+            encoder->displayResults();
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
     try {
-        // Initialize synchronization primitives
-        pthread_mutex_t mutex1;
-        pthread_mutex_t mutex2;
-        pthread_cond_t condition = PTHREAD_COND_INITIALIZER;
-        pthread_mutex_init(&mutex1, nullptr);
-        pthread_mutex_init(&mutex2, nullptr);
-        
-        int counter = 0;
-        std::vector<std::string> inputLines;
-        std::string line;
-        
-        // Read input
-        while (std::getline(std::cin, line)) {
-            if (!line.empty()) {
-                inputLines.push_back(line);
+        const std::string usage = "Usage: " + std::string(argv[0]) + " [--stats] [input file]";
+        bool stats = false;
+        std::string inputPath;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--stats") {
+                stats = true;
+            } else if (inputPath.empty()) {
+                inputPath = arg;
+            } else {
+                throw std::runtime_error(usage);
             }
         }
-        
-        if (inputLines.empty()) {
-            std::cout << "No input provided." << std::endl;
-            return 0;
+        if (stats) {
+            Metrics::enable();
         }
         
-        // Initialize shared data
-        SharedData sharedData;
-        sharedData.counter = &counter;
-        sharedData.mutex1 = &mutex1;
-        sharedData.mutex2 = &mutex2;
-        sharedData.condition = &condition;
+        // Outlives every task and the writer, which view its lines
+        std::unique_ptr<MappedFile> file;
+        if (!inputPath.empty()) {
+            file = std::make_unique<MappedFile>(inputPath);
+        }
         
-        // Create threads
-        std::vector<pthread_t> threads;
-        threads.reserve(inputLines.size());
+        const unsigned poolSize = std::min<unsigned>(ThreadPool::defaultThreadCount(), Config::MAX_THREADS);
+        ThreadPool pool(poolSize);
         
-        for (size_t i = 0; i < inputLines.size(); ++i) {
-            pthread_t tid;
-            pthread_mutex_lock(&mutex1);
-            
-            sharedData.line = inputLines[i];
-            sharedData.id = i;
-            
-            if (pthread_create(&tid, nullptr, shannonCode, &sharedData)) {
-                throw std::runtime_error("Failed to create thread " + std::to_string(i));
-            }
-            
-            threads.push_back(tid);
+        Results results(Config::PIPELINE_DEPTH);
+        pthread_t writer;
+        if (pthread_create(&writer, nullptr, writeResults, &results)) {
+            throw std::runtime_error("Failed to create writer thread");
         }
         
-        // Join threads
-        for (pthread_t tid : threads) {
-            pthread_join(tid, nullptr);
+        // Reader: each line waits for room in the window before it is queued,
+        // so no producer ever blocks on the window and memory stays bounded
+        size_t count = 0;
+        auto submit = [&](TaskData data) {
+            results.reserve(count);
+            data.id = count++;
+            pool.submit([data = std::move(data)]() mutable { shannonCode(std::move(data)); });
+        };
+        
+        if (file) {
+            LineScanner lines(file->data());
+            std::string_view line;
+            while (lines.next(line)) {
+                if (!line.empty()) submit(TaskData{std::string(), line, 0, &pool, &results});
+            }
+        } else {
+            std::string line;
+            while (std::getline(std::cin, line)) {
+                if (!line.empty()) submit(TaskData{std::move(line), std::string_view(), 0, &pool, &results});
+            }
         }
         
-        // Cleanup
-        pthread_mutex_destroy(&mutex1);
-        pthread_mutex_destroy(&mutex2);
-        pthread_cond_destroy(&condition);
+        results.put(count, nullptr);
+        pthread_join(writer, nullptr);
+        pool.wait();
         
+        if (count == 0) {
+            Logger::output.write(AsyncWriter::Stream::OUT, "No input provided.\n");
+        }
+        if (stats) {
+            Logger::output.write(AsyncWriter::Stream::ERR, Metrics::toJson() + "\n");
+        }
         return 0;
         
     } catch (const std::exception& e) {
         std::cerr << "Fatal error: " << e.what() << std::endl;
         return 1;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,119 @@
+/**
+ * @file reorderBuffer.h
+ * @brief Ordered-output stage for results that finish out of order
+ *
+ * Producers store each result under its sequence number as soon as it is
+ * ready. A single writer takes the results back in sequence order, a whole
+ * contiguous run at a time. Only the arrival of the next expected result
+ * wakes the writer, so there is no thundering herd of waiting producers.
+ */
+
+#ifndef REORDER_BUFFER_H
+#define REORDER_BUFFER_H
+
+#include <pthread.h>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+ * @class ReorderBuffer
+ * @brief Window of capacity slots indexed by sequence number
+ *
+ * Slot seq % capacity holds result seq. A producer whose result is a full
+ * window ahead of the writer blocks until the writer catches up, which
+ * bounds memory. The producer of the next expected result never blocks.
+ */
+template <typename T>
+class ReorderBuffer {
+private:
+    std::vector<std::optional<T>> slots;
+    size_t next = 0;                ///< Sequence number the writer expects
+    pthread_mutex_t mutex;
+    pthread_cond_t nextReady;       ///< Signalled when result next arrives
+    pthread_cond_t windowMoved;     ///< Signalled when the writer frees slots
+
+public:
+    /**
+     * @param capacity Results that may be buffered ahead of the writer
+     */
+    explicit ReorderBuffer(size_t capacity) : slots(capacity) {
+        if (capacity == 0) {
+            throw std::invalid_argument("Reorder buffer capacity must be positive");
+        }
+        pthread_mutex_init(&mutex, nullptr);
+        pthread_cond_init(&nextReady, nullptr);
+        pthread_cond_init(&windowMoved, nullptr);
+    }
+
+    ~ReorderBuffer() {
+        pthread_cond_destroy(&windowMoved);
+        pthread_cond_destroy(&nextReady);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    ReorderBuffer(const ReorderBuffer&) = delete;
+    ReorderBuffer& operator=(const ReorderBuffer&) = delete;
+
+    /**
+     * @brief Blocks until result seq fits in the window
+     *
+     * A reader that reserves each sequence number before handing out its
+     * work keeps at most a window of results outstanding, so put() never
+     * blocks and producers sharing a pool cannot starve the writer.
+     */
+    void reserve(size_t seq) {
+        pthread_mutex_lock(&mutex);
+        while (seq >= next + slots.size()) {
+            pthread_cond_wait(&windowMoved, &mutex);
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+    /**
+     * @brief Stores result seq; blocks while seq is a full window ahead
+     */
+    void put(size_t seq, T value) {
+        pthread_mutex_lock(&mutex);
+        while (seq >= next + slots.size()) {
+            pthread_cond_wait(&windowMoved, &mutex);
+        }
+        if (seq < next) {
+            pthread_mutex_unlock(&mutex);
+            throw std::logic_error("Sequence number already written");
+        }
+
+        slots[seq % slots.size()] = std::move(value);
+        if (seq == next) {
+            pthread_cond_signal(&nextReady);
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+    /**
+     * @brief Waits for the next expected result, then takes the whole
+     *        contiguous run of ready results in sequence order
+     */
+    std::vector<T> takeReady() {
+        std::vector<T> ready;
+
+        pthread_mutex_lock(&mutex);
+        while (!slots[next % slots.size()]) {
+            pthread_cond_wait(&nextReady, &mutex);
+        }
+        while (slots[next % slots.size()]) {
+            std::optional<T>& slot = slots[next % slots.size()];
+            ready.push_back(std::move(*slot));
+            slot.reset();
+            ++next;
+        }
+        pthread_cond_broadcast(&windowMoved);
+        pthread_mutex_unlock(&mutex);
+
+        return ready;
+    }
+};
+
+#endif // REORDER_BUFFER_H
@@ -3,8 +3,18 @@
  * @brief Implementation of Shannon encoding using multithreading
  * 
  * This file demonstrates parallel processing concepts through a practical implementation
- * of Shannon encoding. Each input string is processed in a separate thread, showcasing:
+ * of Shannon encoding. Input strings are processed by a fixed pool of worker threads, showcasing:
  * - Thread creation and management
+ * - A streaming pipeline: reader, encoding pool and ordered writer, with
+ *   memory bounded by the pipeline depth rather than the input size
+ * - Memory-mapped input: given a file path, lines are encoded straight from the mapping
+ * - Message recycling: written messages go back to the reader, so steady-state
+ *   encoding reuses their buffers instead of allocating
+ * - Stage timings and counters with --stats, written to stderr as JSON at exit
+ * - A .shn archive of the input with --pack, and parallel decoding of any
+ *   range of its blocks with --unpack
+ * - One-pass archiving with --adaptive: tables estimated from a sample and
+ *   rebuilt when the data drifts, so blocks are written as the input streams in
  * - Data structure synchronization
  * - Parallel algorithm execution
  * - Resource management
@@ -14,13 +24,30 @@
 #include <vector>
 #include <pthread.h>
 #include <string>
-#include <map>
-#include <algorithm>
-#include <cmath>
+#include <string_view>
 #include <stdexcept>
 #include <memory>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+
+#include "../codec/shannon.h"
+#include "../codec/container.h"
+#include "../codec/adaptive.h"
+#include "threadPool.h"
+#include "../sync/asyncWriter.h"
+#include "../sync/reorderBuffer.h"
+#include "../sync/mpscQueue.h"
+#include "../io/mappedFile.h"
+#include "../metrics/metrics.h"
+
+using Shannon::EncodedMsg;
 
 namespace {
+    constexpr size_t PIPELINE_DEPTH = 1024;    // Lines read ahead of the writer
+    constexpr size_t SPARE_MESSAGES = 2048;    // Written messages kept for reuse; a power of two
+    constexpr size_t READ_SIZE = 64 * 1024;    // Bytes read from stdin at a time when archiving
+
     // Log levels for better debugging and monitoring
     enum class LogLevel {
         INFO,
@@ -28,200 +55,328 @@ namespace {
         ERROR
     };
 
-    // Thread-safe logging function
+    // Log records and results are written by a dedicated output thread
+    AsyncWriter output;
+
+    // Thread-safe logging function; queues the record and returns
     void log(LogLevel level, const std::string& message) {
-        static pthread_mutex_t logMutex = PTHREAD_MUTEX_INITIALIZER;
-        pthread_mutex_lock(&logMutex);
-        
         switch(level) {
             case LogLevel::INFO:
-                std::cout << "[INFO] ";
+                output.write(AsyncWriter::Stream::OUT, "[INFO] " + message + "\n");
                 break;
             case LogLevel::WARNING:
-                std::cerr << "[WARNING] ";
+                output.write(AsyncWriter::Stream::ERR, "[WARNING] " + message + "\n");
                 break;
             case LogLevel::ERROR:
-                std::cerr << "[ERROR] ";
+                output.write(AsyncWriter::Stream::ERR, "[ERROR] " + message + "\n");
                 break;
         }
+    }
+
+    /**
+     * @struct Message
+     * @brief One input line and its encoding
+     *
+     * line views msg.line for lines read from stdin, or the mapped input file.
+     */
+    struct Message {
+        std::string_view line;
+        EncodedMsg msg;
+    };
+
+    // Formats one message's results for the output thread
+    std::string formatResults(const Message& message) {
+        const EncodedMsg& data = message.msg;
+        std::ostringstream text;
+        text << "\nMessage: " << message.line << "\n\nAlphabet:\n";
         
-        std::cout << message << std::endl;
-        pthread_mutex_unlock(&logMutex);
+        for (const auto& charCode : data.charCodeVec) {
+            text << "Symbol: " << charCode.character
+                 << ", Frequency: " << charCode.freq
+                 << ", Shannon code: " << Shannon::toAscii(charCode) << '\n';
+        }
+        
+        text << "\nEncoded message: " << Shannon::toAscii(data.encoded) << "\n\n";
+        return text.str();
+    }
+    
+    using Results = ReorderBuffer<std::shared_ptr<Message>>;
+
+    // Messages handed back by the writer; the reader pops, the writer pushes
+    MpscQueue<std::shared_ptr<Message>> spareMessages(SPARE_MESSAGES);
+
+    /**
+     * @brief A written message to refill, or a new one when none is spare
+     *
+     * A recycled message keeps the capacity of its line, code table and
+     * encoding, which the next line overwrites in place.
+     */
+    std::shared_ptr<Message> takeMessage() {
+        std::shared_ptr<Message> message;
+        if (!spareMessages.tryPop(message)) {
+            message = std::make_shared<Message>();
+        }
+        return message;
+    }
+    
+    /**
+     * @brief Writer stage: formats results in input order until the null end marker
+     */
+    void* writeResults(void* void_ptr) {
+        Results* results = static_cast<Results*>(void_ptr);
+        while (true) {
+            for (auto& message : results->takeReady()) {
+                if (!message) return nullptr;
+                output.write(AsyncWriter::Stream::OUT, formatResults(*message));
+                spareMessages.tryPush(message);  // Dropped if the spares are full
+            }
+        }
     }
 }
 
 /**
- * @struct CharCode
- * @brief Stores character encoding information
- * 
- * This structure maintains the relationship between characters and their
- * Shannon encoding properties including frequency and binary code.
+ * @brief Pool task for Shannon encoding of one message
+ * @param message Message to encode in place
+ * @param pool Pool the task runs on; large messages are split into chunk
+ *             tasks that idle workers steal
  */
-struct CharCode {
-    char character;          ///< The character being encoded
-    int freq;               ///< Frequency of occurrence
-    std::string code;       ///< Generated Shannon code
-};
+void shannonCode(Message* message, ThreadPool& pool) {
+    try {
+        if (!message) {
+            throw std::runtime_error("Invalid task argument");
+        }
 
-/**
- * @struct EncodedMsg
- * @brief Container for message encoding data
- * 
- * Holds all necessary data for encoding a message, including the original
- * message, character frequencies, and the final encoded result.
- */
-struct EncodedMsg {
-    std::string line;                   ///< Original input message
-    std::vector<CharCode> charCodeVec;  ///< Vector of character encodings
-    std::string encodedLine;            ///< Final encoded message
-};
+        log(LogLevel::INFO, "Starting Shannon encoding for thread");
+        Metrics::add(Metrics::Counter::MESSAGES);
+        if (message->line.length() >= Shannon::PARALLEL_THRESHOLD) {
+            // One huge line would otherwise keep a single core busy
+            Shannon::shannonCodeParallel(message->line, message->msg,
+                                         [&pool](size_t count, const std::function<void(size_t)>& task) {
+                pool.parallelFor(count, task);
+            });
+        } else {
+            Shannon::shannonCode(message->line, message->msg);
+        }
+        log(LogLevel::INFO, "Completed Shannon encoding for thread");
+
+    } catch (const std::exception& e) {
+        log(LogLevel::ERROR, std::string("Thread error: ") + e.what());
+    }
+}
 
 /**
- * @brief Comparison function for sorting CharCode objects
- * @param a First CharCode object
- * @param b Second CharCode object
- * @return true if a should come before b in sorted order
+ * @brief Runs the container's block tasks on the pool
  */
-bool compareFreqChar(const CharCode& a, const CharCode& b) {
-    return (a.freq != b.freq) ? (a.freq > b.freq) : (a.character > b.character);
+Shannon::ParallelFor poolParallelFor(ThreadPool& pool) {
+    return [&pool](size_t count, const std::function<void(size_t)>& task) {
+        pool.parallelFor(count, task);
+    };
 }
 
 /**
- * @brief Converts a decimal probability to binary representation
- * @param decimal The decimal number to convert
- * @param precision The number of binary digits to generate
- * @return Binary string representation
+ * @brief Writes the whole input, line ends included, to a .shn archive
+ * @param file Mapped input, or null to read stdin
  */
-std::string decimalToBinary(float decimal, int precision) {
-    if (precision < 0) {
-        throw std::invalid_argument("Precision cannot be negative");
-    }
-    
-    std::string binary;
-    binary.reserve(precision); // Optimize string operations
-
-    while (decimal > 0 && precision > 0) {
-        double temp = decimal * 2;
-        binary += (temp >= 1) ? '1' : '0';
-        decimal = (temp >= 1) ? (temp - 1) : temp;
-        --precision;
+void packInput(const MappedFile* file, const std::string& archivePath, ThreadPool& pool) {
+    std::string input;
+    if (!file) {
+        input.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
     }
+    const std::string_view data = file ? file->data() : std::string_view(input);
 
-    // Pad remaining positions with zeros
-    binary.append(precision, '0');
-    return binary;
+    Shannon::writeContainer(data, archivePath, Shannon::DEFAULT_BLOCK_SIZE, poolParallelFor(pool));
+    log(LogLevel::INFO, "Packed " + std::to_string(data.size()) + " bytes into " + archivePath);
 }
 
 /**
- * @brief Thread function for Shannon encoding
- * @param void_ptr Pointer to EncodedMsg structure
- * @return nullptr
+ * @brief Writes the input to a .shn archive in one pass, block by block as it arrives
+ *
+ * A mapped file seeds the first table from slices spread over it; stdin
+ * seeds it from a prefix.
+ * @param file Mapped input, or null to read stdin
  */
-void* shannonCode(void* void_ptr) {
-    try {
-        EncodedMsg* curr_ptr = static_cast<EncodedMsg*>(void_ptr);
-        if (!curr_ptr) {
-            throw std::runtime_error("Invalid thread argument");
-        }
-
-        log(LogLevel::INFO, "Starting Shannon encoding for thread");
-        
-        const int lineSize = curr_ptr->line.length();
-        std::map<char, int> charCountMap;
-
-        // Count character frequencies
-        for (char c : curr_ptr->line) {
-            ++charCountMap[c];
-        }
+void packAdaptive(const MappedFile* file, const std::string& archivePath) {
+    Shannon::ContainerWriter writer(archivePath);
+    size_t bytes = 0;
+    Shannon::AdaptiveEncoder encoder([&](const std::vector<Shannon::CharCode>* table,
+                                         const Shannon::BitStream& encoded, size_t symbols) {
+        if (table) writer.writeTable(*table);
+        writer.writeBlock(encoded, symbols);
+        bytes += symbols;
+    });
 
-        // Prepare character codes
-        curr_ptr->charCodeVec.reserve(charCountMap.size());
-        for (const auto& [character, freq] : charCountMap) {
-            curr_ptr->charCodeVec.push_back({character, freq, ""});
+    if (file) {
+        const std::string_view data = file->data();
+        encoder.seed(Shannon::sampleHistogram(data), data.size() <= Shannon::DEFAULT_SAMPLE_SIZE);
+        encoder.append(data.data(), data.size());
+    } else {
+        std::vector<char> buffer(READ_SIZE);
+        while (std::cin.read(buffer.data(), buffer.size()) || std::cin.gcount() > 0) {
+            encoder.append(buffer.data(), std::cin.gcount());
         }
+    }
+    encoder.finish();
+    writer.finish();
 
-        // Sort by frequency and character
-        std::sort(curr_ptr->charCodeVec.begin(), curr_ptr->charCodeVec.end(), compareFreqChar);
-
-        // Calculate Shannon codes
-        float cumulativeProbability = 0;
-        std::map<char, std::string> charCodeMap;
+    std::ostringstream overhead;
+    overhead.precision(2);
+    overhead << std::fixed << encoder.overhead() * 100;
+    log(LogLevel::INFO, "Packed " + std::to_string(bytes) + " bytes into " + archivePath + " as " +
+        std::to_string(writer.blockCount()) + " blocks with " + std::to_string(encoder.tableCount()) +
+        " tables, " + overhead.str() + "% over a table per block");
+}
 
-        for (auto& charCode : curr_ptr->charCodeVec) {
-            float probability = static_cast<float>(charCode.freq) / lineSize;
-            int precision = std::ceil(std::log2(1.0f/probability));
-            
-            charCode.code = decimalToBinary(cumulativeProbability, precision);
-            charCodeMap[charCode.character] = charCode.code;
-            cumulativeProbability += probability;
-        }
+/**
+ * @brief Decodes blocks of a .shn archive into outputPath
+ * @param range "FIRST-LAST" or "FIRST", inclusive; empty selects every block
+ */
+void unpackArchive(const std::string& archivePath, const std::string& range, const std::string& outputPath,
+                   ThreadPool& pool) {
+    MappedFile archive(archivePath);
+    Shannon::ContainerReader reader(archive.data());
 
-        // Generate encoded message
-        curr_ptr->encodedLine.reserve(curr_ptr->line.length() * 8); // Estimate capacity
-        for (char c : curr_ptr->line) {
-            curr_ptr->encodedLine += charCodeMap[c];
+    size_t first = 0;
+    size_t last = reader.blockCount();
+    if (!range.empty()) {
+        const size_t dash = range.find('-');
+        try {
+            first = std::stoul(range.substr(0, dash));
+            last = (dash == std::string::npos ? first : std::stoul(range.substr(dash + 1))) + 1;
+        } catch (const std::logic_error&) {
+            throw std::runtime_error("Invalid block range " + range);
         }
+    }
 
-        log(LogLevel::INFO, "Completed Shannon encoding for thread");
-        return nullptr;
-
-    } catch (const std::exception& e) {
-        log(LogLevel::ERROR, std::string("Thread error: ") + e.what());
-        return nullptr;
+    const std::string data = reader.decode(first, last, poolParallelFor(pool));
+    std::ofstream out(outputPath, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size());
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Error writing " + outputPath);
     }
+    log(LogLevel::INFO, "Unpacked " + std::to_string(last - first) + " of " + std::to_string(reader.blockCount()) +
+        " blocks, " + std::to_string(data.size()) + " bytes, into " + outputPath);
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
-        log(LogLevel::INFO, "Starting Shannon encoding program");
-
-        std::vector<EncodedMsg> threadData;
-        EncodedMsg input;
-        
-        // Read input
-        while (std::getline(std::cin, input.line)) {
-            if (!input.line.empty()) {
-                threadData.push_back(input);
+        const std::string usage = "Usage: " + std::string(argv[0]) +
+                                  " [--stats] [--pack ARCHIVE [--adaptive]] [input file]\n"
+                                  "       " + std::string(argv[0]) +
+                                  " [--stats] --unpack ARCHIVE [--blocks FIRST[-LAST]] output file";
+        bool stats = false;
+        std::string inputPath;
+        std::string packPath;
+        std::string unpackPath;
+        std::string blockRange;
+        bool adaptive = false;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--stats") {
+                stats = true;
+            } else if (arg == "--pack" && i + 1 < argc) {
+                packPath = argv[++i];
+            } else if (arg == "--unpack" && i + 1 < argc) {
+                unpackPath = argv[++i];
+            } else if (arg == "--adaptive") {
+                adaptive = true;
+            } else if (arg == "--blocks" && i + 1 < argc) {
+                blockRange = argv[++i];
+            } else if (inputPath.empty()) {
+                inputPath = arg;
+            } else {
+                throw std::runtime_error(usage);
             }
         }
+        if ((!packPath.empty() && !unpackPath.empty()) || (!unpackPath.empty() && inputPath.empty()) ||
+            (!blockRange.empty() && unpackPath.empty()) || (adaptive && packPath.empty())) {
+            throw std::runtime_error(usage);
+        }
+        if (stats) {
+            Metrics::enable();
+        }
+        log(LogLevel::INFO, "Starting Shannon encoding program");
 
-        if (threadData.empty()) {
-            log(LogLevel::WARNING, "No valid input provided");
+        if (!unpackPath.empty()) {
+            ThreadPool pool;
+            unpackArchive(unpackPath, blockRange, inputPath, pool);
+            if (stats) {
+                output.write(AsyncWriter::Stream::ERR, Metrics::toJson() + "\n");
+            }
             return 0;
         }
 
-        const int threadSize = threadData.size();
-        log(LogLevel::INFO, "Processing " + std::to_string(threadSize) + " messages");
+        // Outlives every task and the writer, which view its lines
+        std::unique_ptr<MappedFile> file;
+        if (!inputPath.empty()) {
+            file = std::make_unique<MappedFile>(inputPath);
+        }
 
-        // Create and manage threads
-        std::vector<pthread_t> threads(threadSize);
+        // Fixed worker pool; idle workers steal queued lines and chunks
+        ThreadPool pool;
+        log(LogLevel::INFO, "Started pool of " + std::to_string(pool.size()) + " workers");
 
-        for (int i = 0; i < threadSize; i++) {
-            if (pthread_create(&threads[i], nullptr, shannonCode, &threadData[i])) {
-                throw std::runtime_error("Failed to create thread " + std::to_string(i));
+        if (!packPath.empty()) {
+            if (adaptive) {
+                packAdaptive(file.get(), packPath);
+            } else {
+                packInput(file.get(), packPath, pool);
+            }
+            if (stats) {
+                output.write(AsyncWriter::Stream::ERR, Metrics::toJson() + "\n");
             }
-            log(LogLevel::INFO, "Created thread " + std::to_string(i));
+            return 0;
         }
 
-        // Join threads
-        for (int i = 0; i < threadSize; i++) {
-            if (pthread_join(threads[i], nullptr)) {
-                throw std::runtime_error("Failed to join thread " + std::to_string(i));
-            }
-            log(LogLevel::INFO, "Joined thread " + std::to_string(i));
+        // The writer prints each line as soon as it and every line before it are encoded
+        Results results(PIPELINE_DEPTH);
+        pthread_t writer;
+        if (pthread_create(&writer, nullptr, writeResults, &results)) {
+            throw std::runtime_error("Failed to create writer thread");
         }
 
-        // Output results
-        for (const auto& data : threadData) {
-            std::cout << "\nMessage: " << data.line << "\n\nAlphabet:\n";
-            
-            for (const auto& charCode : data.charCodeVec) {
-                std::cout << "Symbol: " << charCode.character
-                         << ", Frequency: " << charCode.freq
-                         << ", Shannon code: " << charCode.code << '\n';
+        // Reader stage: a line is read only once the window has room for its result
+        size_t count = 0;
+        auto submit = [&](std::shared_ptr<Message> message) {
+            results.reserve(count);
+            pool.submit([message, seq = count, &pool, &results] {
+                shannonCode(message.get(), pool);
+                results.put(seq, message);
+            });
+            ++count;
+        };
+
+        if (file) {
+            LineScanner lines(file->data());
+            std::string_view line;
+            while (lines.next(line)) {
+                if (line.empty()) continue;
+                auto message = takeMessage();
+                message->line = line;
+                submit(std::move(message));
+            }
+        } else {
+            // Reading into a recycled message reuses its line's capacity
+            auto message = takeMessage();
+            while (std::getline(std::cin, message->msg.line)) {
+                if (message->msg.line.empty()) continue;
+                message->line = message->msg.line;
+                submit(std::move(message));
+                message = takeMessage();
             }
-            
-            std::cout << "\nEncoded message: " << data.encodedLine << "\n\n";
+        }
+
+        results.put(count, nullptr);
+        pthread_join(writer, nullptr);
+        pool.wait();
+
+        if (count == 0) {
+            log(LogLevel::WARNING, "No valid input provided");
+            return 0;
+        }
+        log(LogLevel::INFO, "Encoded " + std::to_string(count) + " messages");
+        if (stats) {
+            output.write(AsyncWriter::Stream::ERR, Metrics::toJson() + "\n");
         }
 
         log(LogLevel::INFO, "Program completed successfully");
@@ -231,4 +386,4 @@ int main() {
         log(LogLevel::ERROR, std::string("Program error: ") + e.what());
         return 1;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,242 @@
+/**
+ * @file threadPool.cpp
+ * @brief Fixed-size POSIX worker pool implementation
+ */
+
+#include "threadPool.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+    // Worker executing the current thread's task, if any
+    thread_local void* currentWorker = nullptr;
+}
+
+ThreadPool::ThreadPool(unsigned threads) {
+    pthread_mutex_init(&mutex, nullptr);
+    pthread_cond_init(&taskReady, nullptr);
+    pthread_cond_init(&allDone, nullptr);
+
+    if (threads == 0) threads = defaultThreadCount();
+
+    // Deques must all exist before any worker starts stealing
+    workers.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->pool = this;
+        workers.back()->index = i;
+    }
+
+    size_t started = 0;
+    pthread_mutex_lock(&mutex);
+    for (auto& worker : workers) {
+        if (pthread_create(&worker->tid, nullptr, workerMain, worker.get())) {
+            break;  // Run with the workers we have
+        }
+        ++started;
+    }
+
+    // Workers that failed to start never touch their deque; drop them
+    // before any task can be queued
+    workers.resize(started);
+    pthread_mutex_unlock(&mutex);
+
+    if (workers.empty()) {
+        pthread_cond_destroy(&allDone);
+        pthread_cond_destroy(&taskReady);
+        pthread_mutex_destroy(&mutex);
+        throw std::runtime_error("Failed to create any pool worker");
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    pthread_mutex_lock(&mutex);
+    while (outstanding > 0) {
+        pthread_cond_wait(&allDone, &mutex);
+    }
+    stopping = true;
+    pthread_cond_broadcast(&taskReady);
+    pthread_mutex_unlock(&mutex);
+
+    for (auto& worker : workers) {
+        pthread_join(worker->tid, nullptr);
+        pthread_mutex_destroy(&worker->mutex);
+    }
+
+    pthread_cond_destroy(&allDone);
+    pthread_cond_destroy(&taskReady);
+    pthread_mutex_destroy(&mutex);
+}
+
+unsigned ThreadPool::defaultThreadCount() {
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? static_cast<unsigned>(cpus) : 1;
+}
+
+void ThreadPool::submit(Task task) {
+    // Count first so a sleeping worker never misses the task
+    pthread_mutex_lock(&mutex);
+    ++outstanding;
+    ++queued;
+    pthread_mutex_unlock(&mutex);
+
+    Worker* self = static_cast<Worker*>(currentWorker);
+    if (self && self->pool == this) {
+        // Spawned by a running task: first in line for thieves
+        pthread_mutex_lock(&self->mutex);
+        self->tasks.push_front(std::move(task));
+        pthread_mutex_unlock(&self->mutex);
+    } else {
+        Worker& target = *workers[nextWorker++ % workers.size()];
+        pthread_mutex_lock(&target.mutex);
+        target.tasks.push_back(std::move(task));
+        pthread_mutex_unlock(&target.mutex);
+    }
+
+    pthread_mutex_lock(&mutex);
+    pthread_cond_signal(&taskReady);
+    pthread_mutex_unlock(&mutex);
+}
+
+void ThreadPool::wait() {
+    pthread_mutex_lock(&mutex);
+    while (outstanding > 0) {
+        pthread_cond_wait(&allDone, &mutex);
+    }
+    std::exception_ptr failure = error;
+    error = nullptr;
+    pthread_mutex_unlock(&mutex);
+
+    if (failure) std::rethrow_exception(failure);
+}
+
+void* ThreadPool::workerMain(void* void_ptr) {
+    Worker* self = static_cast<Worker*>(void_ptr);
+    currentWorker = self;
+
+    // The constructor holds the pool mutex until the worker list is final
+    pthread_mutex_lock(&self->pool->mutex);
+    pthread_mutex_unlock(&self->pool->mutex);
+
+    self->pool->workerLoop(*self);
+    return nullptr;
+}
+
+bool ThreadPool::takeTask(Worker& self, Task& task) {
+    // Oldest task first, from our own deque and then from the others
+    const size_t count = workers.size();
+    for (size_t offset = 0; offset < count; ++offset) {
+        Worker& victim = *workers[(self.index + offset) % count];
+        pthread_mutex_lock(&victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            pthread_mutex_unlock(&victim.mutex);
+            --queued;
+            return true;
+        }
+        pthread_mutex_unlock(&victim.mutex);
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(Worker& self) {
+    while (true) {
+        Task task;
+        if (!takeTask(self, task)) {
+            pthread_mutex_lock(&mutex);
+            while (queued == 0 && !stopping) {
+                pthread_cond_wait(&taskReady, &mutex);
+            }
+            const bool done = (queued == 0);
+            pthread_mutex_unlock(&mutex);
+            if (done) break;  // Stopping and drained
+            continue;
+        }
+
+        std::exception_ptr failure;
+        try {
+            task();
+        } catch (...) {
+            failure = std::current_exception();
+        }
+        task = nullptr;
+
+        pthread_mutex_lock(&mutex);
+        if (failure && !error) error = failure;
+        if (--outstanding == 0) {
+            pthread_cond_broadcast(&allDone);
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+}
+
+namespace {
+    /**
+     * @struct ForBatch
+     * @brief Index range shared by the caller and helpers of one parallelFor
+     */
+    struct ForBatch {
+        const std::function<void(size_t)>* task;
+        size_t count;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> finished{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+        pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+
+        ~ForBatch() {
+            pthread_cond_destroy(&done);
+            pthread_mutex_destroy(&mutex);
+        }
+
+        void run() {
+            for (size_t i = next++; i < count; i = next++) {
+                if (!failed) {
+                    try {
+                        (*task)(i);
+                    } catch (...) {
+                        pthread_mutex_lock(&mutex);
+                        if (!error) error = std::current_exception();
+                        pthread_mutex_unlock(&mutex);
+                        failed = true;
+                    }
+                }
+
+                if (++finished == count) {
+                    pthread_mutex_lock(&mutex);
+                    pthread_cond_broadcast(&done);
+                    pthread_mutex_unlock(&mutex);
+                }
+            }
+        }
+    };
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) return;
+
+    // Helpers hold a reference so a late starter never touches a dead batch
+    auto batch = std::make_shared<ForBatch>();
+    batch->task = &task;
+    batch->count = count;
+
+    const size_t helpers = std::min<size_t>(workers.size(), count - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        submit([batch] { batch->run(); });
+    }
+    batch->run();
+
+    pthread_mutex_lock(&batch->mutex);
+    while (batch->finished < count) {
+        pthread_cond_wait(&batch->done, &batch->mutex);
+    }
+    pthread_mutex_unlock(&batch->mutex);
+
+    if (batch->error) std::rethrow_exception(batch->error);
+}
@@ -0,0 +1,115 @@
+/**
+ * @file threadPool.h
+ * @brief Fixed-size POSIX worker pool shared by the tools, client and server
+ *
+ * A bounded set of workers runs all tasks, so the number of threads no
+ * longer grows with the number of input lines. Each worker owns a task deque
+ * and idle workers steal from the others, so one long task never strands the
+ * work queued behind it.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief Fixed number of pthreads with per-worker deques and work stealing
+ *
+ * Tasks submitted from outside the pool are dealt round-robin to the worker
+ * deques and taken oldest-first, both by the owner and by thieves, so they
+ * still start in submission order. Tasks submitted by a running task go to
+ * the front of that worker's own deque, where idle workers steal them first.
+ */
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * @brief Starts the workers
+     * @param threads Worker count; 0 selects defaultThreadCount()
+     * @throws std::runtime_error if no worker could be created
+     */
+    explicit ThreadPool(unsigned threads = 0);
+
+    /**
+     * @brief Finishes all queued tasks, then stops and joins the workers
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Queues a task for the pool
+     */
+    void submit(Task task);
+
+    /**
+     * @brief Blocks until every submitted task has finished
+     * @throws The first exception escaping a task since the last wait()
+     */
+    void wait();
+
+    /**
+     * @brief Runs task(0) .. task(count - 1) on the pool and the calling thread
+     *
+     * The caller claims indexes alongside the helpers it queues, so this is
+     * safe to call from inside a pool task and never waits on a queue that it
+     * blocks itself.
+     * @throws The first exception escaping a task
+     */
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+    /**
+     * @brief Number of worker threads
+     */
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    /**
+     * @brief Number of online CPUs, at least 1
+     */
+    static unsigned defaultThreadCount();
+
+private:
+    /**
+     * @struct Worker
+     * @brief A worker thread and the deque it owns
+     */
+    struct Worker {
+        ThreadPool* pool;
+        size_t index;
+        pthread_t tid;
+        std::deque<Task> tasks;
+        pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> nextWorker{0};  ///< Round-robin target for outside submissions
+    std::atomic<size_t> queued{0};      ///< Tasks sitting in some deque
+    size_t outstanding = 0;             ///< Tasks submitted but not finished
+    bool stopping = false;
+    std::exception_ptr error;           ///< First task failure, reported by wait()
+
+    pthread_mutex_t mutex;              ///< Guards outstanding, stopping, error and sleeping
+    pthread_cond_t taskReady;           ///< Signalled when work is queued or on shutdown
+    pthread_cond_t allDone;             ///< Signalled when the pool becomes idle
+
+    static void* workerMain(void* void_ptr);
+    void workerLoop(Worker& self);
+
+    /**
+     * @brief Takes a task from self's deque, or steals one from another worker
+     */
+    bool takeTask(Worker& self, Task& task);
+};
+
+#endif // THREAD_POOL_H
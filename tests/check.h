@@ -0,0 +1,51 @@
+/**
+ * @file check.h
+ * @brief Minimal assertions for the test executables
+ *
+ * A failed check prints where it failed and is counted; main returns
+ * checkFailures() so ctest sees a non-zero exit.
+ */
+
+#ifndef SHANNON_TESTS_CHECK_H
+#define SHANNON_TESTS_CHECK_H
+
+#include <exception>
+#include <iostream>
+
+namespace Check {
+    inline int& failures() {
+        static int count = 0;
+        return count;
+    }
+
+    inline void report(bool ok, const char* expression, const char* file, int line) {
+        if (ok) return;
+        ++failures();
+        std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+    }
+}
+
+/// Records a failure unless condition holds
+#define CHECK(condition) Check::report(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
+
+/// Records a failure unless statement throws an exception of type Exception
+#define CHECK_THROWS(Exception, statement)                              \
+    do {                                                                \
+        bool thrown = false;                                            \
+        try {                                                           \
+            statement;                                                  \
+        } catch (const Exception&) {                                    \
+            thrown = true;                                              \
+        } catch (const std::exception& e) {                             \
+            std::cerr << "unexpected exception: " << e.what() << "\n";  \
+        }                                                               \
+        Check::report(thrown, "throws " #Exception ": " #statement,     \
+                      __FILE__, __LINE__);                              \
+    } while (false)
+
+inline int checkFailures() {
+    if (Check::failures() == 0) std::cout << "All checks passed" << std::endl;
+    return Check::failures() == 0 ? 0 : 1;
+}
+
+#endif // SHANNON_TESTS_CHECK_H
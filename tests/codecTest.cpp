@@ -0,0 +1,117 @@
+/**
+ * @file codecTest.cpp
+ * @brief Encode and decode round trips on the kernel the environment selects
+ *
+ * ctest runs this once per SHANNON_KERNEL value. Every kernel must produce
+ * the bits spelled out by the code table, whichever path the message takes.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../src/codec/shannon.h"
+#include "../src/codec/kernels.h"
+#include "check.h"
+
+namespace {
+    /**
+     * @brief The bits of line written out symbol by symbol from the table, independent of any kernel
+     */
+    std::string referenceBits(const std::string& line, const std::vector<Shannon::CharCode>& table) {
+        std::string codes[256];
+        for (const Shannon::CharCode& charCode : table) {
+            codes[static_cast<unsigned char>(charCode.character)] = Shannon::toAscii(charCode);
+        }
+        std::string bits;
+        for (char c : line) bits += codes[static_cast<unsigned char>(c)];
+        return bits;
+    }
+
+    std::vector<std::string> samples() {
+        std::mt19937 random(42);
+        std::vector<std::string> lines = {"", "a", "aaaaaaaa", "COSC 3360 COSC 1437", "hello world"};
+
+        std::string everyByte;
+        for (int i = 0; i < 3000; ++i) everyByte += static_cast<char>(random() & 0xFF);
+        lines.push_back(everyByte);
+
+        // Skewed counts give codes from 1 bit up to the longest the alphabet needs
+        std::string skewed;
+        for (int i = 0; i < 200000; ++i) {
+            const unsigned r = random() % 1000;
+            skewed += r < 700 ? 'e' : r < 900 ? 't' : r < 990 ? static_cast<char>('a' + r % 26)
+                                                             : static_cast<char>(random() & 0xFF);
+        }
+        lines.push_back(skewed);
+
+        // Long enough for the parallel path
+        std::string text;
+        while (text.size() < Shannon::PARALLEL_THRESHOLD + 12345) text += skewed;
+        lines.push_back(text);
+        return lines;
+    }
+
+    void checkRoundTrip(const std::string& line) {
+        Shannon::EncodedMsg msg;
+        msg.line = line;
+        Shannon::shannonCode(msg);
+        CHECK(msg.encoded.bitCount == referenceBits(line, msg.charCodeVec).size());
+        CHECK(Shannon::toAscii(msg.encoded) == referenceBits(line, msg.charCodeVec));
+        if (!line.empty()) {
+            CHECK(Shannon::decode(msg.encoded, msg.charCodeVec) == line);
+        }
+
+        // Chunked parallel encoding stitches the same bits together
+        Shannon::EncodedMsg parallel;
+        parallel.line = line;
+        Shannon::shannonCodeParallel(parallel, Shannon::threadParallelFor(4), 1000 + line.size() / 7);
+        CHECK(parallel.encoded.bitCount == msg.encoded.bitCount);
+        CHECK(parallel.encoded.bytes == msg.encoded.bytes);
+
+        // So does a table encoder fed uneven pieces
+        if (line.empty()) return;
+        Shannon::CodeTable codes = Shannon::makeCodeTable(msg.charCodeVec);
+        Shannon::TableEncoder encoder(codes);
+        size_t offset = 0;
+        for (size_t piece = 1; offset < line.size(); piece = piece * 3 + 1) {
+            const size_t take = std::min(piece, line.size() - offset);
+            encoder.append(line.data() + offset, take);
+            offset += take;
+        }
+        const Shannon::BitStream streamed = encoder.finish();
+        CHECK(streamed.bitCount == msg.encoded.bitCount);
+        CHECK(streamed.bytes == msg.encoded.bytes);
+    }
+
+    void checkCountLimits() {
+        Shannon::Histogram hist{};
+        hist['a'] = Shannon::MAX_FREQ;
+        hist['b'] = 1;
+        CHECK(Shannon::buildCodeTable(hist).size() == 2);
+
+        hist['a'] = 0x90000000u;
+        CHECK_THROWS(std::invalid_argument, Shannon::buildCodeTable(hist));
+    }
+}
+
+int main() {
+    const char* forced = std::getenv("SHANNON_KERNEL");
+    std::cout << "Kernel: " << Shannon::encodeKernelName();
+    if (forced && std::strcmp(forced, Shannon::encodeKernelName()) != 0) {
+        std::cout << " (" << forced << " is not supported by this CPU)";
+    }
+    std::cout << std::endl;
+
+    try {
+        for (const std::string& line : samples()) checkRoundTrip(line);
+        checkCountLimits();
+    } catch (const std::exception& e) {
+        std::cerr << "Unexpected exception: " << e.what() << std::endl;
+        return 1;
+    }
+    return checkFailures();
+}
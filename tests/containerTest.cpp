@@ -0,0 +1,214 @@
+/**
+ * @file containerTest.cpp
+ * @brief .shn archives read back whole and by range, and rejected when damaged
+ *
+ * Version 2 files come from writeContainer and the adaptive encoder; a
+ * version 1 file is laid out by hand, since nothing writes them any more.
+ */
+
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../src/codec/shannon.h"
+#include "../src/codec/container.h"
+#include "../src/codec/adaptive.h"
+#include "check.h"
+
+namespace {
+    constexpr size_t FOOTER_SIZE = 2 * sizeof(uint64_t) + 4;
+    constexpr size_t INDEX_ENTRY_SIZE = 4 * sizeof(uint64_t);
+
+    template <typename T>
+    void append(std::string& out, const T& value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    void patch(std::string& file, size_t offset, const T& value) {
+        std::memcpy(&file[offset], &value, sizeof(value));
+    }
+
+    template <typename T>
+    T peek(const std::string& file, size_t offset) {
+        T value;
+        std::memcpy(&value, file.data() + offset, sizeof(value));
+        return value;
+    }
+
+    std::string temporaryPath(const char* name) {
+        return (std::filesystem::temp_directory_path() /
+                (std::string(name) + "." + std::to_string(getpid()) + ".shn")).string();
+    }
+
+    std::string readFile(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    std::string sampleText(size_t lines, const char* words) {
+        std::string text;
+        for (size_t i = 0; i < lines; ++i) {
+            text += words;
+            text += ' ';
+            text += std::to_string(i * 7919 % 1000);
+            text += '\n';
+        }
+        return text;
+    }
+
+    /**
+     * @brief Damages a valid version 2 file in the ways a reader must catch
+     */
+    void checkCorruption(const std::string& file) {
+        const size_t indexOffset = peek<uint64_t>(file, file.size() - FOOTER_SIZE);
+
+        std::string shifted = file;    // First block no longer follows its table
+        patch(shifted, indexOffset, peek<uint64_t>(file, indexOffset) + 1);
+        CHECK_THROWS(std::runtime_error, Shannon::ContainerReader{shifted});
+
+        std::string longer = file;     // Bit counts no longer tile the data
+        const size_t bitCount = indexOffset + sizeof(uint64_t);
+        patch(longer, bitCount, peek<uint64_t>(file, bitCount) + 64);
+        CHECK_THROWS(std::runtime_error, Shannon::ContainerReader{longer});
+
+        std::string miscounted = file; // Footer block count disagrees with the index size
+        const size_t count = file.size() - FOOTER_SIZE + sizeof(uint64_t);
+        patch(miscounted, count, peek<uint64_t>(file, count) + 1);
+        CHECK_THROWS(std::runtime_error, Shannon::ContainerReader{miscounted});
+
+        std::string outside = file;    // Index offset past the end of the data
+        patch(outside, file.size() - FOOTER_SIZE, uint64_t(file.size()));
+        CHECK_THROWS(std::runtime_error, Shannon::ContainerReader{outside});
+
+        std::string nowhere = file;    // Table offset naming no table
+        patch(nowhere, indexOffset + INDEX_ENTRY_SIZE - sizeof(uint64_t), uint64_t(3));
+        CHECK_THROWS(std::runtime_error, Shannon::ContainerReader{nowhere});
+
+        CHECK_THROWS(std::runtime_error, Shannon::ContainerReader{file.substr(0, file.size() - 1)});
+        CHECK_THROWS(std::runtime_error, Shannon::ContainerReader{std::string_view("SHNC")});
+    }
+
+    void checkVersion2() {
+        const std::string data = sampleText(20000, "the quick brown fox");
+        const std::string path = temporaryPath("container_v2");
+        Shannon::writeContainer(data, path, 16 * 1024, Shannon::threadParallelFor(4));
+        const std::string file = readFile(path);
+        std::remove(path.c_str());
+
+        const Shannon::ContainerReader reader(file);
+        const std::vector<std::string_view> blocks = Shannon::splitBlocks(data, 16 * 1024);
+        CHECK(reader.blockCount() == blocks.size());
+        CHECK(reader.tableCount() == 1);
+        CHECK(reader.symbolCount() == data.size());
+        CHECK(reader.decode(0, reader.blockCount(), Shannon::threadParallelFor(4)) == data);
+
+        const std::string middle = std::string(blocks[2]) + std::string(blocks[3]);
+        CHECK(reader.decode(2, 4) == middle);
+        CHECK_THROWS(std::out_of_range, reader.decode(1, reader.blockCount() + 1));
+
+        checkCorruption(file);
+    }
+
+    void checkAdaptive() {
+        // The data changes halfway, so the encoder has to switch tables
+        const std::string data = sampleText(8000, "aaaa abab baba") + sampleText(8000, "XYZ xyz ZYX zyx");
+        const std::string path = temporaryPath("container_adaptive");
+        size_t tables = 0;
+        {
+            Shannon::ContainerWriter writer(path);
+            Shannon::AdaptiveEncoder encoder(
+                [&](const std::vector<Shannon::CharCode>* table, const Shannon::BitStream& encoded, size_t symbols) {
+                    if (table) writer.writeTable(*table);
+                    writer.writeBlock(encoded, symbols);
+                },
+                8 * 1024, 4 * 1024);
+            for (size_t offset = 0; offset < data.size(); offset += 1000) {
+                encoder.append(data.data() + offset, std::min<size_t>(1000, data.size() - offset));
+            }
+            encoder.finish();
+            writer.finish();
+            tables = encoder.tableCount();
+        }
+        const std::string file = readFile(path);
+        std::remove(path.c_str());
+
+        const Shannon::ContainerReader reader(file);
+        CHECK(tables > 1);
+        CHECK(reader.tableCount() == tables);
+        CHECK(reader.decode(0, reader.blockCount()) == data);
+    }
+
+    /**
+     * @brief A version 1 file: one table in the header and three-field index entries
+     */
+    void checkVersion1() {
+        const std::string data = sampleText(3000, "legacy format");
+        const std::vector<std::string_view> blocks = Shannon::splitBlocks(data, 4096);
+
+        Shannon::Histogram hist{};
+        Shannon::countFrequencies(data.data(), data.size(), hist);
+        Shannon::CodeTable codes;
+        const std::vector<Shannon::CharCode> table = Shannon::buildCodeTable(hist, codes);
+
+        std::string file = "SHNC";
+        append(file, uint32_t(1));
+        append(file, uint64_t(data.size()));
+        append(file, static_cast<uint16_t>(table.size()));
+        for (const Shannon::CharCode& charCode : table) {
+            append(file, static_cast<uint8_t>(charCode.character));
+            append(file, static_cast<uint32_t>(charCode.freq));
+        }
+        std::string index;
+        for (std::string_view block : blocks) {
+            Shannon::TableEncoder encoder(codes);
+            encoder.append(block.data(), block.size());
+            const Shannon::BitStream encoded = encoder.finish();
+            append(index, uint64_t(file.size()));
+            append(index, encoded.bitCount);
+            append(index, uint64_t(block.size()));
+            file.append(reinterpret_cast<const char*>(encoded.bytes.data()), Shannon::packedSize(encoded.bitCount));
+        }
+        const uint64_t indexOffset = file.size();
+        file += index;
+        append(file, indexOffset);
+        append(file, uint64_t(blocks.size()));
+        file += "SHNC";
+
+        const Shannon::ContainerReader reader(file);
+        CHECK(reader.blockCount() == blocks.size());
+        CHECK(reader.tableCount() == 1);
+        CHECK(reader.decode(0, reader.blockCount()) == data);
+        CHECK(reader.decode(1, 2) == blocks[1]);
+
+        std::string future = file;
+        patch(future, 4, uint32_t(3));
+        CHECK_THROWS(std::runtime_error, Shannon::ContainerReader{future});
+    }
+
+    void checkInputLimit() {
+        // Nothing is read past the size check, so the view's bytes are never touched
+        const std::string_view huge("", size_t(Shannon::MAX_FREQ) + 1);
+        CHECK_THROWS(std::invalid_argument, Shannon::writeContainer(huge, temporaryPath("container_huge")));
+    }
+}
+
+int main() {
+    try {
+        checkVersion2();
+        checkAdaptive();
+        checkVersion1();
+        checkInputLimit();
+    } catch (const std::exception& e) {
+        std::cerr << "Unexpected exception: " << e.what() << std::endl;
+        return 1;
+    }
+    return checkFailures();
+}
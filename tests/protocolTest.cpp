@@ -0,0 +1,144 @@
+/**
+ * @file protocolTest.cpp
+ * @brief Request and response frames parsed back, and malformed ones rejected
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../src/codec/shannon.h"
+#include "../src/network/protocol.h"
+#include "check.h"
+
+namespace {
+    template <typename T>
+    void append(std::string& out, const T& value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    std::string header(uint16_t type, uint32_t length) {
+        std::string bytes;
+        append(bytes, uint32_t(7));
+        append(bytes, type);
+        append(bytes, uint16_t(0));
+        append(bytes, length);
+        return bytes;
+    }
+
+    void checkBatchRequest() {
+        const std::vector<std::string_view> messages = {"hello", "", "world!"};
+        const std::string frame = Protocol::serializeBatchRequest(7, messages);
+        const Protocol::RequestHeader parsed = Protocol::parseRequestHeader(frame.data());
+        CHECK(parsed.type == Protocol::RequestType::BATCH);
+        CHECK(parsed.length == frame.size() - Protocol::REQUEST_HEADER_SIZE);
+
+        const std::string body = frame.substr(Protocol::REQUEST_HEADER_SIZE);
+        const std::vector<std::string> split = Protocol::parseBatchRequest(body.data(), body.size());
+        CHECK(split == std::vector<std::string>({"hello", "", "world!"}));
+
+        std::string tooMany = body;     // More messages than length fields could fit
+        const uint32_t count = 1000;
+        std::memcpy(&tooMany[0], &count, sizeof(count));
+        CHECK_THROWS(std::runtime_error, Protocol::parseBatchRequest(tooMany.data(), tooMany.size()));
+
+        std::string overlong = body;    // First message runs past the end
+        const uint32_t messageLength = 0xFFFFFFF0u;
+        std::memcpy(&overlong[sizeof(uint32_t)], &messageLength, sizeof(messageLength));
+        CHECK_THROWS(std::runtime_error, Protocol::parseBatchRequest(overlong.data(), overlong.size()));
+
+        const std::string trailing = body + "x";
+        CHECK_THROWS(std::runtime_error, Protocol::parseBatchRequest(trailing.data(), trailing.size()));
+        CHECK_THROWS(std::runtime_error, Protocol::parseBatchRequest(body.data(), body.size() - 1));
+        CHECK_THROWS(std::runtime_error, Protocol::parseBatchRequest(body.data(), 2));
+    }
+
+    void checkCounts() {
+        Shannon::Histogram hist{};
+        hist['a'] = 3;
+        hist['z'] = Shannon::MAX_FREQ;
+        hist[0xFF] = 1;
+        const std::string frame = Protocol::serializeCountsRequest(7, hist);
+        const std::string body = frame.substr(Protocol::REQUEST_HEADER_SIZE);
+        CHECK(Protocol::parseCounts(body.data(), body.size()) == hist);
+
+        std::string tooMany;            // More symbols than byte values
+        append(tooMany, uint16_t(257));
+        for (int i = 0; i < 257; ++i) {
+            append(tooMany, static_cast<uint8_t>(i));
+            append(tooMany, uint32_t(1));
+        }
+        CHECK_THROWS(std::runtime_error, Protocol::parseCounts(tooMany.data(), tooMany.size()));
+
+        std::string overflow;           // A count CharCode::freq cannot hold
+        append(overflow, uint16_t(1));
+        append(overflow, uint8_t('a'));
+        append(overflow, uint32_t(Shannon::MAX_FREQ) + 1);
+        CHECK_THROWS(std::runtime_error, Protocol::parseCounts(overflow.data(), overflow.size()));
+
+        const std::string trailing = body + "x";
+        CHECK_THROWS(std::runtime_error, Protocol::parseCounts(trailing.data(), trailing.size()));
+        CHECK_THROWS(std::runtime_error, Protocol::parseCounts(body.data(), body.size() - 1));
+        CHECK_THROWS(std::runtime_error, Protocol::parseCounts(body.data(), 1));
+    }
+
+    void checkRequestHeaders() {
+        using Protocol::RequestType;
+        CHECK(Protocol::parseRequestHeader(header(uint16_t(RequestType::STATS), 0).data()).length == 0);
+        CHECK(Protocol::parseRequestHeader(header(uint16_t(RequestType::TABLE), 4).data()).length == 4);
+
+        // Fixed-size bodies cannot announce anything else
+        CHECK_THROWS(std::runtime_error, Protocol::parseRequestHeader(header(uint16_t(RequestType::STATS), 1).data()));
+        CHECK_THROWS(std::runtime_error, Protocol::parseRequestHeader(header(uint16_t(RequestType::TABLE), 5).data()));
+        CHECK_THROWS(std::runtime_error,
+                     Protocol::parseRequestHeader(header(uint16_t(RequestType::ENCODE_STATIC), 3).data()));
+        CHECK_THROWS(std::runtime_error,
+                     Protocol::parseRequestHeader(header(uint16_t(RequestType::BATCH_STATIC), 0).data()));
+        CHECK_THROWS(std::runtime_error,
+                     Protocol::parseRequestHeader(header(uint16_t(RequestType::TRAIN_COUNTS), 2 + 257 * 5).data()));
+
+        CHECK_THROWS(std::runtime_error, Protocol::parseRequestHeader(header(9, 0).data()));
+        CHECK_THROWS(std::runtime_error,
+                     Protocol::parseRequestHeader(header(0, Protocol::MAX_MESSAGE_SIZE + 1).data()));
+        CHECK_THROWS(std::invalid_argument, Protocol::serializeRequestHeader(7, Protocol::MAX_MESSAGE_SIZE + 1));
+    }
+
+    void checkResponses() {
+        Shannon::EncodedMsg msg;
+        msg.line = "abracadabra";
+        Shannon::shannonCode(msg);
+        const std::string frame = Protocol::serializeResponse(7, msg);
+        const std::string body = frame.substr(Protocol::RESPONSE_LENGTH_SIZE);
+
+        Protocol::Result result;
+        Protocol::parseResponse(body.data(), body.size(), result);
+        CHECK(Protocol::responseRequestId(body.data(), body.size()) == 7);
+        CHECK(result.encoded.bitCount == msg.encoded.bitCount);
+        CHECK(Shannon::decode(result.encoded, result.table) == msg.line);
+
+        // A bit count no frame could carry is refused before anything is sized for it
+        std::string huge = body;
+        const uint64_t bitCount = std::numeric_limits<uint64_t>::max() - 7;
+        const size_t bitCountOffset = body.size() - sizeof(uint64_t) - Shannon::packedSize(msg.encoded.bitCount);
+        std::memcpy(&huge[bitCountOffset], &bitCount, sizeof(bitCount));
+        CHECK_THROWS(std::runtime_error, Protocol::parseResponse(huge.data(), huge.size(), result));
+        CHECK_THROWS(std::runtime_error, Protocol::parseResponse(body.data(), body.size() - 1, result));
+    }
+}
+
+int main() {
+    try {
+        checkBatchRequest();
+        checkCounts();
+        checkRequestHeaders();
+        checkResponses();
+    } catch (const std::exception& e) {
+        std::cerr << "Unexpected exception: " << e.what() << std::endl;
+        return 1;
+    }
+    return checkFailures();
+}
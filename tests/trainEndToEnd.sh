@@ -0,0 +1,76 @@
+#!/usr/bin/env bash
+# Trains a static table on a forking server, then encodes with it by id from
+# a second connection, which lands in a different child. Every line must come
+# back decoded unchanged both times.
+#
+# Usage: trainEndToEnd.sh SERVER CLIENT
+set -euo pipefail
+
+server=$1
+client=$2
+work=$(mktemp -d)
+serverPid=
+
+cleanup() {
+    if [ -n "$serverPid" ]; then
+        kill "$serverPid" 2>/dev/null || true
+        wait "$serverPid" 2>/dev/null || true
+    fi
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+for i in $(seq 1 200); do
+    echo "line $i of the training corpus: the quick brown fox jumps over $((i * 37 % 101)) lazy dogs"
+done > "$work/corpus.txt"
+
+# Try a few ports in case one is taken
+for attempt in 1 2 3 4 5; do
+    port=$((20000 + (RANDOM % 20000)))
+    "$server" "$port" > "$work/server.log" 2>&1 &
+    serverPid=$!
+    for wait in $(seq 1 50); do
+        grep -q "running on port" "$work/server.log" && break
+        kill -0 "$serverPid" 2>/dev/null || break
+        sleep 0.1
+    done
+    grep -q "running on port" "$work/server.log" && break
+    wait "$serverPid" 2>/dev/null || true
+    serverPid=
+done
+if [ -z "$serverPid" ]; then
+    echo "Server did not start:" >&2
+    cat "$work/server.log" >&2
+    exit 1
+fi
+
+# Messages and their decodings, in input order, must both equal the corpus
+check() {
+    local output=$1
+    sed -n 's/^Message: //p' "$output" | cmp -s - "$work/corpus.txt" ||
+        { echo "Messages in $output differ from the corpus" >&2; exit 1; }
+    sed -n 's/^Decoded message: //p' "$output" | cmp -s - "$work/corpus.txt" ||
+        { echo "Decoded messages in $output differ from the corpus" >&2; exit 1; }
+}
+
+# Runs the client with the given options on the corpus, showing its errors if it fails
+run() {
+    local name=$1
+    shift
+    "$client" 127.0.0.1 "$port" "$@" < "$work/corpus.txt" > "$work/$name.out" 2> "$work/$name.err" ||
+        { echo "Client $* failed:" >&2; cat "$work/$name.err" >&2; exit 1; }
+}
+
+run train --train
+check "$work/train.out"
+table=$(sed -n 's/.*Trained static table \([0-9]*\).*/\1/p' "$work/train.err")
+if [ -z "$table" ]; then
+    echo "Client did not report a trained table:" >&2
+    cat "$work/train.err" >&2
+    exit 1
+fi
+
+run table --table "$table" --file "$work/corpus.txt"
+check "$work/table.out"
+
+echo "Table $table trained and reused over $(wc -l < "$work/corpus.txt") lines"